@@ -0,0 +1,92 @@
+#include "Border.hpp"
+
+#include <algorithm>
+
+const char * BorderModeName(int mode)
+{
+  switch (mode)
+  {
+  case BORDER_CLAMP: return "clamp";
+  case BORDER_MIRROR: return "mirror";
+  case BORDER_WRAP: return "wrap";
+  case BORDER_CONSTANT: return "constant";
+  }
+  return "unknown";
+}
+
+int BorderIndex(int i, int n, int mode)
+{
+  if (i >= 0 && i < n)
+    return i;
+
+  switch (mode)
+  {
+  case BORDER_CLAMP:
+    return i < 0 ? 0 : n - 1;
+  case BORDER_MIRROR:
+    i %= 2 * n;
+    if (i < 0)
+      i += 2 * n;
+    return i < n ? i : 2 * n - 1 - i;
+  case BORDER_WRAP:
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+  return -1;
+}
+
+imageRect TileInterior(const imageRect& tile, int nWidth, int nHeight, int nFilterWidth)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  imageRect interior;
+  interior.x0 = std::max(tile.x0, nAnchor);
+  interior.y0 = std::max(tile.y0, nAnchor);
+  interior.x1 = std::min(tile.x1, nWidth - (nFilterWidth - 1 - nAnchor));
+  interior.y1 = std::min(tile.y1, nHeight - (nFilterWidth - 1 - nAnchor));
+  return interior;
+}
+
+int AlignedPitch(int nWidth, int nPixelSize)
+{
+  const int nCacheLine = 64;
+  const int nPage = 4096;
+
+  // Smallest pixel count whose size is a multiple of the cache line
+  int a = nCacheLine, b = nPixelSize;
+  while (b)
+  {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  const int nAlign = nCacheLine / a;
+
+  int nPitch = (nWidth + nAlign - 1) / nAlign * nAlign;
+  if ((nPitch * nPixelSize) % nPage == 0)
+    nPitch += nAlign;
+
+  return nPitch;
+}
+
+void ConvolveBorder(const float * pInput, const float * pFilter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+		    const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+		    const int nNumThreads)
+{
+  ConvolveBorderT<floatOps>(pInput, pFilter, pOutput,
+			    nPitch, nWidth, nHeight, nChannels,
+			    nFilterWidth, nBorderMode, fBorderValue,
+			    nNumThreads);
+}
+
+void ConvolveBorderTile(const float * pInput, const float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+			const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			const imageRect& tile)
+{
+  ConvolveBorderTileT<floatOps>(pInput, pFilter, pOutput,
+				nPitch, nWidth, nHeight, nChannels,
+				nFilterWidth, nBorderMode, fBorderValue,
+				tile);
+}
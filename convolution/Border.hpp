@@ -0,0 +1,184 @@
+#ifndef __BORDER_H__
+#define __BORDER_H__
+
+#include <omp.h>
+
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Border handling
+//
+// Input and output images have the same nWidth x nHeight size and
+// the same row pitch. Output pixel (x, y) is the sum of
+// filter[r][c] * input(x + c - anchor, y + r - anchor), with
+// anchor = FilterAnchor(nFilterWidth). Input coordinates outside
+// the image are remapped according to the border mode:
+//
+// BORDER_CLAMP     aaa|abcd|ddd
+// BORDER_MIRROR    cba|abcd|dcb   (edge pixel repeated, as CLK_ADDRESS_MIRRORED_REPEAT)
+// BORDER_WRAP      bcd|abcd|abc
+// BORDER_CONSTANT  kkk|abcd|kkk
+//
+// Engines compute the interior, where every tap is inside the image,
+// with their branch-free kernel and leave the rest to
+// ConvolveBorder(), the only code that pays for the remapping.
+/////////////////////////////////////////////////////////////////
+
+enum borderMode
+{
+  BORDER_CLAMP = 0,
+  BORDER_MIRROR,
+  BORDER_WRAP,
+  BORDER_CONSTANT,
+  BORDER_MODE_COUNT
+};
+
+const char * BorderModeName(int mode);
+
+// Remapped coordinate in [0, n), or -1 for a constant border
+int BorderIndex(int i, int n, int mode);
+
+inline int FilterAnchor(int nFilterWidth)
+{
+  return (nFilterWidth - 1) / 2;
+}
+
+// Row pitch in pixels: rows start on a 64-byte boundary and the pitch
+// is never a multiple of 4 KiB, which would map every row of a tall
+// filter window to the same cache sets.
+int AlignedPitch(int nWidth, int nPixelSize);
+
+// Output rectangle [x0, x1) x [y0, y1)
+struct imageRect
+{
+  int x0, y0;
+  int x1, y1;
+};
+
+inline bool RectEmpty(const imageRect& rect)
+{
+  return rect.x0 >= rect.x1 || rect.y0 >= rect.y1;
+}
+
+// Part of tile whose filter windows are fully inside the image
+imageRect TileInterior(const imageRect& tile, int nWidth, int nHeight, int nFilterWidth);
+
+/////////////////////////////////////////////////////////////////
+// Border convolution
+//
+// Computes every output pixel of an nChannels-interleaved image whose
+// filter window is not fully inside the image. Ops provides the
+// storage and accumulator types, load() and narrow().
+//
+// The Tile variants do the same for the pixels of one output tile, on
+// the calling thread. Engines pair them with their valid kernel to
+// convolve any tile of the image (see TileScheduler.hpp).
+/////////////////////////////////////////////////////////////////
+
+struct floatOps
+{
+  typedef float storage;
+  typedef float acc;
+
+  static float load(float v) { return v; }
+  static float narrow(float sum) { return sum; }
+};
+
+template <class Ops>
+void ConvolveBorderTileT(const typename Ops::storage * pInput, const typename Ops::acc * pFilter,
+			 typename Ops::storage * pOutput,
+			 const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+			 const int nFilterWidth, const int nBorderMode, const typename Ops::acc borderValue,
+			 const imageRect& tile)
+{
+  typedef typename Ops::acc acc;
+
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int xInteriorEnd = nWidth - (nFilterWidth - 1 - nAnchor);
+  const int yInteriorEnd = nHeight - (nFilterWidth - 1 - nAnchor);
+
+  // Nothing to do for tiles inside the interior
+  if (tile.x0 >= nAnchor && tile.x1 <= xInteriorEnd &&
+      tile.y0 >= nAnchor && tile.y1 <= yInteriorEnd)
+    return;
+
+  // Remapped input column / row for tile coordinate i at tap i + c
+  std::vector<int> xIndex(tile.x1 - tile.x0 + nFilterWidth - 1);
+  std::vector<int> yIndex(tile.y1 - tile.y0 + nFilterWidth - 1);
+  for (int i = 0; i < (int) xIndex.size(); i++)
+    xIndex[i] = BorderIndex(tile.x0 + i - nAnchor, nWidth, nBorderMode);
+  for (int i = 0; i < (int) yIndex.size(); i++)
+    yIndex[i] = BorderIndex(tile.y0 + i - nAnchor, nHeight, nBorderMode);
+
+  for (int yOut = tile.y0; yOut < tile.y1; yOut++)
+  {
+    const bool bFullRow = (yOut < nAnchor || yOut >= yInteriorEnd);
+    const int * pYIndex = &yIndex[yOut - tile.y0];
+
+    for (int xOut = tile.x0; xOut < tile.x1; xOut++)
+    {
+      // Skip the interior span of the row
+      if (!bFullRow && xOut >= nAnchor && xOut < xInteriorEnd)
+      {
+	xOut = xInteriorEnd - 1;
+	continue;
+      }
+
+      const int * pXIndex = &xIndex[xOut - tile.x0];
+
+      for (int ch = 0; ch < nChannels; ch++)
+      {
+	acc sum = 0;
+	for (int r = 0; r < nFilterWidth; r++)
+	{
+	  const int yIn = pYIndex[r];
+
+	  for (int c = 0; c < nFilterWidth; c++)
+	  {
+	    const int xIn = pXIndex[c];
+	    const acc v = (yIn < 0 || xIn < 0) ? borderValue
+	      : Ops::load(pInput[(yIn * nPitch + xIn) * nChannels + ch]);
+	    sum += pFilter[r * nFilterWidth + c] * v;
+	  }
+	}
+	pOutput[(yOut * nPitch + xOut) * nChannels + ch] = Ops::narrow(sum);
+      }
+    }
+  }
+}
+
+// Whole image, one band of rows per thread
+template <class Ops>
+void ConvolveBorderT(const typename Ops::storage * pInput, const typename Ops::acc * pFilter,
+		     typename Ops::storage * pOutput,
+		     const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+		     const int nFilterWidth, const int nBorderMode, const typename Ops::acc borderValue,
+		     const int nNumThreads)
+{
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    const int nThreads = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+
+    imageRect band;
+    band.x0 = 0;
+    band.x1 = nWidth;
+    band.y0 = (int)((long long)nHeight * tid / nThreads);
+    band.y1 = (int)((long long)nHeight * (tid+1) / nThreads);
+
+    if (band.y0 < band.y1)
+      ConvolveBorderTileT<Ops>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nChannels,
+			       nFilterWidth, nBorderMode, borderValue, band);
+  }
+}
+
+void ConvolveBorder(const float * pInput, const float * pFilter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+		    const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+		    const int nNumThreads);
+void ConvolveBorderTile(const float * pInput, const float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight, const int nChannels,
+			const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			const imageRect& tile);
+
+#endif
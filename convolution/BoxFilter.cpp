@@ -0,0 +1,134 @@
+#include "BoxFilter.hpp"
+#include "Border.hpp"
+
+#include <omp.h>
+#include <stddef.h>
+#include <vector>
+
+bool IsConstantFilter(const float * pFilter, const int nFilterWidth, float * pWeight)
+{
+  const int nFilterSize = nFilterWidth * nFilterWidth;
+
+  for (int i = 1; i < nFilterSize; i++)
+    if (pFilter[i] != pFilter[0])
+      return false;
+
+  *pWeight = pFilter[0];
+  return true;
+}
+
+// Horizontal sums of nFilterWidth inputs for nCount outputs, xIndex[k]
+// being the remapped column of the k-th input, -1 for constant. A NULL
+// pRow is a constant border row.
+static void BoxRowSums(const float * pRow, const int * xIndex, const int nCount,
+		       const int nFilterWidth, const float fBorderValue, double * pSum)
+{
+  if (!pRow)
+  {
+    for (int x = 0; x < nCount; x++)
+      pSum[x] = double(fBorderValue) * nFilterWidth;
+    return;
+  }
+
+  double sum = 0;
+  for (int c = 0; c < nFilterWidth - 1; c++)
+    sum += (xIndex[c] < 0) ? fBorderValue : pRow[xIndex[c]];
+
+  for (int x = 0; x < nCount; x++)
+  {
+    const int xAdd = xIndex[x + nFilterWidth - 1];
+    const int xSub = xIndex[x];
+
+    sum += (xAdd < 0) ? fBorderValue : pRow[xAdd];
+    pSum[x] = sum;
+    sum -= (xSub < 0) ? fBorderValue : pRow[xSub];
+  }
+}
+
+// Output rect on the calling thread, xIndex covering its columns and
+// filter margin. Only the nFilterWidth rows of horizontal sums the
+// vertical sum spans are kept, in a ring, so they stay in cache and
+// nothing image-sized is written.
+static void ConvolveBoxRect(const float * pInput, float * pOutput,
+			    const int nPitch, const int nHeight,
+			    const int nFilterWidth, const float fWeight,
+			    const int nBorderMode, const float fBorderValue,
+			    const imageRect& rect, const int * xIndex)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nRectWidth = rect.x1 - rect.x0;
+  const int nRows = rect.y1 - rect.y0 + nFilterWidth - 1;
+
+  std::vector<double> ring((size_t) nFilterWidth * nRectWidth);
+  std::vector<double> colSum(nRectWidth, 0.0);
+
+  for (int i = 0; i < nRows; i++)
+  {
+    const int yIn = BorderIndex(rect.y0 + i - nAnchor, nHeight, nBorderMode);
+    double * pAdd = &ring[(size_t) (i % nFilterWidth) * nRectWidth];
+
+    BoxRowSums((yIn < 0) ? NULL : pInput + (size_t) yIn * nPitch, xIndex, nRectWidth,
+	       nFilterWidth, fBorderValue, pAdd);
+
+    if (i < nFilterWidth - 1)
+    {
+      for (int x = 0; x < nRectWidth; x++)
+	colSum[x] += pAdd[x];
+      continue;
+    }
+
+    // Window rows i - nFilterWidth + 1 to i, the first leaves next
+    const double * pSub = &ring[(size_t) ((i + 1) % nFilterWidth) * nRectWidth];
+    float * pOut = pOutput + (size_t) (rect.y0 + i - nFilterWidth + 1) * nPitch + rect.x0;
+
+    for (int x = 0; x < nRectWidth; x++)
+    {
+      colSum[x] += pAdd[x];
+      pOut[x] = float(colSum[x] * fWeight);
+      colSum[x] -= pSub[x];
+    }
+  }
+}
+
+void ConvolveBox(const float * pInput, float * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight,
+		 const int nFilterWidth, const float fWeight,
+		 const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  // Remapped input column for padded coordinate i, -1 for constant
+  std::vector<int> xIndex(nWidth + nFilterWidth - 1);
+  for (int i = 0; i < (int) xIndex.size(); i++)
+    xIndex[i] = BorderIndex(i - nAnchor, nWidth, nBorderMode);
+
+  // Each thread slides over its own band of rows, the column loops are
+  // unit-stride SIMD loops
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    const int nThreads = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+    const imageRect band = {0, (int)((long long)nHeight * tid / nThreads),
+			    nWidth, (int)((long long)nHeight * (tid+1) / nThreads)};
+
+    if (!RectEmpty(band))
+      ConvolveBoxRect(pInput, pOutput, nPitch, nHeight, nFilterWidth, fWeight,
+		      nBorderMode, fBorderValue, band, &xIndex[0]);
+  }
+}
+
+void ConvolveBoxTile(const float * pInput, float * pOutput,
+		     const int nPitch, const int nWidth, const int nHeight,
+		     const int nFilterWidth, const float fWeight,
+		     const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  // Remapped input column for tile coordinate i, -1 for constant
+  std::vector<int> xIndex(tile.x1 - tile.x0 + nFilterWidth - 1);
+  for (int i = 0; i < (int) xIndex.size(); i++)
+    xIndex[i] = BorderIndex(tile.x0 + i - nAnchor, nWidth, nBorderMode);
+
+  ConvolveBoxRect(pInput, pOutput, nPitch, nHeight, nFilterWidth, fWeight,
+		  nBorderMode, fBorderValue, tile, &xIndex[0]);
+}
@@ -0,0 +1,36 @@
+#ifndef __BOXFILTER_H__
+#define __BOXFILTER_H__
+
+#include "Border.hpp"
+
+/////////////////////////////////////////////////////////////////
+// Box (mean) filter
+//
+// When every filter tap has the same weight the convolution is
+// separable into a horizontal and a vertical running sum, so each
+// output costs one add and one subtract per pass whatever the filter
+// width. Running sums are kept in double so that the add/subtract
+// sliding does not drift over long rows and columns. Each thread or
+// tile keeps the horizontal sums of the nFilterWidth rows under its
+// vertical window only, in a ring.
+//
+// Geometry and borders are the same as the direct engine, see
+// Border.hpp.
+/////////////////////////////////////////////////////////////////
+
+// True if all nFilterWidth^2 taps are equal, *pWeight receives the tap
+bool IsConstantFilter(const float * pFilter, const int nFilterWidth, float * pWeight);
+
+void ConvolveBox(const float * pInput, float * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight,
+		 const int nFilterWidth, const float fWeight,
+		 const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// One output tile on the calling thread. The running sums start at
+// the tile edge, so only the tile and its filter margin are read.
+void ConvolveBoxTile(const float * pInput, float * pOutput,
+		     const int nPitch, const int nWidth, const int nHeight,
+		     const int nFilterWidth, const float fWeight,
+		     const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+#endif
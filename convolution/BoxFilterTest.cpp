@@ -0,0 +1,109 @@
+/////////////////////////////////////////////////////////////////
+// box_test: checks ConvolveBox() and ConvolveBoxTile() against a
+// dense reference, on bands and tiles shorter than the filter, where
+// the ring of row sums wraps within a single output row. Every output
+// pixel outside the image or the tile starts as a sentinel and must
+// keep it.
+/////////////////////////////////////////////////////////////////
+
+#include "BoxFilter.hpp"
+#include "Workload.hpp"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#define SENTINEL -999.0f
+#define TOLERANCE 1e-5f
+
+static float DensePixel(const float * pInput, int nFilterWidth, float fWeight,
+			int nPitch, int nWidth, int nHeight, int nBorderMode, float fBorderValue, int x, int y)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  double sum = 0;
+
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const int xIn = BorderIndex(x + c - nAnchor, nWidth, nBorderMode);
+      const int yIn = BorderIndex(y + r - nAnchor, nHeight, nBorderMode);
+      sum += (xIn < 0 || yIn < 0) ? fBorderValue : pInput[yIn * nPitch + xIn];
+    }
+  return float(sum * fWeight);
+}
+
+// Pixels of tile must match the dense reference, every other pixel of
+// the nPitch x nHeight buffer must still be the sentinel
+static int CheckOutput(const float * pInput, const float * pOutput, int nFilterWidth, float fWeight,
+		       int nPitch, int nWidth, int nHeight, int nBorderMode, const imageRect& tile, const char * pCase)
+{
+  int nFailures = 0;
+
+  for (int y = 0; y < nHeight; y++)
+    for (int x = 0; x < nPitch; x++)
+    {
+      const bool bInside = x >= tile.x0 && x < tile.x1 && y >= tile.y0 && y < tile.y1;
+      const float fExpected = bInside ? DensePixel(pInput, nFilterWidth, fWeight, nPitch, nWidth, nHeight,
+						   nBorderMode, 0.5f, x, y) : SENTINEL;
+      const float fValue = pOutput[y * nPitch + x];
+
+      if (bInside ? !(fabsf(fValue - fExpected) <= TOLERANCE) : fValue != SENTINEL)
+      {
+	if (nFailures == 0)
+	  printf("%s, %dx%d filter %d, %s border: (%d, %d) = %g, expected %g\n", pCase, nWidth, nHeight,
+		 nFilterWidth, BorderModeName(nBorderMode), x, y, fValue, fExpected);
+	nFailures++;
+      }
+    }
+  return nFailures;
+}
+
+int main()
+{
+  int nChecks = 0, nFailures = 0;
+
+  // Whole images on 4 threads: the short images give bands of one or
+  // two rows, each refilling the ring from its own margin
+  const int sizes[][3] = {{64, 48, 1}, {64, 48, 2}, {64, 48, 9}, {37, 5, 13}, {3, 40, 7}, {200, 2, 41}, {1, 1, 5}};
+  for (int s = 0; s < 7; s++)
+    for (int nBorderMode = 0; nBorderMode < BORDER_MODE_COUNT; nBorderMode++)
+    {
+      const int nWidth = sizes[s][0], nHeight = sizes[s][1], nFilterWidth = sizes[s][2];
+      const int nPitch = nWidth + 3;
+      const float fWeight = 1.0f / (nFilterWidth * nFilterWidth);
+      std::vector<float> input(nPitch * nHeight), output(nPitch * nHeight, SENTINEL);
+
+      FillPattern(&input[0], nPitch, nWidth, nHeight, 1, PATTERN_UNIFORM, s, WORKLOAD_STREAM_INPUT, 1);
+
+      const imageRect image = {0, 0, nWidth, nHeight};
+      ConvolveBox(&input[0], &output[0], nPitch, nWidth, nHeight, nFilterWidth, fWeight, nBorderMode, 0.5f, 4);
+      nFailures += CheckOutput(&input[0], &output[0], nFilterWidth, fWeight, nPitch, nWidth, nHeight,
+			       nBorderMode, image, "image") > 0;
+      nChecks++;
+    }
+
+  // Tiles at the edges and in the middle, some shorter and narrower
+  // than the filter
+  const imageRect tiles[] = {{0, 0, 4, 8}, {60, 8, 64, 16}, {30, 20, 31, 21}, {0, 0, 64, 1}, {10, 5, 13, 40}, {0, 0, 64, 40}};
+  const int filterWidths[] = {1, 4, 11, 41};
+  for (int t = 0; t < 6; t++)
+    for (int f = 0; f < 4; f++)
+      for (int nBorderMode = 0; nBorderMode < BORDER_MODE_COUNT; nBorderMode++)
+      {
+	const int nWidth = 64, nHeight = 40, nPitch = 80, nFilterWidth = filterWidths[f];
+	const float fWeight = 1.0f / (nFilterWidth * nFilterWidth);
+	std::vector<float> input(nPitch * nHeight), output(nPitch * nHeight, SENTINEL);
+
+	FillPattern(&input[0], nPitch, nWidth, nHeight, 1, PATTERN_UNIFORM, t, WORKLOAD_STREAM_INPUT, 1);
+
+	ConvolveBoxTile(&input[0], &output[0], nPitch, nWidth, nHeight, nFilterWidth, fWeight,
+			nBorderMode, 0.5f, tiles[t]);
+	nFailures += CheckOutput(&input[0], &output[0], nFilterWidth, fWeight, nPitch, nWidth, nHeight,
+				 nBorderMode, tiles[t], "tile") > 0;
+	nChecks++;
+      }
+
+  printf("%d checks, %d failures\n", nChecks, nFailures);
+  return nFailures == 0 ? 0 : 1;
+}
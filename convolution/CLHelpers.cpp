@@ -2,11 +2,13 @@
 
 #include <cstdio>
 
+// Platforms are enumerated on the first call only
 void CLHelpers::getDevice(int id, cl::Device& device)
 {
-  std::vector<cl::Device> devices;
+  static std::vector<cl::Device> devices;
 
-  getAllDevices(devices);
+  if (devices.empty())
+    getAllDevices(devices);
   device = devices[id];
 }
 void CLHelpers::getAllDevices(std::vector<cl::Device>& devices)
@@ -2,29 +2,205 @@
 #define __CONVOLUTION_H__
 
 #include "Timer.hpp"
+#include "HwCounters.hpp"
+#include "RaplCounters.hpp"
 #include "StatFile.hpp"
+#include "TypedConvolution.hpp"
+#include "MultiChannel.hpp"
+#include "Border.hpp"
+#include "BoxFilter.hpp"
+#include "Winograd.hpp"
+#include "Service.hpp"
+#include "FrameRing.hpp"
+#include "JobExecutor.hpp"
+#include "Pipeline.hpp"
+#include "Pyramid.hpp"
+#include "Workload.hpp"
+#include "TileScheduler.hpp"
+#include "FilterBank.hpp"
+#include "SparseFilter.hpp"
+#include "DeviceRegistry.hpp"
+#include "Temporal.hpp"
+#include "Incremental.hpp"
+
+#include <CL/cl.hpp>
 
 struct hostBufferStruct
 {
 float * pInput;
 float * pFilter;
+bool bBoxFilter;		// pFilter has identical taps of weight fBoxWeight
+float fBoxWeight;
+sparseFilter sparse;		// Non-zero taps of pFilter
 float * pOutputCPU;
-} hostBuffers;
+float * pOutputGPU;
+size_t nCapacity;		// Floats allocated in the three buffers above (service mode)
+
+// Storage for params.nDataType != DATA_FLOAT
+void * pInputTyped;
+int32_t * pFilterFixed;
+void * pOutputTyped;
+
+// Storage for params.nChannels > 1, same image in both layouts
+float * pInputInterleaved;
+float * pOutputInterleaved;
+float * pInputPlanar;
+float * pOutputPlanar;
+};
+extern hostBufferStruct hostBuffers;
 
 struct timerStruct
 {
 double dCpuTime;
+double dGpuTime;
 CPerfCounter counter;
-} timers;
+HwCounters hwCounters;		// Open when params.bHwCounters and perf is available
+RaplCounters energy;		// Open when params.bEnergy and RAPL is readable
+};
+extern timerStruct timers;
+
+/////////////////////////////////////////////////////////////////
+// Engines
+//
+// Benchmark mode times every engine enabled by the current params
+// into its own stat file. Otherwise only the selected one is run.
+/////////////////////////////////////////////////////////////////
+
+enum cpuEngine
+{
+  CPU_DIRECT = 0,		// Convolve()
+  CPU_TYPED,			// ConvolveU8/U16/Half() for params.nDataType
+  CPU_INTERLEAVED,		// ConvolveInterleaved()
+  CPU_PLANAR,			// ConvolvePlanar()
+  CPU_PLANAR_TRANSPOSED,	// ConvolvePlanar() on interleaved data, transposes included
+  CPU_BOX,			// ConvolveBox()
+  CPU_WINOGRAD_F2,		// ConvolveWinograd() F(2x2, 3x3) and F(2x2, 5x5)
+  CPU_WINOGRAD_F4,		// ConvolveWinograd() F(4x4, 3x3)
+  CPU_SPARSE,			// ConvolveSparse()
+  CPU_ENGINE_COUNT
+};
+
+enum gpuEngine
+{
+  GPU_DIRECT = 0,		// convolve
+  GPU_TYPED,			// convolve_u8/u16/half for params.nDataType
+  GPU_INTERLEAVED,		// convolve_rgb/rgba
+  GPU_PLANAR,			// convolve_planar
+  GPU_BOX,			// box_rows + box_columns
+  GPU_LOCAL,			// convolve_local
+  GPU_IMAGE,			// convolve_image
+  GPU_WINOGRAD_F2,		// convolve_winograd F(2x2, 3x3) and F(2x2, 5x5)
+  GPU_WINOGRAD_F4,		// convolve_winograd F(4x4, 3x3)
+  GPU_SPARSE,			// convolve_sparse
+  GPU_SPARSE_FIXED,		// convolve_sparse with the taps compiled in
+  GPU_ENGINE_COUNT
+};
+
+// Input path of the float single-channel engine outside benchmark mode
+enum gpuInput
+{
+  GPU_INPUT_BUFFER = 0,		// GPU_DIRECT
+  GPU_INPUT_LOCAL,		// GPU_LOCAL
+  GPU_INPUT_IMAGE,		// GPU_IMAGE
+  GPU_INPUT_COUNT
+};
+
+struct gpuContextStruct
+{
+int nDevice;			// Index in the device registry
+cl::Device device;
+cl::Context context;
+cl::CommandQueue queue;
+cl::Program program;
+};
+
+// A service device: its context and kernel, created at startup, and
+// its buffers, grown like the host ones so steady-state jobs only
+// transfer
+struct serviceDeviceStruct
+{
+gpuContextStruct gpu;
+cl::Kernel kernel;
+cl::Buffer input;
+cl::Buffer output;
+cl::Buffer filter;
+size_t nImageBytes;		// Capacity of input and output
+size_t nFilterBytes;		// Capacity of filter
+};
+
+// Limits of the target device that some engines depend on
+struct gpuDeviceStruct
+{
+bool bImageSupport;
+cl_ulong nLocalMemSize;
+};
+extern gpuDeviceStruct gpuDevice;
+extern DeviceRegistry registry;
+
+// Tiles and workers of the tiled CPU schedules
+struct tileSchedulerStruct
+{
+std::vector<imageRect> tiles;	// params.nTileSize tiles in params.nTileOrder
+TilePool * pPool;		// Workers of the current RunCPU(), NULL outside it
+};
+extern tileSchedulerStruct scheduler;
 
 struct statFileStruct
 {
-StatFile cpu4Threads;
-} stats;
+StatFile cpu[CPU_ENGINE_COUNT];
+StatFile schedule[SCHEDULE_COUNT];	// Selected engine under each CPU schedule
+StatFile gpu[GPU_ENGINE_COUNT];
+};
+extern statFileStruct stats;
+
+struct paramStruct;
+
+// What one convolution reads and writes. The engine wrappers take it
+// instead of the globals above, so a second convolution, an executor
+// job for one, brings its own parameters and buffers. driverState
+// points at the globals.
+struct convolutionState
+{
+const paramStruct * pParams;
+const hostBufferStruct * pBuffers;
+timerStruct * pTimers;			// TimeCPU() and the GPU runs only
+statFileStruct * pStats;		// CompareSchedules() only
+const tileSchedulerStruct * pScheduler;	// Tiled schedules only
+};
+extern convolutionState driverState;
+
+enum filterType
+{
+  FILTER_RANDOM = 0,		// Normalized random taps
+  FILTER_BOX,			// Mean filter
+  FILTER_CROSS,			// Normalized random taps on the anchor row and column
+  FILTER_LAPLACIAN,		// Zero-sum cross, -(taps - 1) at the anchor and 1 elsewhere
+  FILTER_TYPE_COUNT
+};
+
+#define BENCHMARK_FILTER_COUNT 8
 
-#define BENCHMARK_FILTER_COUNT 6
+extern int benchmarkFilterWidths[BENCHMARK_FILTER_COUNT];
 
-int benchmarkFilterWidths[BENCHMARK_FILTER_COUNT] = {2, 4, 8, 16, 32, 64};
+// Image heights of the size sweep: SWEEP_MIN_SIZE, twice that, ...
+// up to params.nSweepSize, each with the widths of sweepWidth
+#define SWEEP_MIN_SIZE 64
+#define SWEEP_MIN_TAPS 5e7	// Filter taps per timed point, so small images time over several iterations
+
+enum sweepPitch
+{
+  SWEEP_PITCH_PADDED = 0,	// AlignedPitch(), moved off the power of two where it lands on it
+  SWEEP_PITCH_POW2,		// Smallest power of two holding the width
+  SWEEP_PITCH_COUNT
+};
+
+enum sweepWidth
+{
+  SWEEP_WIDTH_POW2 = 0,		// The height
+  SWEEP_WIDTH_ODD,		// One less: a remainder on every row
+  SWEEP_WIDTH_WIDE,		// 3/2 of it plus one, far from a power of two
+  SWEEP_WIDTH_COUNT
+};
 
 #define FREE(ptr, free_val)			\
   if (ptr != free_val)				\
@@ -39,6 +215,9 @@ int benchmarkFilterWidths[BENCHMARK_FILTER_COUNT] = {2, 4, 8, 16, 32, 64};
 
 void InitFilterHostBuffer(int width);
 void InitHostBuffers();
+void InitTypedHostBuffers();
+void InitMultiChannelHostBuffers();
+void InitFilterTaps(float * pFilter, int width, int nCounter);
 void InitFilterHostBuffer(int width);
 
 void ClearBuffer(float * pBuf);
@@ -50,6 +229,11 @@ void ReleaseHostBuffers();
 
 void PrintInfo();
 void PrintCPUTime(int run);
+void OpenHwCounters();
+std::string HwCounterSummary(const convolutionState& state);
+void OpenEnergyCounters();
+std::string EnergySummary(const convolutionState& state, double dTime);
+void PrintGPUTime();
 
 /////////////////////////////////////////////////////////////////
 // Statistics
@@ -63,15 +247,124 @@ void ReleaseStatFiles();
 /////////////////////////////////////////////////////////////////
 
 void Convolve(float * pInput, float * pFilter, float * pOutput,
-	      const int nInWidth, const int nWidth, const int nHeight,
+	      const int nPitch, const int nWidth, const int nHeight,
 	      const int nFilterWidth, const int nNumThreads);
+void ConvolveWithBorder(float * pInput, float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			const int nNumThreads);
+void ConvolveWithBorderTile(float * pInput, float * pFilter, float * pOutput,
+			    const int nPitch, const int nWidth, const int nHeight,
+			    const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			    const imageRect& tile);
 
+const char * CPUEngineName(int engine);
+bool CPUEngineEnabled(const convolutionState& state, int engine);
+bool CPUEngineSupported(int engine, int nFilterWidth);
+int SelectedCPUEngine(const convolutionState& state, int nFilterWidth);
+
+void ConvolveCPUTile(const convolutionState& state, int engine, int nFilterWidth, const imageRect& tile);
+void ConvolveCPU(const convolutionState& state, int engine, int nFilterWidth, int nNumThreads, int nSchedule);
+double TimeCPU(const convolutionState& state, int engine, int nFilterWidth, int nNumThreads, int nSchedule);
 void RunCPU(int run);
 
 /////////////////////////////////////////////////////////////////
 // Convolution on GPU
 /////////////////////////////////////////////////////////////////
 
+const char * GPUEngineName(int engine);
+bool GPUEngineEnabled(const convolutionState& state, int engine);
+int SelectedGPUEngine(const convolutionState& state);
+
+double RunGPUConvolution(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+			 const cl::Program& program, int engine, int nFilterWidth);
+void CalibrateDevices();
+int SelectDevice(int nWidth, int nHeight, int nFilterWidth);
+void InitGPU(gpuContextStruct& gpu, int nDevice);
+void InitGPU(gpuContextStruct& gpu);
+bool GPUEngineSupported(int engine, int nFilterWidth);
+double RunGPUBox(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		 const cl::Program& program, int nFilterWidth);
+double RunGPUWinograd(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		      const cl::Program& program, int nFilterWidth, int nOutputTile);
+double RunGPUSparse(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		    const cl::Program& program, bool bFixed);
 void RunGPU();
 
+/////////////////////////////////////////////////////////////////
+// Service mode
+/////////////////////////////////////////////////////////////////
+
+void ReserveServiceBuffers(int nWidth, int nHeight, int nFilterWidth);
+double RunServiceGPUJob(serviceDeviceStruct& device, int nFilterWidth);
+void InitServiceDevices(std::vector<serviceDeviceStruct>& devices);
+bool RunServiceJob(int fd, const serviceRequest& request, std::vector<serviceDeviceStruct> * pDevices, serviceReply& reply);
+void RunService();
+
+/////////////////////////////////////////////////////////////////
+// Ring ingest mode
+/////////////////////////////////////////////////////////////////
+
+void PrintRingMetrics(const frameRing& input, const frameRing& output, double dSeconds);
+void RunFrameRings();
+
+/////////////////////////////////////////////////////////////////
+// Job executor benchmark
+/////////////////////////////////////////////////////////////////
+
+void RunJobs();
+
+/////////////////////////////////////////////////////////////////
+// Filter pipeline benchmark
+/////////////////////////////////////////////////////////////////
+
+void InitPipelineFilters(std::vector<pipelineStage>& stages);
+void ReleasePipelineFilters(std::vector<pipelineStage>& stages);
+double TimePipelineCPU(const std::vector<pipelineStage>& stages, bool bFused);
+double RunGPUPipeline(const gpuContextStruct& gpu, const std::vector<pipelineStage>& stages, bool bFused);
+void RunPipelineBenchmark();
+
+/////////////////////////////////////////////////////////////////
+// Pyramid benchmark
+/////////////////////////////////////////////////////////////////
+
+void RunGPUPyramid(const gpuContextStruct& gpu, const float * pFilter, std::vector<pyramidLevel>& levels);
+void RunPyramid();
+
+/////////////////////////////////////////////////////////////////
+// Filter bank benchmark
+/////////////////////////////////////////////////////////////////
+
+void InitBankFilters(float * pFilters, int nFilters);
+double RunGPUFilterBank(const gpuContextStruct& gpu, const float * pFilters, int nFilters, float * pOutputs);
+void RunFilterBank();
+
+/////////////////////////////////////////////////////////////////
+// Image-size sweep
+/////////////////////////////////////////////////////////////////
+
+const char * SweepPitchName(int nPitchMode);
+const char * SweepWidthName(int nWidthMode);
+int SweepWidth(int nSize, int nWidthMode);
+int SweepPitch(int nWidth, int nPixelSize, int nPitchMode);
+void InitSweepImage(int nSize, int nWidthMode, int nPitchMode);
+void RunSizeSweep();
+
+/////////////////////////////////////////////////////////////////
+// Spatio-temporal benchmark
+/////////////////////////////////////////////////////////////////
+
+void InitTemporalFilter(float * pFilter);
+double TimeTemporalCPU(const float * pSources, const float * pFilter, bool bRing, float * pOutput);
+double RunGPUTemporal(const gpuContextStruct& gpu, const float * pSources, const float * pFilter, bool bRing);
+void RunTemporal();
+
+/////////////////////////////////////////////////////////////////
+// Incremental benchmark
+/////////////////////////////////////////////////////////////////
+
+double TimeIncremental(const float * pBackground, int engine, bool bIncremental, bool bMask,
+		       long * pDirtyInput, long * pDirtyOutput);
+void RunIncremental();
+
 #endif
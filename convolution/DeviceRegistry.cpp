@@ -0,0 +1,298 @@
+#define __CL_ENABLE_EXCEPTIONS
+
+#include "DeviceRegistry.hpp"
+
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Calibration jobs: (width, height, filter width)
+#define CALIBRATION_SMALL 256
+#define CALIBRATION_LARGE 1024
+#define CALIBRATION_NARROW 3
+#define CALIBRATION_WIDE 9
+#define CALIBRATION_RUNS 3	// Best of, after one warm-up run
+#define CALIBRATION_MIN_TIME 0.02	// Seconds per run, well above the timer resolution
+
+DeviceRegistry::DeviceRegistry()
+  : bEnumerated(false), bCalibrated(false)
+{
+}
+
+void DeviceRegistry::Enumerate()
+{
+  if (bEnumerated)
+    return;
+  bEnumerated = true;
+
+  std::vector<cl::Platform> platforms;
+  cl::Platform::get(&platforms);
+
+  for (size_t p = 0; p < platforms.size(); p++)
+  {
+    std::string platformName;
+    platforms[p].getInfo(CL_PLATFORM_NAME, &platformName);
+
+    std::vector<cl::Device> platformDevices;
+    try
+    {
+      platforms[p].getDevices(CL_DEVICE_TYPE_ALL, &platformDevices);
+    }
+    catch (cl::Error e)
+    {
+      // A platform without devices reports an error, the others still count
+      continue;
+    }
+
+    for (size_t d = 0; d < platformDevices.size(); d++)
+    {
+      const cl::Device& device = platformDevices[d];
+      deviceCaps info;
+      std::string extensions, driver;
+      cl_bool bImageSupport = CL_FALSE, bUnifiedMemory = CL_FALSE;
+
+      device.getInfo(CL_DEVICE_NAME, &info.name);
+      device.getInfo(CL_DEVICE_TYPE, &info.type);
+      device.getInfo(CL_DEVICE_MAX_COMPUTE_UNITS, &info.nComputeUnits);
+      device.getInfo(CL_DEVICE_LOCAL_MEM_SIZE, &info.nLocalMemSize);
+      device.getInfo(CL_DEVICE_GLOBAL_MEM_SIZE, &info.nGlobalMemSize);
+      device.getInfo(CL_DEVICE_IMAGE_SUPPORT, &bImageSupport);
+      device.getInfo(CL_DEVICE_HOST_UNIFIED_MEMORY, &bUnifiedMemory);
+      device.getInfo(CL_DEVICE_EXTENSIONS, &extensions);
+      device.getInfo(CL_DRIVER_VERSION, &driver);
+
+      info.platform = platformName;
+      info.key = platformName + " / " + info.name + " / " + driver;
+      info.bImageSupport = (bImageSupport == CL_TRUE);
+      info.bUnifiedMemory = (bUnifiedMemory == CL_TRUE) || info.type == CL_DEVICE_TYPE_CPU;
+      info.bFp16 = extensions.find("cl_khr_fp16") != std::string::npos;
+
+      deviceScore score = {false, 0, 0, 0};
+
+      devices.push_back(device);
+      caps.push_back(info);
+      scores.push_back(score);
+    }
+  }
+
+  LoadScores(DEVICE_SCORES_FILENAME);
+}
+
+// One line per device: launch, pixel and tap times, then the key
+static bool ParseScore(const std::string& line, deviceScore& score, std::string& key)
+{
+  std::istringstream fields(line);
+
+  if (!(fields >> score.dLaunch >> score.dPixel >> score.dTap))
+    return false;
+  fields >> std::ws;
+  std::getline(fields, key);
+  score.bValid = true;
+  return !key.empty();
+}
+
+bool DeviceRegistry::LoadScores(const char * pPath)
+{
+  std::ifstream file(pPath);
+  if (!file.is_open())
+    return false;
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+    deviceScore score;
+    std::string key;
+
+    if (!ParseScore(line, score, key))
+      continue;
+
+    for (int i = 0; i < Count(); i++)
+      if (caps[i].key == key)
+	scores[i] = score;
+  }
+  return true;
+}
+
+// Entries of devices absent from this machine are kept
+bool DeviceRegistry::SaveScores(const char * pPath) const
+{
+  std::vector<std::string> lines;
+  {
+    std::ifstream file(pPath);
+    std::string line;
+    while (std::getline(file, line))
+    {
+      deviceScore score;
+      std::string key;
+      bool bOwn = false;
+
+      if (ParseScore(line, score, key))
+	for (int i = 0; i < Count(); i++)
+	  bOwn = bOwn || (scores[i].bValid && caps[i].key == key);
+      if (!bOwn)
+	lines.push_back(line);
+    }
+  }
+
+  std::ofstream file(pPath);
+  if (!file.is_open())
+    return false;
+
+  for (size_t l = 0; l < lines.size(); l++)
+    file << lines[l] << std::endl;
+
+  file.precision(9);
+  for (int i = 0; i < Count(); i++)
+    if (scores[i].bValid)
+      file << scores[i].dLaunch << " " << scores[i].dPixel << " " << scores[i].dTap << " " << caps[i].key << std::endl;
+
+  return file.good();
+}
+
+// Best time of the direct kernel on an nWidth x nHeight image, from
+// writing the input to reading the output back. A run repeats the job
+// until it lasts CALIBRATION_MIN_TIME, so fast devices are not
+// measured at the resolution of the timer.
+static double CalibrationTime(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program,
+			     int nWidth, int nHeight, int nFilterWidth)
+{
+  const size_t sizeBytes = (size_t) nWidth * nHeight * sizeof(float);
+  std::vector<float> input((size_t) nWidth * nHeight), output((size_t) nWidth * nHeight);
+  std::vector<float> filter(nFilterWidth * nFilterWidth, 1.0f / (nFilterWidth * nFilterWidth));
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = float(i % 251);
+
+  cl::Buffer inputBuffer(context, CL_MEM_READ_ONLY, sizeBytes);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, sizeBytes);
+  cl::Buffer filterBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			  filter.size() * sizeof(float), &filter[0]);
+
+  cl::Kernel kernel(program, "convolve");
+  kernel.setArg(0, inputBuffer);
+  kernel.setArg(1, filterBuffer);
+  kernel.setArg(2, outputBuffer);
+  kernel.setArg(3, nWidth);
+  kernel.setArg(4, nFilterWidth);
+  kernel.setArg(5, nWidth);
+  kernel.setArg(6, nHeight);
+  kernel.setArg(7, 0);		// BORDER_CLAMP
+  kernel.setArg(8, 0.0f);
+
+  int nRepeats = 1;
+  double dBest = 0;
+  for (int r = 0; r <= CALIBRATION_RUNS; r++)
+  {
+    const double dStart = omp_get_wtime();
+    for (int j = 0; j < nRepeats; j++)
+    {
+      queue.enqueueWriteBuffer(inputBuffer, CL_FALSE, 0, sizeBytes, &input[0]);
+      queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nWidth, nHeight), cl::NullRange);
+      queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, sizeBytes, &output[0]);
+    }
+    const double dTime = (omp_get_wtime() - dStart) / nRepeats;
+
+    // The warm-up run sizes the others
+    if (r == 0)
+      nRepeats = std::max(1, (int) ceil(CALIBRATION_MIN_TIME / std::max(dTime, 1e-7)));
+    else if (r == 1 || dTime < dBest)
+      dBest = dTime;
+  }
+  return dBest;
+}
+
+int DeviceRegistry::Calibrate(const std::string& source)
+{
+  int nCalibrated = 0;
+
+  if (bCalibrated)
+    return 0;
+  bCalibrated = true;
+
+  for (int i = 0; i < Count(); i++)
+  {
+    if (scores[i].bValid)
+      continue;
+
+    try
+    {
+      cl::Context context(devices[i]);
+      cl::CommandQueue queue(context, devices[i]);
+      cl::Program program(context, source);
+      program.build();
+
+      const double dSmall = CalibrationTime(context, queue, program, CALIBRATION_SMALL, CALIBRATION_SMALL, CALIBRATION_NARROW);
+      const double dLarge = CalibrationTime(context, queue, program, CALIBRATION_LARGE, CALIBRATION_LARGE, CALIBRATION_NARROW);
+      const double dWide = CalibrationTime(context, queue, program, CALIBRATION_LARGE, CALIBRATION_LARGE, CALIBRATION_WIDE);
+
+      const double nSmallPixels = double(CALIBRATION_SMALL) * CALIBRATION_SMALL;
+      const double nLargePixels = double(CALIBRATION_LARGE) * CALIBRATION_LARGE;
+      const int nNarrowTaps = CALIBRATION_NARROW * CALIBRATION_NARROW;
+      const int nWideTaps = CALIBRATION_WIDE * CALIBRATION_WIDE;
+
+      // Timer noise can make a term negative, none of them is
+      const double dNarrowPixel = std::max(0.0, (dLarge - dSmall) / (nLargePixels - nSmallPixels));
+      scores[i].dTap = std::max(0.0, (dWide - dLarge) / (nLargePixels * (nWideTaps - nNarrowTaps)));
+      scores[i].dPixel = std::max(0.0, dNarrowPixel - nNarrowTaps * scores[i].dTap);
+      scores[i].dLaunch = std::max(0.0, dSmall - nSmallPixels * dNarrowPixel);
+      scores[i].bValid = true;
+      nCalibrated++;
+    }
+    catch (cl::Error e)
+    {
+      std::cerr << "Calibration of " << caps[i].name << " failed: " << e.what() << std::endl;
+    }
+  }
+
+  return nCalibrated;
+}
+
+double DeviceRegistry::PredictedTime(int i, int nWidth, int nHeight, int nFilterWidth) const
+{
+  if (!scores[i].bValid)
+    return -1;
+
+  const deviceScore& score = scores[i];
+  return score.dLaunch + double(nWidth) * nHeight * (score.dPixel + double(nFilterWidth) * nFilterWidth * score.dTap);
+}
+
+int DeviceRegistry::Fastest(int nWidth, int nHeight, int nFilterWidth) const
+{
+  int nBest = -1;
+  double dBest = 0;
+
+  for (int i = 0; i < Count(); i++)
+  {
+    const double dTime = PredictedTime(i, nWidth, nHeight, nFilterWidth);
+    if (dTime >= 0 && (nBest < 0 || dTime < dBest))
+    {
+      nBest = i;
+      dBest = dTime;
+    }
+  }
+  return nBest;
+}
+
+void DeviceRegistry::Print() const
+{
+  for (int i = 0; i < Count(); i++)
+  {
+    const deviceCaps& info = caps[i];
+    const char * pType = (info.type == CL_DEVICE_TYPE_GPU) ? "GPU"
+      : (info.type == CL_DEVICE_TYPE_CPU) ? "CPU"
+      : (info.type == CL_DEVICE_TYPE_ACCELERATOR) ? "accelerator" : "other";
+
+    printf("[%d] %s (%s, %s): %u compute units, %lu KiB local, %lu MiB global%s%s%s\n",
+	   i, info.name.c_str(), info.platform.c_str(), pType, info.nComputeUnits,
+	   (unsigned long) (info.nLocalMemSize >> 10), (unsigned long) (info.nGlobalMemSize >> 20),
+	   info.bImageSupport ? ", images" : "", info.bFp16 ? ", fp16" : "",
+	   info.bUnifiedMemory ? ", unified memory" : "");
+    if (scores[i].bValid)
+      printf("    calibration: %g s per job + %g ns per pixel + %g ns per pixel and tap\n",
+	     scores[i].dLaunch, scores[i].dPixel * 1e9, scores[i].dTap * 1e9);
+  }
+}
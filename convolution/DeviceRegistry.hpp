@@ -0,0 +1,98 @@
+#ifndef __DEVICEREGISTRY_H__
+#define __DEVICEREGISTRY_H__
+
+#include <CL/cl.hpp>
+
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// OpenCL device registry
+//
+// Enumerates every platform once and keeps each device with its
+// capabilities, so engine and device choices do not query the
+// runtime again. Devices are indexed in enumeration order, the order
+// of -p.
+//
+// A device is scored by a short calibration: the direct convolve
+// kernel of convolution.cl is timed, transfers included, on a small
+// and a large image with a small filter, and on the large image with
+// a wider filter. The three times fit
+//
+//   t(W, H, w) = launch + W * H * (pixel + w^2 * tap)
+//
+// which predicts the time of any job, so the fastest device can be
+// picked per image and filter size rather than once. Scores are saved
+// to a file keyed by platform, device and driver version, read once
+// by Enumerate(), and only devices missing from it are calibrated.
+// Nothing assumes a GPU: a CPU-only OpenCL runtime is calibrated and
+// picked the same way.
+/////////////////////////////////////////////////////////////////
+
+#define DEVICE_SCORES_FILENAME "device_scores.txt"
+
+struct deviceCaps
+{
+  std::string name;
+  std::string platform;
+  std::string key;		// Platform, name and driver version, the scores file key
+  cl_device_type type;
+  cl_uint nComputeUnits;
+  cl_ulong nLocalMemSize;
+  cl_ulong nGlobalMemSize;
+  bool bImageSupport;
+  bool bFp16;			// cl_khr_fp16
+  bool bUnifiedMemory;		// Shares host memory, no transfer over a bus
+};
+
+// Fit of the calibration times, in seconds
+struct deviceScore
+{
+  bool bValid;			// Calibrated or loaded; false if calibration failed
+  double dLaunch;		// Per job
+  double dPixel;		// Per output pixel, transfers included
+  double dTap;			// Per output pixel and filter tap
+};
+
+class DeviceRegistry
+{
+public:
+
+  DeviceRegistry();
+
+  // Queries the runtime on the first call only, and loads the scores
+  // of DEVICE_SCORES_FILENAME
+  void Enumerate();
+
+  int Count() const { return (int) devices.size(); }
+  const cl::Device& Device(int i) const { return devices[i]; }
+  const deviceCaps& Caps(int i) const { return caps[i]; }
+  const deviceScore& Score(int i) const { return scores[i]; }
+
+  // Scores of the enumerated devices found in pPath. Returns false if
+  // the file cannot be read.
+  bool LoadScores(const char * pPath);
+  bool SaveScores(const char * pPath) const;
+
+  // Calibrates the devices without a score, on the first call only, so
+  // a device that fails is not retried. source is convolution.cl.
+  // Returns the number of devices calibrated.
+  int Calibrate(const std::string& source);
+
+  // -1 for a device without a score
+  double PredictedTime(int i, int nWidth, int nHeight, int nFilterWidth) const;
+  // Device of the lowest predicted time, -1 if none is scored
+  int Fastest(int nWidth, int nHeight, int nFilterWidth) const;
+
+  void Print() const;
+
+private:
+
+  bool bEnumerated;
+  bool bCalibrated;
+  std::vector<cl::Device> devices;
+  std::vector<deviceCaps> caps;
+  std::vector<deviceScore> scores;
+};
+
+#endif
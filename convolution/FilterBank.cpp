@@ -0,0 +1,306 @@
+#include "FilterBank.hpp"
+#include "Border.hpp"
+
+#include <omp.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////////
+// SIMD vector of VLEN floats
+/////////////////////////////////////////////////////////////////
+
+#if defined(__AVX512F__)
+
+typedef __m512 vfloat;
+#define VLEN 16
+#define VLOAD(p) _mm512_loadu_ps(p)
+#define VSTORE(p, v) _mm512_storeu_ps(p, v)
+#define VSET1(f) _mm512_set1_ps(f)
+#define VZERO() _mm512_setzero_ps()
+#define VADD(a, b) _mm512_add_ps(a, b)
+#define VFMA(a, b, c) _mm512_fmadd_ps(a, b, c)
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+typedef __m256 vfloat;
+#define VLEN 8
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VSTORE(p, v) _mm256_storeu_ps(p, v)
+#define VSET1(f) _mm256_set1_ps(f)
+#define VZERO() _mm256_setzero_ps()
+#define VADD(a, b) _mm256_add_ps(a, b)
+#define VFMA(a, b, c) _mm256_fmadd_ps(a, b, c)
+
+#elif defined(__SSE2__)
+
+typedef __m128 vfloat;
+#define VLEN 4
+#define VLOAD(p) _mm_loadu_ps(p)
+#define VSTORE(p, v) _mm_storeu_ps(p, v)
+#define VSET1(f) _mm_set1_ps(f)
+#define VZERO() _mm_setzero_ps()
+#define VADD(a, b) _mm_add_ps(a, b)
+#define VFMA(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+
+#else
+
+typedef float vfloat;
+#define VLEN 1
+#define VLOAD(p) (*(p))
+#define VSTORE(p, v) (*(p) = (v))
+#define VSET1(f) (f)
+#define VZERO() 0.0f
+#define VADD(a, b) ((a) + (b))
+#define VFMA(a, b, c) ((a) * (b) + (c))
+
+#endif
+
+// Micro-kernel block: MR filters x NR pixels, 12 vector accumulators
+#define MR 6
+#define NR (2 * VLEN)
+
+// Cache blocks: KC taps x NC pixels of P per packed block
+#define KC 256
+#define NC (8 * NR)
+
+/////////////////////////////////////////////////////////////////
+// Padding and packing
+/////////////////////////////////////////////////////////////////
+
+void PadImage(const float * pInput, float * pPadded,
+	      const int nPitch, const int nPaddedPitch, const int nWidth, const int nHeight,
+	      const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+	      const int nNumThreads)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nPaddedWidth = nWidth + nFilterWidth - 1;
+  const int nPaddedHeight = nHeight + nFilterWidth - 1;
+
+  std::vector<int> xIndex(nPaddedWidth);
+  for (int x = 0; x < nPaddedWidth; x++)
+    xIndex[x] = BorderIndex(x - nAnchor, nWidth, nBorderMode);
+
+#pragma omp parallel for num_threads(nNumThreads)
+  for (int y = 0; y < nPaddedHeight; y++)
+  {
+    const int yIn = BorderIndex(y - nAnchor, nHeight, nBorderMode);
+    float * pRow = pPadded + (size_t) y * nPaddedPitch;
+
+    if (yIn < 0)
+    {
+      for (int x = 0; x < nPaddedWidth; x++)
+	pRow[x] = fBorderValue;
+      continue;
+    }
+
+    const float * pIn = pInput + (size_t) yIn * nPitch;
+    for (int x = 0; x < nAnchor; x++)
+      pRow[x] = (xIndex[x] < 0) ? fBorderValue : pIn[xIndex[x]];
+    memcpy(pRow + nAnchor, pIn, nWidth * sizeof(float));
+    for (int x = nAnchor + nWidth; x < nPaddedWidth; x++)
+      pRow[x] = (xIndex[x] < 0) ? fBorderValue : pIn[xIndex[x]];
+  }
+}
+
+static int FilterPanels(int nFilters)
+{
+  return (nFilters + MR - 1) / MR;
+}
+
+// Block kb of kc taps starts at kb * nPanels * MR, panel mp of it at
+// mp * kc * MR further, tap k of the panel holds MR filters. Filters
+// past nFilters are zero.
+void InitFilterBank(filterBank& bank, const float * pFilters, int nFilters, int nFilterWidth)
+{
+  const int K = nFilterWidth * nFilterWidth;
+  const int nPanels = FilterPanels(nFilters);
+
+  bank.nFilters = nFilters;
+  bank.nFilterWidth = nFilterWidth;
+  bank.packed.assign((size_t) K * nPanels * MR, 0.0f);
+
+  for (int kb = 0; kb < K; kb += KC)
+  {
+    const int kc = std::min(KC, K - kb);
+    float * pBlock = &bank.packed[(size_t) kb * nPanels * MR];
+
+    for (int mp = 0; mp < nPanels; mp++)
+      for (int k = 0; k < kc; k++)
+	for (int i = 0; i < MR; i++)
+	{
+	  const int f = mp * MR + i;
+	  pBlock[(mp * kc + k) * MR + i] = (f < nFilters) ? pFilters[(size_t) f * K + kb + k] : 0.0f;
+	}
+  }
+}
+
+// Taps [kb, kb + kc) of nc output pixels from x0 of row y, as
+// NR-wide micro-panels of kc rows. Columns past nc are zero.
+static void PackPatches(const float * pPadded, const int nPaddedPitch, const int nFilterWidth,
+			const int y, const int x0, const int nc, const int kb, const int kc,
+			float * pPacked)
+{
+  const int nGroups = (nc + NR - 1) / NR;
+
+  for (int k = 0; k < kc; k++)
+  {
+    const int r = (kb + k) / nFilterWidth;
+    const int c = (kb + k) % nFilterWidth;
+    const float * pSrc = pPadded + (size_t) (y + r) * nPaddedPitch + x0 + c;
+
+    for (int g = 0; g < nGroups; g++)
+    {
+      float * pDst = pPacked + ((size_t) g * kc + k) * NR;
+      const int n = std::min(NR, nc - g * NR);
+
+      if (n == NR)
+	for (int j = 0; j < NR; j += VLEN)
+	  VSTORE(pDst + j, VLOAD(pSrc + g * NR + j));
+      else
+      {
+	for (int j = 0; j < n; j++)
+	  pDst[j] = pSrc[g * NR + j];
+	for (int j = n; j < NR; j++)
+	  pDst[j] = 0.0f;
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////
+// Micro-kernel
+/////////////////////////////////////////////////////////////////
+
+#define ROW_FMA(i)					\
+  {							\
+    const vfloat a = VSET1(pA[i]);			\
+    c##i##0 = VFMA(a, b0, c##i##0);			\
+    c##i##1 = VFMA(a, b1, c##i##1);			\
+  }
+
+#define ROW_STORE(i)							\
+  if (bAccumulate)							\
+  {									\
+    c##i##0 = VADD(c##i##0, VLOAD(pC + i * ldc));			\
+    c##i##1 = VADD(c##i##1, VLOAD(pC + i * ldc + VLEN));		\
+  }									\
+  VSTORE(pC + i * ldc, c##i##0);					\
+  VSTORE(pC + i * ldc + VLEN, c##i##1);
+
+// C (MR x NR, rows ldc apart) = or += A panel (kc x MR) . B panel (kc x NR)
+static void MicroKernel(const int kc, const float * pA, const float * pB,
+			float * pC, const size_t ldc, const bool bAccumulate)
+{
+  vfloat c00 = VZERO(), c01 = VZERO(), c10 = VZERO(), c11 = VZERO();
+  vfloat c20 = VZERO(), c21 = VZERO(), c30 = VZERO(), c31 = VZERO();
+  vfloat c40 = VZERO(), c41 = VZERO(), c50 = VZERO(), c51 = VZERO();
+
+  for (int k = 0; k < kc; k++)
+  {
+    const vfloat b0 = VLOAD(pB);
+    const vfloat b1 = VLOAD(pB + VLEN);
+
+    ROW_FMA(0);
+    ROW_FMA(1);
+    ROW_FMA(2);
+    ROW_FMA(3);
+    ROW_FMA(4);
+    ROW_FMA(5);
+
+    pA += MR;
+    pB += NR;
+  }
+
+  ROW_STORE(0);
+  ROW_STORE(1);
+  ROW_STORE(2);
+  ROW_STORE(3);
+  ROW_STORE(4);
+  ROW_STORE(5);
+}
+
+// Edge blocks go through a full-size block on the stack
+static void MicroKernelEdge(const int kc, const float * pA, const float * pB,
+			    float * pC, const size_t ldc, const bool bAccumulate,
+			    const int nRows, const int nColumns)
+{
+  float block[MR * NR];
+  MicroKernel(kc, pA, pB, block, NR, false);
+
+  for (int i = 0; i < nRows; i++)
+    for (int j = 0; j < nColumns; j++)
+      pC[i * ldc + j] = bAccumulate ? pC[i * ldc + j] + block[i * NR + j] : block[i * NR + j];
+}
+
+/////////////////////////////////////////////////////////////////
+// Convolution
+/////////////////////////////////////////////////////////////////
+
+void ConvolveFilterBank(filterBank& bank, const float * pInput, float * pOutputs,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  const int nFilterWidth = bank.nFilterWidth;
+  const int K = nFilterWidth * nFilterWidth;
+  const int nPanels = FilterPanels(bank.nFilters);
+  const size_t nPlaneSize = (size_t) nPitch * nHeight;
+
+  bank.nPaddedPitch = nWidth + nFilterWidth - 1;
+  const size_t nPaddedSize = (size_t) bank.nPaddedPitch * (nHeight + nFilterWidth - 1);
+  if (bank.padded.size() < nPaddedSize)
+    bank.padded.resize(nPaddedSize);
+
+  PadImage(pInput, &bank.padded[0], nPitch, bank.nPaddedPitch, nWidth, nHeight,
+	   nFilterWidth, nBorderMode, fBorderValue, nNumThreads);
+
+  const float * pPadded = &bank.padded[0];
+  const int nPaddedPitch = bank.nPaddedPitch;
+  const int nColumnBlocks = (nWidth + NC - 1) / NC;
+  const int nJobs = nHeight * nColumnBlocks;
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    std::vector<float> packed((size_t) std::min(KC, K) * NC);
+
+#pragma omp for schedule(static)
+    for (int job = 0; job < nJobs; job++)
+    {
+      const int y = job / nColumnBlocks;
+      const int x0 = (job % nColumnBlocks) * NC;
+      const int nc = std::min(NC, nWidth - x0);
+      const int nGroups = (nc + NR - 1) / NR;
+
+      for (int kb = 0; kb < K; kb += KC)
+      {
+	const int kc = std::min(KC, K - kb);
+	const float * pBlockA = &bank.packed[(size_t) kb * nPanels * MR];
+	const bool bAccumulate = kb > 0;
+
+	PackPatches(pPadded, nPaddedPitch, nFilterWidth, y, x0, nc, kb, kc, &packed[0]);
+
+	for (int g = 0; g < nGroups; g++)
+	{
+	  const float * pB = &packed[(size_t) g * kc * NR];
+	  const int nColumns = std::min(NR, nc - g * NR);
+
+	  for (int mp = 0; mp < nPanels; mp++)
+	  {
+	    const float * pA = pBlockA + (size_t) mp * kc * MR;
+	    float * pC = pOutputs + mp * MR * nPlaneSize + (size_t) y * nPitch + x0 + g * NR;
+	    const int nRows = std::min(MR, bank.nFilters - mp * MR);
+
+	    if (nRows == MR && nColumns == NR)
+	      MicroKernel(kc, pA, pB, pC, nPlaneSize, bAccumulate);
+	    else
+	      MicroKernelEdge(kc, pA, pB, pC, nPlaneSize, bAccumulate, nRows, nColumns);
+	  }
+	}
+      }
+    }
+  }
+}
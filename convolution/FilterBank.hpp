@@ -0,0 +1,58 @@
+#ifndef __FILTERBANK_H__
+#define __FILTERBANK_H__
+
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Filter bank
+//
+// Applies nFilters filters of the same width to one image as a single
+// matrix product,
+//
+//   Out (nFilters x pixels) = F (nFilters x K) . P (K x pixels)
+//
+// with K = nFilterWidth^2, F one filter per row and P the im2col
+// matrix, column p holding the filter window of output pixel p.
+//
+// P is never built. The input is padded once with its border applied
+// (PadImage()), so row k = (r, c) of P restricted to a run of output
+// pixels of one row is a contiguous run of a padded row. Each thread
+// packs a KC x NC block of P straight from the padded image into
+// NR-wide micro-panels, the filters are packed once into MR-row
+// micro-panels, and a hand-written MR x NR register-blocked SIMD
+// micro-kernel (AVX-512, AVX2 + FMA or SSE, see FilterBank.cpp)
+// accumulates every MR x NR block of Out over KC taps at a time.
+// A B micro-panel stays in L1 while every filter panel streams over
+// it, the KC x NC block stays in L2.
+//
+// Results match ConvolveWithBorder() up to float rounding, the taps
+// being summed in a different order.
+/////////////////////////////////////////////////////////////////
+
+struct filterBank
+{
+  int nFilters;
+  int nFilterWidth;
+  std::vector<float> packed;	// Filters in KC blocks of MR-row micro-panels
+  std::vector<float> padded;	// Input with its border, reused across calls
+  int nPaddedPitch;
+};
+
+// pFilters holds nFilters filters of nFilterWidth^2 taps, one after
+// the other
+void InitFilterBank(filterBank& bank, const float * pFilters, int nFilters, int nFilterWidth);
+
+// pOutputs receives one nPitch x nHeight plane per filter
+void ConvolveFilterBank(filterBank& bank, const float * pInput, float * pOutputs,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// nWidth + nFilterWidth - 1 x nHeight + nFilterWidth - 1 image whose
+// pixel (x, y) is input pixel (x - anchor, y - anchor) after border
+// remapping, rows nPaddedPitch floats apart
+void PadImage(const float * pInput, float * pPadded,
+	      const int nPitch, const int nPaddedPitch, const int nWidth, const int nHeight,
+	      const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+	      const int nNumThreads);
+
+#endif
@@ -0,0 +1,249 @@
+#include "FrameRing.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <sched.h>
+#endif
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define ADD(p, v) __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+#define SUB(p, v) __atomic_sub_fetch(p, v, __ATOMIC_SEQ_CST)
+
+#define PAGE_SIZE_BYTES 4096
+
+// Not FUTEX_PRIVATE_FLAG: the words are shared between processes
+static void FutexWait(uint32_t * pWord, uint32_t nExpected)
+{
+#if defined(__linux__)
+  syscall(SYS_futex, pWord, FUTEX_WAIT, nExpected, NULL, NULL, 0);
+#else
+  if (LOAD(pWord) == nExpected)
+    sched_yield();
+#endif
+}
+
+static void FutexWake(uint32_t * pWord)
+{
+#if defined(__linux__)
+  syscall(SYS_futex, pWord, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+  (void) pWord;
+#endif
+}
+
+static size_t RoundUp(size_t n, size_t nAlign)
+{
+  return (n + nAlign - 1) / nAlign * nAlign;
+}
+
+static bool MapFrameRing(frameRing& ring, int fd, size_t nBytes)
+{
+  void * p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    return false;
+
+  ring.pHeader = (frameRingHeader *) p;
+  ring.nBytes = nBytes;
+  return true;
+}
+
+static void SetSlotPointers(frameRing& ring)
+{
+  char * pBase = (char *) ring.pHeader;
+  ring.pTimestamps = (uint64_t *) (pBase + RoundUp(sizeof(frameRingHeader), CACHE_LINE));
+  ring.pSlots = pBase + ring.pHeader->nSlotOffset;
+}
+
+bool CreateFrameRing(frameRing& ring, const char * pName, int nSlots,
+		     int nWidth, int nHeight, int nPitch)
+{
+  memset(&ring, 0, sizeof(ring));
+  strncpy(ring.name, pName, FRAME_RING_NAME_LENGTH - 1);
+
+  const size_t nSlotOffset = RoundUp(RoundUp(sizeof(frameRingHeader), CACHE_LINE) + nSlots * sizeof(uint64_t),
+				     PAGE_SIZE_BYTES);
+  const size_t nSlotStride = RoundUp((size_t) nPitch * nHeight * sizeof(float), PAGE_SIZE_BYTES);
+  const size_t nBytes = nSlotOffset + nSlots * nSlotStride;
+
+  int fd = shm_open(pName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return false;
+
+  const bool bOk = (ftruncate(fd, nBytes) == 0) && MapFrameRing(ring, fd, nBytes);
+  close(fd);
+  if (!bOk)
+  {
+    shm_unlink(pName);
+    return false;
+  }
+
+  // ftruncate() zero-fills, so counters and metrics start at 0
+  frameRingHeader * h = ring.pHeader;
+  h->nSlots = nSlots;
+  h->nWidth = nWidth;
+  h->nHeight = nHeight;
+  h->nPitch = nPitch;
+  h->nSlotOffset = nSlotOffset;
+  h->nSlotStride = nSlotStride;
+  STORE(&h->nMagic, (uint32_t) FRAME_RING_MAGIC);
+
+  SetSlotPointers(ring);
+  return true;
+}
+
+bool OpenFrameRing(frameRing& ring, const char * pName)
+{
+  memset(&ring, 0, sizeof(ring));
+  strncpy(ring.name, pName, FRAME_RING_NAME_LENGTH - 1);
+
+  int fd = shm_open(pName, O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  bool bOk = (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(frameRingHeader) &&
+	      MapFrameRing(ring, fd, st.st_size));
+  close(fd);
+
+  if (bOk && LOAD(&ring.pHeader->nMagic) != FRAME_RING_MAGIC)
+  {
+    munmap(ring.pHeader, ring.nBytes);
+    bOk = false;
+  }
+  if (!bOk)
+  {
+    ring.pHeader = NULL;
+    return false;
+  }
+
+  SetSlotPointers(ring);
+  return true;
+}
+
+void CloseFrameRing(frameRing& ring, bool bUnlink)
+{
+  if (ring.pHeader)
+    munmap(ring.pHeader, ring.nBytes);
+  if (bUnlink)
+    shm_unlink(ring.name);
+  ring.pHeader = NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+// Writer
+/////////////////////////////////////////////////////////////////
+
+float * AcquireWriteSlot(frameRing& ring, bool bWait)
+{
+  frameRingHeader * h = ring.pHeader;
+  const uint32_t head = h->head;	// Only written by this side
+
+  for (;;)
+  {
+    // Read the sequence first, a release after this changes it and
+    // makes FutexWait() return at once
+    const uint32_t seq = LOAD(&h->spaceSeq);
+    if (head - LOAD(&h->tail) < (uint32_t) h->nSlots)
+      return (float *) (ring.pSlots + (head % h->nSlots) * h->nSlotStride);
+    if (!bWait)
+      return NULL;
+
+    ADD(&h->nWriterWaits, 1);
+    ADD(&h->nWriterWaiters, 1);
+    if (seq == LOAD(&h->spaceSeq) && head - LOAD(&h->tail) >= (uint32_t) h->nSlots)
+      FutexWait(&h->spaceSeq, seq);
+    SUB(&h->nWriterWaiters, 1);
+  }
+}
+
+void PublishSlot(frameRing& ring, uint64_t nTimestamp)
+{
+  frameRingHeader * h = ring.pHeader;
+  const uint32_t head = h->head;
+
+  ring.pTimestamps[head % h->nSlots] = nTimestamp;
+  STORE(&h->head, head + 1);
+
+  const uint32_t depth = head + 1 - LOAD(&h->tail);
+  if (depth > h->nMaxDepth)
+    STORE(&h->nMaxDepth, depth);
+
+  ADD(&h->dataSeq, 1);
+  if (LOAD(&h->nReaderWaiters))
+    FutexWake(&h->dataSeq);
+}
+
+void CloseFrameRingWriter(frameRing& ring)
+{
+  frameRingHeader * h = ring.pHeader;
+
+  STORE(&h->nClosed, 1u);
+  ADD(&h->dataSeq, 1);
+  if (LOAD(&h->nReaderWaiters))
+    FutexWake(&h->dataSeq);
+}
+
+/////////////////////////////////////////////////////////////////
+// Reader
+/////////////////////////////////////////////////////////////////
+
+float * AcquireReadSlot(frameRing& ring, bool bWait, uint64_t * pTimestamp)
+{
+  frameRingHeader * h = ring.pHeader;
+  const uint32_t tail = h->tail;	// Only written by this side
+
+  for (;;)
+  {
+    // Closing follows the last publish, so a closed ring seen here
+    // cannot hide a frame from the head check below
+    const uint32_t seq = LOAD(&h->dataSeq);
+    const bool bClosed = LOAD(&h->nClosed);
+    if (LOAD(&h->head) != tail)
+    {
+      if (pTimestamp)
+	*pTimestamp = ring.pTimestamps[tail % h->nSlots];
+      return (float *) (ring.pSlots + (tail % h->nSlots) * h->nSlotStride);
+    }
+    if (!bWait || bClosed)
+      return NULL;
+
+    ADD(&h->nReaderWaits, 1);
+    ADD(&h->nReaderWaiters, 1);
+    if (seq == LOAD(&h->dataSeq) && LOAD(&h->head) == tail)
+      FutexWait(&h->dataSeq, seq);
+    SUB(&h->nReaderWaiters, 1);
+  }
+}
+
+void ReleaseSlot(frameRing& ring)
+{
+  frameRingHeader * h = ring.pHeader;
+
+  STORE(&h->tail, h->tail + 1);
+
+  ADD(&h->spaceSeq, 1);
+  if (LOAD(&h->nWriterWaiters))
+    FutexWake(&h->spaceSeq);
+}
+
+uint32_t FrameRingDepth(const frameRing& ring)
+{
+  return LOAD(&ring.pHeader->head) - LOAD(&ring.pHeader->tail);
+}
+
+uint64_t MonotonicNanoseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,90 @@
+#ifndef __FRAMERING_H__
+#define __FRAMERING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/////////////////////////////////////////////////////////////////
+// Shared-memory frame ring
+//
+// A POSIX shared-memory object holding nSlots float frames of
+// nWidth x nHeight pixels with a row pitch of nPitch, so the engine
+// convolves a slot in place. Each ring has one writer and one
+// reader process:
+//
+//   writer: AcquireWriteSlot(), fill the slot, PublishSlot()
+//   reader: AcquireReadSlot(), use the slot, ReleaseSlot()
+//
+// head and tail count published and released frames and are only
+// written by their owner, so the handoff is lock-free. A side that
+// finds the ring empty (full) sleeps on a futex word that the other
+// side bumps on every publish (release). The wake syscall is only made
+// when somebody is sleeping.
+//
+// The header also carries the metrics, so any process that maps the
+// ring can read throughput and queue depth.
+/////////////////////////////////////////////////////////////////
+
+#define FRAME_RING_MAGIC 0x474e4952	// "RING"
+#define FRAME_RING_SLOTS 8
+#define FRAME_RING_NAME_LENGTH 64
+
+#define CACHE_LINE 64
+
+struct frameRingHeader
+{
+  uint32_t nMagic;
+  int32_t nSlots;
+  int32_t nWidth;
+  int32_t nHeight;
+  int32_t nPitch;		// Row pitch in pixels
+  uint32_t nClosed;		// Set by the writer after its last frame
+  uint64_t nSlotOffset;		// Bytes from the header to slot 0
+  uint64_t nSlotStride;		// Bytes between slots
+
+  // Writer side
+  __attribute__((aligned(CACHE_LINE))) uint32_t head;	// Frames published
+  uint32_t dataSeq;		// Futex word, bumped on publish and close
+  uint32_t nReaderWaiters;
+  uint32_t nMaxDepth;		// Largest head - tail seen on publish
+  uint64_t nWriterWaits;	// Times the writer found the ring full
+
+  // Reader side
+  __attribute__((aligned(CACHE_LINE))) uint32_t tail;	// Frames released
+  uint32_t spaceSeq;		// Futex word, bumped on release
+  uint32_t nWriterWaiters;
+  uint64_t nReaderWaits;	// Times the reader found the ring empty
+};
+
+struct frameRing
+{
+  frameRingHeader * pHeader;
+  uint64_t * pTimestamps;	// Per slot, set by the writer (CLOCK_MONOTONIC ns)
+  char * pSlots;
+  size_t nBytes;
+  char name[FRAME_RING_NAME_LENGTH];
+};
+
+// Create (and own) or open an existing ring, false on failure
+bool CreateFrameRing(frameRing& ring, const char * pName, int nSlots,
+		     int nWidth, int nHeight, int nPitch);
+bool OpenFrameRing(frameRing& ring, const char * pName);
+void CloseFrameRing(frameRing& ring, bool bUnlink);
+
+// Writer. AcquireWriteSlot() returns NULL if the ring is full and
+// !bWait, PublishSlot() hands the acquired slot to the reader
+float * AcquireWriteSlot(frameRing& ring, bool bWait);
+void PublishSlot(frameRing& ring, uint64_t nTimestamp);
+void CloseFrameRingWriter(frameRing& ring);
+
+// Reader. AcquireReadSlot() returns NULL if the ring is empty and
+// either !bWait or the writer has closed it
+float * AcquireReadSlot(frameRing& ring, bool bWait, uint64_t * pTimestamp);
+void ReleaseSlot(frameRing& ring);
+
+// Frames published but not yet released
+uint32_t FrameRingDepth(const frameRing& ring);
+
+uint64_t MonotonicNanoseconds();
+
+#endif
@@ -0,0 +1,141 @@
+#include "HwCounters.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#endif
+
+HwCounters::HwCounters()
+{
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+  {
+    fds[i] = -1;
+    values[i] = 0;
+  }
+}
+
+HwCounters::~HwCounters()
+{
+  Close();
+}
+
+const char * HwCounters::Name(int counter)
+{
+  switch (counter)
+  {
+  case HW_CYCLES: return "cycles";
+  case HW_INSTRUCTIONS: return "instructions";
+  case HW_LLC_MISSES: return "LLC misses";
+  case HW_DTLB_MISSES: return "dTLB misses";
+  case HW_BRANCH_MISSES: return "branch misses";
+  }
+  return "unknown";
+}
+
+#if defined(__linux__)
+
+static int OpenEvent(uint32_t type, uint64_t config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool HwCounters::Open()
+{
+  const uint64_t dtlbReadMiss = PERF_COUNT_HW_CACHE_DTLB |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+  fds[HW_CYCLES] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  fds[HW_INSTRUCTIONS] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds[HW_LLC_MISSES] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  fds[HW_DTLB_MISSES] = OpenEvent(PERF_TYPE_HW_CACHE, dtlbReadMiss);
+  fds[HW_BRANCH_MISSES] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+  // The first failure is usually the reason for all of them
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    if (fds[i] < 0)
+    {
+      fds[i] = -1;
+      if (error.empty())
+	error = std::string("perf_event_open: ") + strerror(errno);
+    }
+
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    if (fds[i] >= 0)
+      return true;
+  return false;
+}
+
+void HwCounters::Start()
+{
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    if (fds[i] >= 0)
+    {
+      ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void HwCounters::Stop()
+{
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    if (fds[i] >= 0)
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+  {
+    values[i] = 0;
+    if (fds[i] < 0)
+      continue;
+
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (read(fds[i], data, sizeof(data)) != (ssize_t) sizeof(data))
+      continue;
+    values[i] = (data[2] > 0) ? double(data[0]) * double(data[1]) / double(data[2]) : 0;
+  }
+}
+
+#else
+
+bool HwCounters::Open()
+{
+  error = "hardware counters need Linux perf_event_open";
+  return false;
+}
+
+void HwCounters::Start()
+{
+}
+
+void HwCounters::Stop()
+{
+}
+
+#endif
+
+void HwCounters::Close()
+{
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+  {
+    if (fds[i] >= 0)
+      close(fds[i]);
+    fds[i] = -1;
+  }
+}
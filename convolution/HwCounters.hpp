@@ -0,0 +1,61 @@
+#ifndef __HWCOUNTERS_H__
+#define __HWCOUNTERS_H__
+
+#include <string>
+
+/////////////////////////////////////////////////////////////////
+// Hardware performance counters
+//
+// Counts user-space events of the whole process through Linux
+// perf_event_open. Each event is opened on its own, so a PMU without
+// one of them (LLC or dTLB misses in many VMs) still gives the
+// others. The events are inherited by threads created after Open(),
+// so Open() must run before the first OpenMP region to see the
+// worker threads. Counts are scaled by time enabled / time running
+// when the kernel multiplexes them.
+//
+// On other systems, or when perf is not permitted (containers,
+// perf_event_paranoid > 2), Open() returns false and every counter
+// reads as unavailable.
+/////////////////////////////////////////////////////////////////
+
+enum hwCounter
+{
+  HW_CYCLES = 0,
+  HW_INSTRUCTIONS,
+  HW_LLC_MISSES,
+  HW_DTLB_MISSES,
+  HW_BRANCH_MISSES,
+  HW_COUNTER_COUNT
+};
+
+class HwCounters
+{
+public:
+
+  HwCounters();
+  ~HwCounters();
+
+  // True if at least one counter could be opened. Otherwise Error()
+  // says why.
+  bool Open();
+  void Close();
+
+  // Counts between Start() and Stop() replace the previous ones
+  void Start();
+  void Stop();
+
+  bool Available(int counter) const { return fds[counter] >= 0; }
+  double Value(int counter) const { return values[counter]; }
+  const std::string& Error() const { return error; }
+
+  static const char * Name(int counter);
+
+private:
+
+  int fds[HW_COUNTER_COUNT];
+  double values[HW_COUNTER_COUNT];
+  std::string error;
+};
+
+#endif
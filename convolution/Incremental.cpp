@@ -0,0 +1,166 @@
+#include "Incremental.hpp"
+
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+void InitIncremental(incrementalState& state, int nPitch, int nWidth, int nHeight, int nTileSize)
+{
+  state.nPitch = nPitch;
+  state.nWidth = nWidth;
+  state.nHeight = nHeight;
+  state.nTileSize = nTileSize;
+  state.nTilesX = (nWidth + nTileSize - 1) / nTileSize;
+  state.nTilesY = (nHeight + nTileSize - 1) / nTileSize;
+  state.bPrevious = false;
+
+  state.pPrevious = (float *) malloc((size_t) nPitch * nHeight * sizeof(float));
+  if (!state.pPrevious)
+    throw(std::string("InitIncremental()::Could not allocate memory"));
+
+  state.inputDirty.assign(IncrementalTileCount(state), 0);
+  state.outputDirty.assign(IncrementalTileCount(state), 0);
+  state.dirtyTiles.clear();
+}
+
+void ReleaseIncremental(incrementalState& state)
+{
+  free(state.pPrevious);
+  state.pPrevious = NULL;
+}
+
+imageRect IncrementalTile(const incrementalState& state, int i)
+{
+  imageRect tile;
+  tile.x0 = (i % state.nTilesX) * state.nTileSize;
+  tile.y0 = (i / state.nTilesX) * state.nTileSize;
+  tile.x1 = std::min(tile.x0 + state.nTileSize, state.nWidth);
+  tile.y1 = std::min(tile.y0 + state.nTileSize, state.nHeight);
+  return tile;
+}
+
+static void CopyTile(incrementalState& state, const float * pInput, const imageRect& tile)
+{
+  const size_t rowBytes = (tile.x1 - tile.x0) * sizeof(float);
+  for (int y = tile.y0; y < tile.y1; y++)
+    memcpy(state.pPrevious + (size_t) y * state.nPitch + tile.x0, pInput + (size_t) y * state.nPitch + tile.x0, rowBytes);
+}
+
+int DiffTiles(incrementalState& state, const float * pInput, int nNumThreads)
+{
+  const int nTiles = IncrementalTileCount(state);
+  const bool bPrevious = state.bPrevious;
+  int nDirty = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:nDirty) num_threads(nNumThreads)
+  for (int i = 0; i < nTiles; i++)
+  {
+    const imageRect tile = IncrementalTile(state, i);
+    const size_t rowBytes = (tile.x1 - tile.x0) * sizeof(float);
+
+    bool bDirty = !bPrevious;
+    for (int y = tile.y0; y < tile.y1 && !bDirty; y++)
+    {
+      const size_t nOffset = (size_t) y * state.nPitch + tile.x0;
+      bDirty = memcmp(pInput + nOffset, state.pPrevious + nOffset, rowBytes) != 0;
+    }
+
+    state.inputDirty[i] = bDirty;
+    if (bDirty)
+    {
+      CopyTile(state, pInput, tile);
+      nDirty++;
+    }
+  }
+
+  state.bPrevious = true;
+  return nDirty;
+}
+
+int SetDirtyTiles(incrementalState& state, const unsigned char * pMask, const float * pInput, int nNumThreads)
+{
+  const int nTiles = IncrementalTileCount(state);
+  const bool bPrevious = state.bPrevious;
+  int nDirty = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:nDirty) num_threads(nNumThreads)
+  for (int i = 0; i < nTiles; i++)
+  {
+    const bool bDirty = !bPrevious || pMask[i] != 0;
+
+    state.inputDirty[i] = bDirty;
+    if (bDirty)
+    {
+      CopyTile(state, pInput, IncrementalTile(state, i));
+      nDirty++;
+    }
+  }
+
+  state.bPrevious = true;
+  return nDirty;
+}
+
+// Tiles of one axis holding the pixels [nFirst, nLast], which may
+// run past the image: clipped to it, or with bWrap taken modulo nSize
+static void MarkTileRange(int nFirst, int nLast, int nSize, int nTileSize, bool bWrap,
+			  std::vector<unsigned char>& marks)
+{
+  if (bWrap && nLast - nFirst + 1 >= nSize)
+  {
+    nFirst = 0;
+    nLast = nSize - 1;
+  }
+  else if (bWrap && nFirst < 0)
+  {
+    MarkTileRange(nFirst + nSize, nSize - 1, nSize, nTileSize, false, marks);
+    nFirst = 0;
+  }
+  else if (bWrap && nLast >= nSize)
+  {
+    MarkTileRange(0, nLast - nSize, nSize, nTileSize, false, marks);
+    nLast = nSize - 1;
+  }
+
+  nFirst = std::max(nFirst, 0);
+  nLast = std::min(nLast, nSize - 1);
+  for (int t = nFirst / nTileSize; t <= nLast / nTileSize; t++)
+    marks[t] = 1;
+}
+
+int DirtyOutputTiles(incrementalState& state, int nFilterWidth, int nBorderMode)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nAfter = nFilterWidth - 1 - nAnchor;
+  const bool bWrap = (nBorderMode == BORDER_WRAP);
+  std::vector<unsigned char> columns(state.nTilesX), rows(state.nTilesY);
+
+  std::fill(state.outputDirty.begin(), state.outputDirty.end(), 0);
+
+  for (int i = 0; i < IncrementalTileCount(state); i++)
+  {
+    if (!state.inputDirty[i])
+      continue;
+
+    const imageRect tile = IncrementalTile(state, i);
+    std::fill(columns.begin(), columns.end(), 0);
+    std::fill(rows.begin(), rows.end(), 0);
+    MarkTileRange(tile.x0 - nAfter, tile.x1 - 1 + nAnchor, state.nWidth, state.nTileSize, bWrap, columns);
+    MarkTileRange(tile.y0 - nAfter, tile.y1 - 1 + nAnchor, state.nHeight, state.nTileSize, bWrap, rows);
+
+    for (int ty = 0; ty < state.nTilesY; ty++)
+      if (rows[ty])
+	for (int tx = 0; tx < state.nTilesX; tx++)
+	  if (columns[tx])
+	    state.outputDirty[ty * state.nTilesX + tx] = 1;
+  }
+
+  state.dirtyTiles.clear();
+  for (int i = 0; i < IncrementalTileCount(state); i++)
+    if (state.outputDirty[i])
+      state.dirtyTiles.push_back(IncrementalTile(state, i));
+
+  return (int) state.dirtyTiles.size();
+}
@@ -0,0 +1,71 @@
+#ifndef __INCREMENTAL_H__
+#define __INCREMENTAL_H__
+
+#include "Border.hpp"
+
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Incremental reconvolution
+//
+// For streams whose frames mostly repeat the previous one. The image
+// is cut into a row-major grid of nTileSize x nTileSize tiles, and a
+// new frame marks the input tiles that changed. They come either from
+// a bitwise compare with the previous frame, which DiffTiles() does
+// with one memcmp per tile row, stopping at the first row that
+// differs, or from a mask the caller already has, such as a motion
+// detector or an encoder's skipped macroblocks (SetDirtyTiles()).
+//
+// Input column x reaches output columns x - (w - 1 - anchor) to
+// x + anchor, and rows likewise. The output tiles to recompute are
+// the dirty input tiles grown by that halo. With BORDER_WRAP the halo
+// wraps around the image. The mirror and clamp borders read pixels
+// nearer than the tap they replace, so the halo covers them. Every
+// other output tile keeps its value from the previous frame, so the
+// output buffer must persist between frames. The first frame is all
+// dirty.
+/////////////////////////////////////////////////////////////////
+
+struct incrementalState
+{
+  int nPitch;
+  int nWidth;
+  int nHeight;
+  int nTileSize;
+  int nTilesX;
+  int nTilesY;
+
+  float * pPrevious;		// Input of the previous frame
+  bool bPrevious;		// False until the first frame
+
+  std::vector<unsigned char> inputDirty;	// Per input tile, row-major
+  std::vector<unsigned char> outputDirty;	// Per output tile, row-major
+  std::vector<imageRect> dirtyTiles;		// Output tiles to recompute
+};
+
+void InitIncremental(incrementalState& state, int nPitch, int nWidth, int nHeight, int nTileSize);
+void ReleaseIncremental(incrementalState& state);
+
+inline int IncrementalTileCount(const incrementalState& state)
+{
+  return state.nTilesX * state.nTilesY;
+}
+
+// Tile i of the grid, clipped to the image
+imageRect IncrementalTile(const incrementalState& state, int i);
+
+// Marks the input tiles where pInput differs from the previous frame
+// and copies them into it. Returns the number of dirty tiles.
+int DiffTiles(incrementalState& state, const float * pInput, int nNumThreads);
+
+// Takes pMask, one byte per tile in row-major order, non-zero for a
+// changed tile, as the dirty input tiles. The marked tiles of pInput
+// are still copied into the previous frame, so a later DiffTiles()
+// compares against the right frame. Returns the number of dirty tiles.
+int SetDirtyTiles(incrementalState& state, const unsigned char * pMask, const float * pInput, int nNumThreads);
+
+// Fills state.dirtyTiles with the output tiles within the filter halo
+// of a dirty input tile. Returns their count.
+int DirtyOutputTiles(incrementalState& state, int nFilterWidth, int nBorderMode);
+
+#endif
@@ -0,0 +1,104 @@
+#include "JobExecutor.hpp"
+
+#include <string>
+
+/////////////////////////////////////////////////////////////////
+// Executor
+/////////////////////////////////////////////////////////////////
+
+JobExecutor::JobExecutor(int nWorkers, jobFunction function)
+  : function(function), nPending(0), bStop(false)
+{
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&workAvailable, NULL);
+  pthread_cond_init(&allDone, NULL);
+
+  for (int i = 0; i < nWorkers; i++)
+  {
+    workerInfo * pWorker = new workerInfo;
+    pWorker->pExecutor = this;
+
+    if (pthread_create(&pWorker->thread, NULL, WorkerMain, pWorker) != 0)
+    {
+      delete pWorker;
+      break;
+    }
+    workers.push_back(pWorker);
+  }
+
+  if (workers.empty())
+    throw(std::string("JobExecutor()::Could not start any worker"));
+}
+
+JobExecutor::~JobExecutor()
+{
+  pthread_mutex_lock(&mutex);
+  bStop = true;
+  pthread_cond_broadcast(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    pthread_join(workers[i]->thread, NULL);
+    delete workers[i];
+  }
+
+  pthread_cond_destroy(&allDone);
+  pthread_cond_destroy(&workAvailable);
+  pthread_mutex_destroy(&mutex);
+}
+
+void JobExecutor::Submit(convolutionJob * pJobs, int nJobs)
+{
+  pthread_mutex_lock(&mutex);
+  for (int i = 0; i < nJobs; i++)
+    queue.push_back(pJobs + i);
+  nPending += nJobs;
+  pthread_cond_broadcast(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+}
+
+void JobExecutor::Wait()
+{
+  pthread_mutex_lock(&mutex);
+  while (nPending > 0)
+    pthread_cond_wait(&allDone, &mutex);
+  pthread_mutex_unlock(&mutex);
+}
+
+void * JobExecutor::WorkerMain(void * pArg)
+{
+  workerInfo * pWorker = (workerInfo *) pArg;
+  JobExecutor * pExecutor = pWorker->pExecutor;
+
+  pthread_mutex_lock(&pExecutor->mutex);
+  for (;;)
+  {
+    while (pExecutor->queue.empty() && !pExecutor->bStop)
+      pthread_cond_wait(&pExecutor->workAvailable, &pExecutor->mutex);
+    if (pExecutor->queue.empty())
+      break;
+
+    convolutionJob * pJob = pExecutor->queue.front();
+    pExecutor->queue.pop_front();
+    pthread_mutex_unlock(&pExecutor->mutex);
+
+    // A job that throws gets its time at -1 rather than taking the
+    // pool down
+    try
+    {
+      pExecutor->function(*pJob);
+    }
+    catch (std::string)
+    {
+      pJob->dComputeTime = -1;
+    }
+
+    pthread_mutex_lock(&pExecutor->mutex);
+    if (--pExecutor->nPending == 0)
+      pthread_cond_broadcast(&pExecutor->allDone);
+  }
+  pthread_mutex_unlock(&pExecutor->mutex);
+
+  return NULL;
+}
@@ -0,0 +1,75 @@
+#ifndef __JOBEXECUTOR_H__
+#define __JOBEXECUTOR_H__
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Job executor
+//
+// A convolutionJob is one whole-image convolution with its own
+// convolutionState (see Convolution.hpp), so any number of them can
+// run at once without touching params or hostBuffers. The executor
+// keeps a fixed pool of worker threads. Each worker runs whole jobs
+// on its own thread, with no OpenMP team per image, which is the
+// right trade for many small images.
+//
+// The executor does not convolve itself: it calls the jobFunction it
+// was built with, RunConvolutionJob() in main.cpp, which runs the
+// job's engine over one tile covering the image, as the tiled
+// schedules do.
+/////////////////////////////////////////////////////////////////
+
+struct convolutionState;
+
+struct convolutionJob
+{
+  const convolutionState * pState;	// Owned by the submitter
+  int engine;			// CPU engine, see Convolution.hpp
+  int nFilterWidth;
+
+  // Set by the job function
+  double dComputeTime;		// Seconds, -1 if the job threw
+};
+
+// Runs one job on the calling thread
+typedef void (*jobFunction)(convolutionJob& job);
+
+class JobExecutor
+{
+public:
+
+  JobExecutor(int nWorkers, jobFunction function);
+  ~JobExecutor();
+
+  // Queues the jobs, which must stay alive until Wait() returns
+  void Submit(convolutionJob * pJobs, int nJobs);
+  // Blocks until every submitted job has run
+  void Wait();
+
+  int Workers() const { return (int) workers.size(); }
+
+private:
+
+  struct workerInfo
+  {
+    JobExecutor * pExecutor;
+    pthread_t thread;
+  };
+
+  static void * WorkerMain(void * pArg);
+
+  jobFunction function;
+  std::vector<workerInfo *> workers;
+  std::deque<convolutionJob *> queue;
+  int nPending;			// Queued or running
+  bool bStop;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t workAvailable;
+  pthread_cond_t allDone;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "MultiChannel.hpp"
+#include "Border.hpp"
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////////
+// Layout transposes
+/////////////////////////////////////////////////////////////////
+
+void InterleavedToPlanar(const float * pSrc, float * pDst,
+			 const int nPixels, const int nChannels, const int nNumThreads)
+{
+  const int nBlocks = nPixels / 4;
+
+#if defined(__SSE2__)
+  if (nChannels == 4)
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks; i++)
+    {
+      __m128 p0 = _mm_loadu_ps(pSrc + i*16);
+      __m128 p1 = _mm_loadu_ps(pSrc + i*16 + 4);
+      __m128 p2 = _mm_loadu_ps(pSrc + i*16 + 8);
+      __m128 p3 = _mm_loadu_ps(pSrc + i*16 + 12);
+      _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+      _mm_storeu_ps(pDst + i*4, p0);
+      _mm_storeu_ps(pDst + nPixels + i*4, p1);
+      _mm_storeu_ps(pDst + 2*nPixels + i*4, p2);
+      _mm_storeu_ps(pDst + 3*nPixels + i*4, p3);
+    }
+  }
+  else if (nChannels == 3)
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks; i++)
+    {
+      // a = r0 g0 b0 r1, b = g1 b1 r2 g2, c = b2 r3 g3 b3
+      __m128 a = _mm_loadu_ps(pSrc + i*12);
+      __m128 b = _mm_loadu_ps(pSrc + i*12 + 4);
+      __m128 c = _mm_loadu_ps(pSrc + i*12 + 8);
+
+      __m128 r = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+      __m128 g = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+				_mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+      __m128 bl = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)),
+				 _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+
+      _mm_storeu_ps(pDst + i*4, r);
+      _mm_storeu_ps(pDst + nPixels + i*4, g);
+      _mm_storeu_ps(pDst + 2*nPixels + i*4, bl);
+    }
+  }
+  else
+#endif
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks*4; i++)
+      for (int ch = 0; ch < nChannels; ch++)
+	pDst[ch*nPixels + i] = pSrc[i*nChannels + ch];
+  }
+
+  for (int i = nBlocks*4; i < nPixels; i++)
+    for (int ch = 0; ch < nChannels; ch++)
+      pDst[ch*nPixels + i] = pSrc[i*nChannels + ch];
+}
+
+void PlanarToInterleaved(const float * pSrc, float * pDst,
+			 const int nPixels, const int nChannels, const int nNumThreads)
+{
+  const int nBlocks = nPixels / 4;
+
+#if defined(__SSE2__)
+  if (nChannels == 4)
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks; i++)
+    {
+      __m128 p0 = _mm_loadu_ps(pSrc + i*4);
+      __m128 p1 = _mm_loadu_ps(pSrc + nPixels + i*4);
+      __m128 p2 = _mm_loadu_ps(pSrc + 2*nPixels + i*4);
+      __m128 p3 = _mm_loadu_ps(pSrc + 3*nPixels + i*4);
+      _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+      _mm_storeu_ps(pDst + i*16, p0);
+      _mm_storeu_ps(pDst + i*16 + 4, p1);
+      _mm_storeu_ps(pDst + i*16 + 8, p2);
+      _mm_storeu_ps(pDst + i*16 + 12, p3);
+    }
+  }
+  else if (nChannels == 3)
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks; i++)
+    {
+      __m128 r = _mm_loadu_ps(pSrc + i*4);
+      __m128 g = _mm_loadu_ps(pSrc + nPixels + i*4);
+      __m128 b = _mm_loadu_ps(pSrc + 2*nPixels + i*4);
+
+      __m128 p0 = _mm_shuffle_ps(_mm_shuffle_ps(r, g, _MM_SHUFFLE(0,0,0,0)),
+				 _mm_shuffle_ps(b, r, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+      __m128 p1 = _mm_shuffle_ps(_mm_shuffle_ps(g, b, _MM_SHUFFLE(1,1,1,1)),
+				 _mm_shuffle_ps(r, g, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+      __m128 p2 = _mm_shuffle_ps(_mm_shuffle_ps(b, r, _MM_SHUFFLE(3,3,2,2)),
+				 _mm_shuffle_ps(g, b, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+
+      _mm_storeu_ps(pDst + i*12, p0);
+      _mm_storeu_ps(pDst + i*12 + 4, p1);
+      _mm_storeu_ps(pDst + i*12 + 8, p2);
+    }
+  }
+  else
+#endif
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int i = 0; i < nBlocks*4; i++)
+      for (int ch = 0; ch < nChannels; ch++)
+	pDst[i*nChannels + ch] = pSrc[ch*nPixels + i];
+  }
+
+  for (int i = nBlocks*4; i < nPixels; i++)
+    for (int ch = 0; ch < nChannels; ch++)
+      pDst[i*nChannels + ch] = pSrc[ch*nPixels + i];
+}
+
+/////////////////////////////////////////////////////////////////
+// Convolution on CPU
+/////////////////////////////////////////////////////////////////
+
+// Valid convolution of an nWidth x nHeight region
+static void ConvolveInterleavedInterior(const float * pInput, const float * pFilter, float * pOutput,
+					const int nPitch, const int nWidth, const int nHeight,
+					const int nChannels, const int nFilterWidth, const int nNumThreads)
+{
+  const int nRowLength = nWidth * nChannels;
+
+#pragma omp parallel for num_threads(nNumThreads)
+  for (int yOut = 0; yOut < nHeight; yOut++)
+  {
+    float * pOut = pOutput + yOut * nPitch * nChannels;
+
+    for (int i = 0; i < nRowLength; i++)
+      pOut[i] = 0;
+
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const float * pInRow = pInput + (yOut + r) * nPitch * nChannels;
+
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const float f = pFilter[r * nFilterWidth + c];
+	const float * pIn = pInRow + c * nChannels;
+
+	for (int i = 0; i < nRowLength; i++)
+	  pOut[i] += f * pIn[i];
+      }
+    }
+  }
+}
+
+void ConvolveInterleaved(const float * pInput, const float * pFilter, float * pOutput,
+			 const int nPitch, const int nWidth, const int nHeight,
+			 const int nChannels, const int nFilterWidth,
+			 const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nInteriorWidth = nWidth - nFilterWidth + 1;
+  const int nInteriorHeight = nHeight - nFilterWidth + 1;
+
+  if (nInteriorWidth > 0 && nInteriorHeight > 0)
+    ConvolveInterleavedInterior(pInput, pFilter, pOutput + (nAnchor * nPitch + nAnchor) * nChannels,
+				nPitch, nInteriorWidth, nInteriorHeight,
+				nChannels, nFilterWidth, nNumThreads);
+
+  ConvolveBorder(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nChannels,
+		 nFilterWidth, nBorderMode, fBorderValue, nNumThreads);
+}
+
+void ConvolvePlanar(const float * pInput, const float * pFilter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight,
+		    const int nChannels, const int nFilterWidth,
+		    const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  const int nPlaneSize = nPitch * nHeight;
+
+  for (int ch = 0; ch < nChannels; ch++)
+    ConvolveInterleaved(pInput + ch * nPlaneSize, pFilter, pOutput + ch * nPlaneSize,
+			nPitch, nWidth, nHeight,
+			1, nFilterWidth,
+			nBorderMode, fBorderValue, nNumThreads);
+}
+
+void ConvolveInterleavedTile(const float * pInput, const float * pFilter, float * pOutput,
+			     const int nPitch, const int nWidth, const int nHeight,
+			     const int nChannels, const int nFilterWidth,
+			     const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const imageRect interior = TileInterior(tile, nWidth, nHeight, nFilterWidth);
+
+  if (!RectEmpty(interior))
+    ConvolveInterleavedInterior(pInput + ((interior.y0 - nAnchor) * nPitch + interior.x0 - nAnchor) * nChannels,
+				pFilter, pOutput + (interior.y0 * nPitch + interior.x0) * nChannels,
+				nPitch, interior.x1 - interior.x0, interior.y1 - interior.y0,
+				nChannels, nFilterWidth, 1);
+
+  ConvolveBorderTile(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nChannels,
+		     nFilterWidth, nBorderMode, fBorderValue, tile);
+}
+
+void ConvolvePlanarTile(const float * pInput, const float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nChannels, const int nFilterWidth,
+			const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  const int nPlaneSize = nPitch * nHeight;
+
+  for (int ch = 0; ch < nChannels; ch++)
+    ConvolveInterleavedTile(pInput + ch * nPlaneSize, pFilter, pOutput + ch * nPlaneSize,
+			    nPitch, nWidth, nHeight,
+			    1, nFilterWidth,
+			    nBorderMode, fBorderValue, tile);
+}
@@ -0,0 +1,62 @@
+#ifndef __MULTICHANNEL_H__
+#define __MULTICHANNEL_H__
+
+#include "Border.hpp"
+
+/////////////////////////////////////////////////////////////////
+// Multi-channel (RGB / RGBA) images
+//
+// Interleaved: pixel (x, y) channel ch is at (y * nPitch + x) * nChannels + ch.
+// Planar:      channel ch is a full plane at ch * nPitch * nHeight.
+//
+// nPitch is in pixels and shared by both layouts.
+/////////////////////////////////////////////////////////////////
+
+enum layoutType
+{
+  LAYOUT_INTERLEAVED = 0,
+  LAYOUT_PLANAR
+};
+
+#define MAX_CHANNELS 4
+
+/////////////////////////////////////////////////////////////////
+// Layout transposes (SSE for 3 and 4 channels)
+/////////////////////////////////////////////////////////////////
+
+void InterleavedToPlanar(const float * pSrc, float * pDst,
+			 const int nPixels, const int nChannels, const int nNumThreads);
+void PlanarToInterleaved(const float * pSrc, float * pDst,
+			 const int nPixels, const int nChannels, const int nNumThreads);
+
+/////////////////////////////////////////////////////////////////
+// Convolution on CPU
+//
+// All channels are convolved with the same filter in one pass. Each
+// interior output row is accumulated tap by tap over its
+// contiguous floats, so the inner loop is a unit-stride SIMD loop
+// whatever the channel count. Borders follow Border.hpp.
+/////////////////////////////////////////////////////////////////
+
+void ConvolveInterleaved(const float * pInput, const float * pFilter, float * pOutput,
+			 const int nPitch, const int nWidth, const int nHeight,
+			 const int nChannels, const int nFilterWidth,
+			 const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+void ConvolvePlanar(const float * pInput, const float * pFilter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight,
+		    const int nChannels, const int nFilterWidth,
+		    const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// One output tile, all channels, on the calling thread
+void ConvolveInterleavedTile(const float * pInput, const float * pFilter, float * pOutput,
+			     const int nPitch, const int nWidth, const int nHeight,
+			     const int nChannels, const int nFilterWidth,
+			     const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+void ConvolvePlanarTile(const float * pInput, const float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nChannels, const int nFilterWidth,
+			const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+#endif
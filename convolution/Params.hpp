@@ -2,6 +2,8 @@
 #define PARAMS_H_
 
 #include "CLHelpers.hpp"
+#include "Convolution.hpp"
+#include "TypedConvolution.hpp"
 
 #include <vector>
 #include <iostream>
@@ -13,22 +15,53 @@
 
 struct paramStruct
 {
-  int nWidth;		// Output image width
-  int nHeight;		// Output image height
-  int nInWidth;		// Input  image width
-  int nInHeight;	// Input  image height
+  int nWidth;		// Image width
+  int nHeight;		// Image height
+  int nPitch;		// Row pitch in pixels of float images
+  int nTypedPitch;	// Row pitch in pixels of nDataType images
   int nFilterWidth;	// Filter size is nFilterWidth X nFilterWidth
+  bool bFilterWidthSet;	// -f given, otherwise nFilterWidth is the default
+  int nFilterType;	// Filter taps (0=random, 1=box, 2=cross, 3=Laplacian)
+  int nDilation;	// Taps on every nDilation-th row and column from the anchor
+  int nGpuInput;	// GPU input path (0=buffer, 1=local memory, 2=image)
+  int nDevice;		// OpenCL device index (see -p), -1 for the fastest by calibration
   int nIterations;	// Run timing loop for nIterations
 
   int nMode;		// Execution mode (-1=All, 0=CPU, 1=GPU)
+  int nDataType;	// Storage type (0=float, 1=u8, 2=u16, 3=half)
+  int nChannels;	// Channels per pixel (1, 3 or 4)
+  int nLayout;		// Multi-channel layout (0=interleaved, 1=planar)
+
+  int nBorderMode;	// Border mode (0=clamp, 1=mirror, 2=wrap, 3=constant)
+  float fBorderValue;	// Constant border value
+
+  int nInputPattern;	// Synthetic input (see Workload.hpp)
+  unsigned int nSeed;	// Seed of every generated buffer
 
   // Test CPU performance with 1,4,8 etc. OpenMP threads
   std::vector<int> ompThreads;
   int nOmpRuns;		// ompThreads.size()
 
+  int nSchedule;	// CPU work schedule (see TileScheduler.hpp)
+  int nTileOrder;	// Tile traversal order of the tiled schedules
+  int nTileSize;	// Tile width and height in pixels
+
   bool benchmark;	// Benchmark mode
+  bool bHwCounters;	// Hardware counters of the timed CPU runs
+  bool bEnergy;		// RAPL energy of the timed CPU and GPU runs
+
+  const char * pServicePath;	// Unix socket of the service mode, NULL otherwise
+  const char * pRingName;	// Shared-memory rings of the ingest mode, NULL otherwise
+  int nJobs;		// Independent images of the job executor benchmark, 0 otherwise
+  const char * pPipeline;	// Filter pipeline spec (see Pipeline.hpp), NULL otherwise
+  int nPyramidLevels;		// Levels of the pyramid benchmark, 0 otherwise
+  int nBankFilters;		// Largest bank of the filter-bank benchmark, 0 otherwise
+  int nSweepSize;		// Largest image side of the size sweep, 0 otherwise
+  int nTemporalFrames;		// Frames of the spatio-temporal filter, 0 otherwise
+  int nChangedArea;		// Percent of each frame the incremental benchmark changes, -1 otherwise
 
-} params;
+};
+extern paramStruct params;
 
 void Usage(char *name);
 void ParseCommandLine(int argc, char* argv[]);
@@ -38,16 +71,47 @@ void InitParams(int argc, char* argv[])
   params.nWidth = 1024;
   params.nHeight = 1024;
   params.nFilterWidth = 3;
+  params.bFilterWidthSet = false;
+  params.nFilterType = FILTER_RANDOM;
+  params.nDilation = 1;
+  params.nGpuInput = GPU_INPUT_BUFFER;
+  params.nDevice = -1;
   params.nIterations = 1;
 
   params.nMode = -1;
+  params.nDataType = 0;
+  params.nChannels = 1;
+  params.nLayout = LAYOUT_INTERLEAVED;
+  params.nBorderMode = BORDER_CLAMP;
+  params.fBorderValue = 0.0f;
+
+  params.nInputPattern = PATTERN_UNIFORM;
+  params.nSeed = 0;
+
+  params.nSchedule = SCHEDULE_ENGINE;
+  params.nTileOrder = TILE_ORDER_MORTON;
+  params.nTileSize = 64;
 
   params.benchmark = false;
+  params.bHwCounters = false;
+  params.bEnergy = false;
+  params.pServicePath = NULL;
+  params.pRingName = NULL;
+  params.nJobs = 0;
+  params.pPipeline = NULL;
+  params.nPyramidLevels = 0;
+  params.nBankFilters = 0;
+  params.nSweepSize = 0;
+  params.nTemporalFrames = 0;
+  params.nChangedArea = -1;
 
   ParseCommandLine(argc, argv);
 
-  params.nInWidth = params.nWidth + (params.nFilterWidth-1);
-  params.nInHeight = params.nHeight + (params.nFilterWidth-1);
+  if (params.nChannels > 1 && params.nDataType != DATA_FLOAT)
+    throw(std::string("Multi-channel images are only supported with float data"));
+
+  params.nPitch = AlignedPitch(params.nWidth, sizeof(float));
+  params.nTypedPitch = AlignedPitch(params.nWidth, DataTypeSize(params.nDataType));
 
   params.ompThreads.push_back(4);
   //params.ompThreads.push_back(1);
@@ -65,16 +129,375 @@ void ParseCommandLine(int argc, char* argv[])
       if (++i < argc)
 	sscanf(argv[i], "%d", &params.nMode);
       break;
+    case 't':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nDataType);
+	if (params.nDataType < 0 || params.nDataType >= DATA_TYPE_COUNT)
+	{
+	  std::cerr << "Invalid data type " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'c':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nChannels);
+	if (params.nChannels != 1 && params.nChannels != 3 && params.nChannels != 4)
+	{
+	  std::cerr << "Invalid channel count " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'l':
+      if (++i < argc)
+	sscanf(argv[i], "%d", &params.nLayout);
+      break;
+    case 'e':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nBorderMode);
+	if (params.nBorderMode < 0 || params.nBorderMode >= BORDER_MODE_COUNT)
+	{
+	  std::cerr << "Invalid border mode " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'v':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%f", &params.fBorderValue);
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'a':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nSchedule);
+	if (params.nSchedule < 0 || params.nSchedule >= SCHEDULE_COUNT)
+	{
+	  std::cerr << "Invalid CPU schedule " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'u':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nTileOrder);
+	if (params.nTileOrder < 0 || params.nTileOrder >= TILE_ORDER_COUNT)
+	{
+	  std::cerr << "Invalid tile order " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'w':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nTileSize);
+	if (params.nTileSize < 1)
+	{
+	  std::cerr << "Invalid tile size " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
     case 'p':
       CLHelpers::printAllDeviceInfo();
       exit(EXIT_SUCCESS);
     case 'b':
       params.benchmark = true;
       break;
+    case 'o':
+      params.bHwCounters = true;
+      break;
+    case 'E':
+      params.bEnergy = true;
+      break;
     case 'f':
       if (++i < argc)
       {
 	sscanf(argv[i], "%u", &params.nFilterWidth);
+	params.bFilterWidthSet = true;
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'k':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nFilterType);
+	if (params.nFilterType < 0 || params.nFilterType >= FILTER_TYPE_COUNT)
+	{
+	  std::cerr << "Invalid filter type " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'D':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nDilation);
+	if (params.nDilation < 1)
+	{
+	  std::cerr << "Invalid dilation " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'g':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nGpuInput);
+	if (params.nGpuInput < 0 || params.nGpuInput >= GPU_INPUT_COUNT)
+	{
+	  std::cerr << "Invalid GPU input path " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'G':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nDevice);
+	if (params.nDevice < -1)
+	{
+	  std::cerr << "Invalid device " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 's':
+      if (++i < argc)
+      {
+	params.pServicePath = argv[i];
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'r':
+      if (++i < argc)
+      {
+	params.pRingName = argv[i];
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'j':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nJobs);
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'd':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nInputPattern);
+	if (params.nInputPattern < 0 || params.nInputPattern >= PATTERN_COUNT)
+	{
+	  std::cerr << "Invalid input pattern " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw;
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'z':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%u", &params.nSeed);
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'n':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nPyramidLevels);
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'F':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nBankFilters);
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'S':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nSweepSize);
+	if (params.nSweepSize != 0 && params.nSweepSize < SWEEP_MIN_SIZE)
+	{
+	  std::cerr << "Invalid size sweep limit " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'T':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nTemporalFrames);
+	if (params.nTemporalFrames < 0)
+	{
+	  std::cerr << "Invalid temporal frame count " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'I':
+      if (++i < argc)
+      {
+	sscanf(argv[i], "%d", &params.nChangedArea);
+	if (params.nChangedArea < -1 || params.nChangedArea > 100)
+	{
+	  std::cerr << "Invalid changed area " << argv[i] << std::endl;
+	  Usage(argv[0]);
+	  throw(std::string("Invalid argument"));
+	}
+      }
+      else
+      {
+	std::cerr << "Could not read argument after option " << argv[i-1] << std::endl;
+	Usage(argv[0]);
+	throw;
+      }
+      break;
+    case 'q':
+      if (++i < argc)
+      {
+	params.pPipeline = argv[i];
       }
       else
       {
@@ -132,12 +555,38 @@ void ParseCommandLine(int argc, char* argv[])
 
 void Usage(char *name)
 {
-  printf("\tUsage: %s [-h] [-m <int>] [-p] [-b] [-f <int>] [-i <int>] [-x <int>] [-y <int>]\n", name);
+  printf("\tUsage: %s [-h] [-m <int>] [-t <int>] [-c <int>] [-l <int>] [-e <int>] [-v <float>] [-d <int>] [-z <int>] [-a <int>] [-u <int>] [-w <int>] [-p] [-b] [-o] [-E] [-f <int>] [-k <int>] [-D <int>] [-g <int>] [-G <int>] [-s <path>] [-r <name>] [-j <int>] [-q <spec>] [-n <int>] [-F <int>] [-S <int>] [-T <int>] [-I <int>] [-i <int>] [-x <int>] [-y <int>]\n", name);
   printf("   -h		Print this help menu.\n");
   printf("   -m <int>	Mode (0=CPU, 1=GPU).\n");
+  printf("   -t <int>	Data type (0=float, 1=u8, 2=u16, 3=half).\n");
+  printf("   -c <int>	Channels per pixel (1, 3 or 4).\n");
+  printf("   -l <int>	Multi-channel layout (0=interleaved, 1=planar).\n");
+  printf("   -e <int>	Border mode (0=clamp, 1=mirror, 2=wrap, 3=constant).\n");
+  printf("   -v <float>	Constant border value, in storage units.\n");
+  printf("   -d <int>	Input pattern (0=uniform, 1=normal, 2=constant, 3=gradient, 4=sparse).\n");
+  printf("   -z <int>	Seed of the generated input and filters.\n");
+  printf("   -a <int>	CPU schedule (0=engine row bands, 1=OpenMP static tiles, 2=OpenMP dynamic tiles,\n"
+	 "		3=OpenMP guided tiles, 4=work-stealing tile pool).\n");
+  printf("   -u <int>	Tile order of the tiled CPU schedules (0=row-major, 1=Morton).\n");
+  printf("   -w <int>	Tile width and height of the tiled CPU schedules.\n");
   printf("   -p		Print available OpenCL platforms.\n");
   printf("   -b		Benchmark mode.\n");
+  printf("   -o		Report hardware counters of the CPU runs (Linux perf_event_open).\n");
+  printf("   -E		Report energy per frame of the CPU and GPU runs (Linux powercap RAPL).\n");
   printf("   -f <int>	Sets the filter width.\n");
+  printf("   -k <int>	Filter type (0=random, 1=box, 2=cross, 3=Laplacian).\n");
+  printf("   -D <int>	Dilation: only every <int>-th row and column of the filter from its anchor has taps.\n");
+  printf("   -g <int>	GPU input path (0=buffer, 1=local memory, 2=image).\n");
+  printf("   -G <int>	OpenCL device index as listed by -p, -1 (default) for the fastest by calibration.\n");
+  printf("   -s <path>	Run as a service on the Unix socket <path>, see convolve_client.\n");
+  printf("   -r <name>	Convolve frames from the shared-memory ring <name>, see ring_producer.\n");
+  printf("   -j <int>	Time <int> independent images on the job executor against one at a time.\n");
+  printf("   -q <spec>	Time a filter pipeline fused and unfused, e.g. c5,c3,a,k0:1 (see Pipeline.hpp).\n");
+  printf("   -n <int>	Time a Gaussian / Laplacian pyramid of <int> levels with a binomial filter of width -f.\n");
+  printf("   -F <int>	Time filter banks of 1, 2, 4, ... up to <int> filters of width -f, one GEMM per bank.\n");
+  printf("   -S <int>	Time every engine on images of height 64, 128, ... up to <int>, power-of-two, odd and wide widths, power-of-two and padded pitch, every benchmark filter width up to -f.\n");
+  printf("   -T <int>	Convolve a stream of -i frames with a -f x -f x <int> filter through a ring of the last <int> frames.\n");
+  printf("   -I <int>	Reconvolve -i frames with <int> percent changed, whole and by dirty -w tiles only.\n");
   printf("   -i <int>	Number of iterations.\n");
   printf("   -x <int>	Sets the image width.\n");
   printf("   -y <int>	Sets the image height.\n");
@@ -0,0 +1,315 @@
+#include "Pipeline.hpp"
+#include "Border.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////////
+// Spec parsing
+/////////////////////////////////////////////////////////////////
+
+bool ParsePipeline(const char * pSpec, std::vector<pipelineStage>& stages)
+{
+  stages.clear();
+
+  const char * p = pSpec;
+  while (*p)
+  {
+    pipelineStage stage;
+    memset(&stage, 0, sizeof(stage));
+
+    char * pEnd = (char *) p + 1;
+    switch (*p)
+    {
+    case 'c':
+      stage.nType = STAGE_CONVOLVE;
+      stage.nFilterWidth = strtol(p + 1, &pEnd, 10);
+      if (stage.nFilterWidth <= 0)
+	return false;
+      break;
+    case 's':
+    case 'k':
+      stage.nType = (*p == 's') ? STAGE_SCALE : STAGE_CLAMP;
+      stage.fA = strtof(p + 1, &pEnd);
+      if (*pEnd != ':')
+	return false;
+      stage.fB = strtof(pEnd + 1, &pEnd);
+      break;
+    case 'a':
+      stage.nType = STAGE_ABS;
+      break;
+    case 't':
+      stage.nType = STAGE_THRESHOLD;
+      stage.fA = strtof(p + 1, &pEnd);
+      break;
+    default:
+      return false;
+    }
+
+    if (*pEnd != ',' && *pEnd != 0)
+      return false;
+    p = (*pEnd == ',') ? pEnd + 1 : pEnd;
+
+    stages.push_back(stage);
+  }
+
+  return !stages.empty();
+}
+
+bool PipelineFusable(int nBorderMode)
+{
+  return nBorderMode != BORDER_WRAP;
+}
+
+/////////////////////////////////////////////////////////////////
+// Execution
+/////////////////////////////////////////////////////////////////
+
+// A convolution and the pointwise ops that follow it
+struct convStep
+{
+  int nFilterWidth;
+  const float * pFilter;
+  int nBefore;			// Rows / columns of the window before the centre
+  int nAfter;
+  std::vector<pipelineStage> post;
+};
+
+// Rows [nFirstRow, nFirstRow + n) of a stage's input, each padded
+// with nBefore / nAfter border columns
+struct rowBuffer
+{
+  std::vector<float> data;
+  int nStride;
+  int nBefore;
+  int nFirstRow;
+
+  float * Row(int y) { return &data[(size_t) (y - nFirstRow) * nStride]; }
+};
+
+static void BuildSteps(const std::vector<pipelineStage>& stages,
+		       std::vector<pipelineStage>& pre, std::vector<convStep>& steps)
+{
+  for (size_t i = 0; i < stages.size(); i++)
+  {
+    const pipelineStage& stage = stages[i];
+    if (stage.nType == STAGE_CONVOLVE)
+    {
+      convStep step;
+      step.nFilterWidth = stage.nFilterWidth;
+      step.pFilter = stage.pFilter;
+      step.nBefore = FilterAnchor(stage.nFilterWidth);
+      step.nAfter = stage.nFilterWidth - 1 - step.nBefore;
+      steps.push_back(step);
+    }
+    else if (steps.empty())
+      pre.push_back(stage);
+    else
+      steps.back().post.push_back(stage);
+  }
+}
+
+static void ApplyOpsRow(const std::vector<pipelineStage>& ops, size_t nFirst, size_t nLast,
+			float * pRow, const int nWidth)
+{
+  for (size_t i = nFirst; i < nLast; i++)
+    for (int x = 0; x < nWidth; x++)
+      pRow[x] = ApplyPointwise(ops[i], pRow[x]);
+}
+
+// Fills the border columns of a row whose pixels start at pRow + nBefore
+static void PadRow(float * pRow, const int nWidth, const int nBefore, const int nAfter,
+		   const int nBorderMode, const float fBorderValue)
+{
+  const float * pPixels = pRow + nBefore;
+
+  for (int i = 0; i < nBefore; i++)
+  {
+    const int x = BorderIndex(i - nBefore, nWidth, nBorderMode);
+    pRow[i] = (x < 0) ? fBorderValue : pPixels[x];
+  }
+  for (int i = 0; i < nAfter; i++)
+  {
+    const int x = BorderIndex(nWidth + i, nWidth, nBorderMode);
+    pRow[nBefore + nWidth + i] = (x < 0) ? fBorderValue : pPixels[x];
+  }
+}
+
+// One output row of a convolution step, the input rows are already padded
+static void ConvolveRow(const convStep& step, rowBuffer& in, const float * pConstantRow,
+			const int y, const int nWidth, const int nHeight, const int nBorderMode,
+			float * pDst)
+{
+  const int nFilterWidth = step.nFilterWidth;
+
+  for (int x = 0; x < nWidth; x++)
+    pDst[x] = 0;
+
+  for (int r = 0; r < nFilterWidth; r++)
+  {
+    const int yIn = BorderIndex(y + r - step.nBefore, nHeight, nBorderMode);
+    const float * pInRow = (yIn < 0) ? pConstantRow : in.Row(yIn);
+
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const float f = step.pFilter[r * nFilterWidth + c];
+      const float * pIn = pInRow + c;
+
+      for (int x = 0; x < nWidth; x++)
+	pDst[x] += f * pIn[x];
+    }
+  }
+}
+
+static void InitRowBuffer(rowBuffer& buffer, const convStep& consumer, const int nWidth, const int nRows)
+{
+  buffer.nBefore = consumer.nBefore;
+  buffer.nStride = nWidth + consumer.nFilterWidth - 1;
+  buffer.nFirstRow = 0;
+  buffer.data.resize((size_t) nRows * buffer.nStride);
+}
+
+void RunPipeline(const float * pInput, float * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight,
+		 const std::vector<pipelineStage>& stages,
+		 const int nBorderMode, const float fBorderValue,
+		 const bool bFused, const int nNumThreads)
+{
+  std::vector<pipelineStage> pre;
+  std::vector<convStep> steps;
+  BuildSteps(stages, pre, steps);
+
+  const int nSteps = (int) steps.size();
+
+  // Pointwise ops only
+  if (nSteps == 0)
+  {
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int y = 0; y < nHeight; y++)
+    {
+      memcpy(pOutput + y * nPitch, pInput + y * nPitch, nWidth * sizeof(float));
+      ApplyOpsRow(pre, 0, pre.size(), pOutput + y * nPitch, nWidth);
+    }
+    return;
+  }
+
+  int nMaxStride = 0;
+  int nTotalHalo = 0;
+  for (int s = 0; s < nSteps; s++)
+  {
+    nMaxStride = std::max(nMaxStride, nWidth + steps[s].nFilterWidth - 1);
+    nTotalHalo += steps[s].nFilterWidth - 1;
+  }
+  const std::vector<float> constantRow(nMaxStride, fBorderValue);
+
+  if (!bFused || !PipelineFusable(nBorderMode))
+  {
+    // Stage by stage over whole images, one pass per op
+    std::vector<rowBuffer> buffers(nSteps);
+    for (int s = 0; s < nSteps; s++)
+      InitRowBuffer(buffers[s], steps[s], nWidth, nHeight);
+
+#pragma omp parallel for num_threads(nNumThreads)
+    for (int y = 0; y < nHeight; y++)
+      memcpy(buffers[0].Row(y) + buffers[0].nBefore, pInput + y * nPitch, nWidth * sizeof(float));
+
+    for (size_t i = 0; i < pre.size(); i++)
+    {
+#pragma omp parallel for num_threads(nNumThreads)
+      for (int y = 0; y < nHeight; y++)
+	ApplyOpsRow(pre, i, i + 1, buffers[0].Row(y) + buffers[0].nBefore, nWidth);
+    }
+
+    for (int s = 0; s < nSteps; s++)
+    {
+      const bool bLast = (s == nSteps - 1);
+
+#pragma omp parallel for num_threads(nNumThreads)
+      for (int y = 0; y < nHeight; y++)
+	PadRow(buffers[s].Row(y), nWidth, steps[s].nBefore, steps[s].nAfter, nBorderMode, fBorderValue);
+
+#pragma omp parallel for num_threads(nNumThreads)
+      for (int y = 0; y < nHeight; y++)
+      {
+	float * pDst = bLast ? pOutput + y * nPitch : buffers[s+1].Row(y) + buffers[s+1].nBefore;
+	ConvolveRow(steps[s], buffers[s], &constantRow[0], y, nWidth, nHeight, nBorderMode, pDst);
+      }
+
+      for (size_t i = 0; i < steps[s].post.size(); i++)
+      {
+#pragma omp parallel for num_threads(nNumThreads)
+	for (int y = 0; y < nHeight; y++)
+	{
+	  float * pDst = bLast ? pOutput + y * nPitch : buffers[s+1].Row(y) + buffers[s+1].nBefore;
+	  ApplyOpsRow(steps[s].post, i, i + 1, pDst, nWidth);
+	}
+      }
+    }
+    return;
+  }
+
+  // Bands sized so that one stage's rows stay around 256 KiB
+  const int nBandRows = std::max(8, std::min(64, int(256 * 1024 / (nMaxStride * sizeof(float)))
+					      - nTotalHalo));
+  const int nBands = (nHeight + nBandRows - 1) / nBandRows;
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    // Input rows of step s, with everything later steps read around a band
+    std::vector<rowBuffer> buffers(nSteps);
+    std::vector<int> rowsEnd(nSteps);
+    int nHalo = nTotalHalo;
+    for (int s = 0; s < nSteps; s++)
+    {
+      InitRowBuffer(buffers[s], steps[s], nWidth, nBandRows + nHalo);
+      nHalo -= steps[s].nFilterWidth - 1;
+    }
+
+#pragma omp for schedule(dynamic)
+    for (int band = 0; band < nBands; band++)
+    {
+      const int y0 = band * nBandRows;
+      const int y1 = std::min(nHeight, y0 + nBandRows);
+
+      // Rows each step must produce, walking back from the band. With
+      // clamp, mirror and constant borders every remapped row stays
+      // inside these ranges.
+      int lo = y0, hi = y1;
+      for (int s = nSteps - 1; s >= 0; s--)
+      {
+	lo = std::max(0, lo - steps[s].nBefore);
+	hi = std::min(nHeight, hi + steps[s].nAfter);
+	buffers[s].nFirstRow = lo;
+	rowsEnd[s] = hi;
+      }
+
+      for (int y = buffers[0].nFirstRow; y < rowsEnd[0]; y++)
+      {
+	float * pRow = buffers[0].Row(y);
+	memcpy(pRow + buffers[0].nBefore, pInput + y * nPitch, nWidth * sizeof(float));
+	ApplyOpsRow(pre, 0, pre.size(), pRow + buffers[0].nBefore, nWidth);
+	PadRow(pRow, nWidth, steps[0].nBefore, steps[0].nAfter, nBorderMode, fBorderValue);
+      }
+
+      for (int s = 0; s < nSteps; s++)
+      {
+	const bool bLast = (s == nSteps - 1);
+	const int yBegin = bLast ? y0 : buffers[s+1].nFirstRow;
+	const int yEnd = bLast ? y1 : rowsEnd[s+1];
+
+	for (int y = yBegin; y < yEnd; y++)
+	{
+	  float * pRow = bLast ? NULL : buffers[s+1].Row(y);
+	  float * pDst = bLast ? pOutput + y * nPitch : pRow + buffers[s+1].nBefore;
+
+	  ConvolveRow(steps[s], buffers[s], &constantRow[0], y, nWidth, nHeight, nBorderMode, pDst);
+	  ApplyOpsRow(steps[s].post, 0, steps[s].post.size(), pDst, nWidth);
+	  if (!bLast)
+	    PadRow(pRow, nWidth, steps[s+1].nBefore, steps[s+1].nAfter, nBorderMode, fBorderValue);
+	}
+      }
+    }
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Filter pipeline
+//
+// A chain of convolutions and pointwise ops applied to one float
+// image. Every convolution reads the previous stage's full-size
+// result with the same border mode, as if the stages ran one after
+// another over whole images, which is exactly what the unfused path
+// does.
+//
+// The fused path processes horizontal bands of rows. Each band pulls
+// only the rows it needs from stage to stage through small
+// per-thread buffers that stay in cache, and pointwise ops are
+// applied to a row as soon as it is produced. Neighbouring bands
+// recompute the rows their windows share. Wrap borders need rows
+// from the far side of the image, so they use the unfused path.
+//
+// Spec syntax, stages separated by commas:
+//   c<w>        convolution with a w x w filter
+//   s<a>:<b>    v * a + b
+//   k<lo>:<hi>  clamp to [lo, hi]
+//   a           |v|
+//   t<th>       v >= th ? 1 : 0
+/////////////////////////////////////////////////////////////////
+
+enum stageType
+{
+  STAGE_CONVOLVE = 0,
+  STAGE_SCALE,
+  STAGE_CLAMP,
+  STAGE_ABS,
+  STAGE_THRESHOLD
+};
+
+struct pipelineStage
+{
+  int nType;
+  int nFilterWidth;		// STAGE_CONVOLVE
+  float * pFilter;		// STAGE_CONVOLVE, set by the caller
+  float fA;			// Pointwise arguments
+  float fB;
+};
+
+// False on a syntax error. Convolution filters are left NULL.
+bool ParsePipeline(const char * pSpec, std::vector<pipelineStage>& stages);
+
+inline float ApplyPointwise(const pipelineStage& stage, float v)
+{
+  switch (stage.nType)
+  {
+  case STAGE_SCALE: return v * stage.fA + stage.fB;
+  case STAGE_CLAMP: return v < stage.fA ? stage.fA : (v > stage.fB ? stage.fB : v);
+  case STAGE_ABS: return v < 0 ? -v : v;
+  case STAGE_THRESHOLD: return v >= stage.fA ? 1.0f : 0.0f;
+  }
+  return v;
+}
+
+bool PipelineFusable(int nBorderMode);
+
+// pInput and pOutput are nWidth x nHeight with a row pitch of nPitch
+void RunPipeline(const float * pInput, float * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight,
+		 const std::vector<pipelineStage>& stages,
+		 const int nBorderMode, const float fBorderValue,
+		 const bool bFused, const int nNumThreads);
+
+#endif
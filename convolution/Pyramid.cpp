@@ -0,0 +1,297 @@
+#include "Pyramid.hpp"
+#include "Border.hpp"
+
+#include <omp.h>
+#include <stdlib.h>
+
+#include <string>
+
+/////////////////////////////////////////////////////////////////
+// Buffer pool
+/////////////////////////////////////////////////////////////////
+
+BufferPool::~BufferPool()
+{
+  for (size_t i = 0; i < entries.size(); i++)
+    free(entries[i].pBuffer);
+}
+
+float * BufferPool::Acquire(size_t nFloats)
+{
+  // Smallest free buffer that fits
+  int nBest = -1;
+  for (size_t i = 0; i < entries.size(); i++)
+    if (!entries[i].bInUse && entries[i].nCapacity >= nFloats &&
+	(nBest < 0 || entries[i].nCapacity < entries[nBest].nCapacity))
+      nBest = (int) i;
+
+  if (nBest < 0)
+  {
+    entry e;
+    e.pBuffer = (float *) malloc(nFloats * sizeof(float));
+    if (!e.pBuffer)
+      throw(std::string("BufferPool::Acquire()::Could not allocate memory"));
+    e.nCapacity = nFloats;
+    entries.push_back(e);
+    nAllocations++;
+    nBest = (int) entries.size() - 1;
+  }
+
+  entries[nBest].bInUse = true;
+  return entries[nBest].pBuffer;
+}
+
+void BufferPool::Release(const float * pBuffer)
+{
+  for (size_t i = 0; i < entries.size(); i++)
+    if (entries[i].pBuffer == pBuffer)
+      entries[i].bInUse = false;
+}
+
+/////////////////////////////////////////////////////////////////
+// Levels
+/////////////////////////////////////////////////////////////////
+
+void InitBinomialFilter(float * pFilter, int nFilterWidth)
+{
+  // Row of Pascal's triangle
+  std::vector<double> taps(nFilterWidth, 0);
+  taps[0] = 1;
+  for (int n = 1; n < nFilterWidth; n++)
+    for (int i = n; i > 0; i--)
+      taps[i] += taps[i-1];
+
+  double dSum = 0;
+  for (int i = 0; i < nFilterWidth; i++)
+    dSum += taps[i];
+
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+      pFilter[r * nFilterWidth + c] = float(taps[r] * taps[c] / (dSum * dSum));
+}
+
+void PyramidGeometry(int nWidth, int nHeight, int nPitch, int nLevels,
+		     std::vector<pyramidLevel>& levels)
+{
+  levels.clear();
+
+  for (int k = 0; k < nLevels; k++)
+  {
+    pyramidLevel level;
+    level.nWidth = nWidth;
+    level.nHeight = nHeight;
+    level.nPitch = (k == 0) ? nPitch : AlignedPitch(nWidth, sizeof(float));
+    level.pGaussian = NULL;
+    level.pLaplacian = NULL;
+    level.dReduceTime = 0;
+    level.dExpandTime = 0;
+    levels.push_back(level);
+
+    if (nWidth == 1 && nHeight == 1)
+      break;
+    nWidth = (nWidth + 1) / 2;
+    nHeight = (nHeight + 1) / 2;
+  }
+}
+
+// Pixel x of a row with the border applied, pRow is NULL for a
+// constant border row
+static inline float Sample(const float * pRow, int x, int nWidth, int nBorderMode, float fBorderValue)
+{
+  if (!pRow)
+    return fBorderValue;
+  if ((unsigned) x < (unsigned) nWidth)
+    return pRow[x];
+  const int i = BorderIndex(x, nWidth, nBorderMode);
+  return (i < 0) ? fBorderValue : pRow[i];
+}
+
+static inline const float * BorderRow(const float * pImage, int y, int nPitch, int nHeight, int nBorderMode)
+{
+  const int i = BorderIndex(y, nHeight, nBorderMode);
+  return (i < 0) ? NULL : pImage + i * nPitch;
+}
+
+// Level out = filtered and decimated level in. Input columns
+// 2j - anchor and 2j + 1 - anchor go to pEven[j] and pOdd[j], so tap
+// c of output x reads phase c & 1 at x + c / 2.
+static void ReduceLevel(const pyramidLevel& in, const pyramidLevel& out, float * pOut,
+			const float * pFilter, const int nFilterWidth,
+			const int nBorderMode, const float fBorderValue,
+			const int nNumThreads, BufferPool& pool)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nPhase = (in.nWidth + nFilterWidth) / 2 + 1;
+  float * pScratch = pool.Acquire((size_t) nNumThreads * 2 * nPhase);
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    float * pEven = pScratch + (size_t) omp_get_thread_num() * 2 * nPhase;
+    float * pOdd = pEven + nPhase;
+
+#pragma omp for
+    for (int y = 0; y < out.nHeight; y++)
+    {
+      float * pDst = pOut + y * out.nPitch;
+      for (int x = 0; x < out.nWidth; x++)
+	pDst[x] = 0;
+
+      for (int r = 0; r < nFilterWidth; r++)
+      {
+	const float * pRow = BorderRow(in.pGaussian, 2 * y + r - nAnchor, in.nPitch, in.nHeight, nBorderMode);
+	for (int j = 0; j < nPhase; j++)
+	{
+	  pEven[j] = Sample(pRow, 2 * j - nAnchor, in.nWidth, nBorderMode, fBorderValue);
+	  pOdd[j] = Sample(pRow, 2 * j + 1 - nAnchor, in.nWidth, nBorderMode, fBorderValue);
+	}
+
+	for (int c = 0; c < nFilterWidth; c++)
+	{
+	  const float f = pFilter[r * nFilterWidth + c];
+	  const float * pIn = ((c & 1) ? pOdd : pEven) + c / 2;
+
+	  for (int x = 0; x < out.nWidth; x++)
+	    pDst[x] += f * pIn[x];
+	}
+      }
+    }
+  }
+
+  pool.Release(pScratch);
+}
+
+// pDst = pSrc + fSign * expand(pCoarse) over the fine level. Fine
+// pixel x = 2i + p only gathers taps c with c = p + anchor (mod 2),
+// from coarse pixel i + (p + anchor - c) / 2, and likewise for rows.
+static void ExpandLevel(const pyramidLevel& coarse, const float * pCoarse,
+			const pyramidLevel& fine, const float * pSrc, float * pDst, const float fSign,
+			const float * pFilter, const int nFilterWidth,
+			const int nBorderMode, const float fBorderValue,
+			const int nNumThreads, BufferPool& pool)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nPad = nFilterWidth / 2 + 1;
+  const int nRow = coarse.nWidth + 2 * nPad;
+  const int nHalf[2] = {(fine.nWidth + 1) / 2, fine.nWidth / 2};
+  const size_t nScratch = nRow + 2 * nHalf[0];
+  float * pScratch = pool.Acquire(nNumThreads * nScratch);
+
+  // Transpose of the reduction, 4 restores the mean of the decimated pixels
+  const float fScale = 4 * fSign;
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    float * pRow = pScratch + omp_get_thread_num() * nScratch;
+    float * pAcc[2] = {pRow + nRow, pRow + nRow + nHalf[0]};
+
+#pragma omp for
+    for (int y = 0; y < fine.nHeight; y++)
+    {
+      for (int i = 0; i < nHalf[0]; i++)
+	pAcc[0][i] = pAcc[1][i] = 0;
+
+      for (int r = 0; r < nFilterWidth; r++)
+      {
+	if ((y + nAnchor - r) & 1)
+	  continue;
+
+	const float * pCoarseRow = BorderRow(pCoarse, (y + nAnchor - r) / 2, coarse.nPitch, coarse.nHeight, nBorderMode);
+	for (int j = 0; j < nRow; j++)
+	  pRow[j] = Sample(pCoarseRow, j - nPad, coarse.nWidth, nBorderMode, fBorderValue);
+
+	for (int c = 0; c < nFilterWidth; c++)
+	{
+	  const int p = (c + nAnchor) & 1;
+	  const float f = pFilter[r * nFilterWidth + c];
+	  const float * pIn = pRow + nPad + (p + nAnchor - c) / 2;
+	  float * pOut = pAcc[p];
+
+	  for (int i = 0; i < nHalf[p]; i++)
+	    pOut[i] += f * pIn[i];
+	}
+      }
+
+      const float * pSrcRow = pSrc + y * fine.nPitch;
+      float * pDstRow = pDst + y * fine.nPitch;
+      for (int i = 0; i < nHalf[0]; i++)
+	pDstRow[2 * i] = pSrcRow[2 * i] + fScale * pAcc[0][i];
+      for (int i = 0; i < nHalf[1]; i++)
+	pDstRow[2 * i + 1] = pSrcRow[2 * i + 1] + fScale * pAcc[1][i];
+    }
+  }
+
+  pool.Release(pScratch);
+}
+
+void BuildPyramid(const float * pInput, int nPitch, int nWidth, int nHeight,
+		  const float * pFilter, int nFilterWidth, int nLevels,
+		  int nBorderMode, float fBorderValue, int nNumThreads,
+		  BufferPool& pool, std::vector<pyramidLevel>& levels)
+{
+  PyramidGeometry(nWidth, nHeight, nPitch, nLevels, levels);
+  levels[0].pGaussian = pInput;
+
+  for (size_t k = 1; k < levels.size(); k++)
+  {
+    const double dStart = omp_get_wtime();
+
+    float * pGaussian = pool.Acquire((size_t) levels[k].nPitch * levels[k].nHeight);
+    ReduceLevel(levels[k-1], levels[k], pGaussian, pFilter, nFilterWidth,
+		nBorderMode, fBorderValue, nNumThreads, pool);
+    levels[k].pGaussian = pGaussian;
+
+    levels[k].dReduceTime = omp_get_wtime() - dStart;
+  }
+
+  for (size_t k = 0; k + 1 < levels.size(); k++)
+  {
+    const double dStart = omp_get_wtime();
+
+    levels[k].pLaplacian = pool.Acquire((size_t) levels[k].nPitch * levels[k].nHeight);
+    ExpandLevel(levels[k+1], levels[k+1].pGaussian, levels[k], levels[k].pGaussian,
+		levels[k].pLaplacian, -1, pFilter, nFilterWidth,
+		nBorderMode, fBorderValue, nNumThreads, pool);
+
+    levels[k].dExpandTime = omp_get_wtime() - dStart;
+  }
+}
+
+void ReleasePyramid(std::vector<pyramidLevel>& levels, BufferPool& pool)
+{
+  for (size_t k = 0; k < levels.size(); k++)
+  {
+    if (k > 0)
+      pool.Release(levels[k].pGaussian);
+    pool.Release(levels[k].pLaplacian);
+    levels[k].pGaussian = NULL;
+    levels[k].pLaplacian = NULL;
+  }
+}
+
+void CollapsePyramid(const std::vector<pyramidLevel>& levels,
+		     const float * pFilter, int nFilterWidth,
+		     int nBorderMode, float fBorderValue, int nNumThreads,
+		     BufferPool& pool, float * pOutput)
+{
+  const int nTop = (int) levels.size() - 1;
+  const float * pCurrent = levels[nTop].pGaussian;
+
+  if (nTop == 0)
+  {
+    for (int y = 0; y < levels[0].nHeight; y++)
+      for (int x = 0; x < levels[0].nWidth; x++)
+	pOutput[y * levels[0].nPitch + x] = pCurrent[y * levels[0].nPitch + x];
+    return;
+  }
+
+  for (int k = nTop - 1; k >= 0; k--)
+  {
+    float * pNext = (k == 0) ? pOutput : pool.Acquire((size_t) levels[k].nPitch * levels[k].nHeight);
+    ExpandLevel(levels[k+1], pCurrent, levels[k], levels[k].pLaplacian, pNext, 1,
+		pFilter, nFilterWidth, nBorderMode, fBorderValue, nNumThreads, pool);
+
+    if (k + 1 < nTop)
+      pool.Release(pCurrent);
+    pCurrent = pNext;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+
+#include <stddef.h>
+
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Gaussian / Laplacian pyramid
+//
+// Level 0 is the input. Level k + 1 is level k filtered and then
+// decimated by two in each direction, giving (W + 1) / 2 x (H + 1) / 2.
+// Only the retained pixels are computed. Output (x, y) is the sum of
+// filter[r][c] * level(2x + c - anchor, 2y + r - anchor), with the
+// border remapping of Border.hpp.
+//
+// Laplacian level k is level k minus the expansion of level k + 1.
+// The top level keeps only its Gaussian image, so adding the
+// expansions back from the top rebuilds the input exactly. The
+// expansion is the transpose of the reduction, scaled by 4. Each
+// output pixel visits only the taps that land on a coarse pixel,
+// which is about a quarter of the filter.
+//
+// On the CPU, every input row is split into its even and odd columns
+// before use, so the stride-2 taps become unit-stride loops.
+/////////////////////////////////////////////////////////////////
+
+// Fixed set of float buffers handed out by size. Released buffers
+// are kept for the next Acquire(), so rebuilding a pyramid of the
+// same size does not allocate.
+class BufferPool
+{
+public:
+
+  BufferPool() : nAllocations(0) {}
+  ~BufferPool();
+
+  float * Acquire(size_t nFloats);
+  void Release(const float * pBuffer);
+
+  int Allocations() const { return nAllocations; }
+
+private:
+
+  struct entry
+  {
+    float * pBuffer;
+    size_t nCapacity;
+    bool bInUse;
+  };
+
+  std::vector<entry> entries;
+  int nAllocations;
+};
+
+struct pyramidLevel
+{
+  int nWidth;
+  int nHeight;
+  int nPitch;
+
+  const float * pGaussian;	// Level 0 is the caller's input
+  float * pLaplacian;		// NULL on the top level
+
+  double dReduceTime;		// Seconds spent building pGaussian
+  double dExpandTime;		// Seconds spent building pLaplacian
+};
+
+// Normalized binomial taps, the usual stand-in for a Gaussian
+void InitBinomialFilter(float * pFilter, int nFilterWidth);
+
+// Sizes and pitches of up to nLevels levels, stopping at 1 x 1
+void PyramidGeometry(int nWidth, int nHeight, int nPitch, int nLevels,
+		     std::vector<pyramidLevel>& levels);
+
+void BuildPyramid(const float * pInput, int nPitch, int nWidth, int nHeight,
+		  const float * pFilter, int nFilterWidth, int nLevels,
+		  int nBorderMode, float fBorderValue, int nNumThreads,
+		  BufferPool& pool, std::vector<pyramidLevel>& levels);
+
+// Returns every buffer of the pyramid to the pool
+void ReleasePyramid(std::vector<pyramidLevel>& levels, BufferPool& pool);
+
+// Rebuilds level 0 from the Laplacian levels into pOutput
+void CollapsePyramid(const std::vector<pyramidLevel>& levels,
+		     const float * pFilter, int nFilterWidth,
+		     int nBorderMode, float fBorderValue, int nNumThreads,
+		     BufferPool& pool, float * pOutput);
+
+#endif
@@ -0,0 +1,126 @@
+#include "RaplCounters.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+
+RaplCounters::RaplCounters()
+{
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+    joules[d] = 0;
+}
+
+const char * RaplCounters::Name(int domain)
+{
+  switch (domain)
+  {
+  case RAPL_PACKAGE: return "package";
+  case RAPL_DRAM: return "dram";
+  }
+  return "unknown";
+}
+
+// First line of a sysfs attribute, false if it cannot be read
+static bool ReadAttribute(const std::string& path, std::string& value)
+{
+  std::ifstream file(path.c_str());
+  return file.is_open() && std::getline(file, value);
+}
+
+static bool ReadCounter(const std::string& path, uint64_t& value)
+{
+  std::string text;
+  if (!ReadAttribute(path, text))
+    return false;
+  value = strtoull(text.c_str(), NULL, 10);
+  return true;
+}
+
+bool RaplCounters::Open(const char * pRoot)
+{
+  DIR * pDir = opendir(pRoot);
+  if (!pDir)
+  {
+    error = std::string(pRoot) + ": " + strerror(errno);
+    return false;
+  }
+
+  // Zones sorted so that packages are summed in a stable order
+  std::vector<std::string> names;
+  for (struct dirent * pEntry = readdir(pDir); pEntry; pEntry = readdir(pDir))
+    if (strncmp(pEntry->d_name, "intel-rapl:", strlen("intel-rapl:")) == 0)
+      names.push_back(pEntry->d_name);
+  closedir(pDir);
+  std::sort(names.begin(), names.end());
+
+  for (size_t z = 0; z < names.size(); z++)
+  {
+    const std::string zonePath = std::string(pRoot) + "/" + names[z];
+    std::string name;
+    int domain;
+
+    if (!ReadAttribute(zonePath + "/name", name))
+      continue;
+    if (name.compare(0, strlen("package-"), "package-") == 0)
+      domain = RAPL_PACKAGE;
+    else if (name == "dram")
+      domain = RAPL_DRAM;
+    else
+      continue;
+
+    raplZone zone;
+    zone.energyPath = zonePath + "/energy_uj";
+    zone.nStart = 0;
+    if (!ReadCounter(zone.energyPath, zone.nStart))
+    {
+      if (error.empty())
+	error = zone.energyPath + ": " + strerror(errno);
+      continue;
+    }
+    if (!ReadCounter(zonePath + "/max_energy_range_uj", zone.nMaxRange))
+      zone.nMaxRange = 0;
+
+    zones[domain].push_back(zone);
+  }
+
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+    if (Available(d))
+      return true;
+
+  if (error.empty())
+    error = std::string("no RAPL package or dram zone in ") + pRoot;
+  return false;
+}
+
+void RaplCounters::Start()
+{
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+    for (size_t z = 0; z < zones[d].size(); z++)
+      ReadCounter(zones[d][z].energyPath, zones[d][z].nStart);
+}
+
+void RaplCounters::Stop()
+{
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+  {
+    joules[d] = 0;
+    for (size_t z = 0; z < zones[d].size(); z++)
+    {
+      const raplZone& zone = zones[d][z];
+      uint64_t nEnd;
+      if (!ReadCounter(zone.energyPath, nEnd))
+	continue;
+
+      // A counter below its start value wrapped, unless the range is
+      // unknown and it cannot be told from a reset
+      if (nEnd >= zone.nStart)
+	joules[d] += double(nEnd - zone.nStart) * 1e-6;
+      else if (zone.nMaxRange > zone.nStart)
+	joules[d] += double(zone.nMaxRange - zone.nStart + nEnd) * 1e-6;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef __RAPLCOUNTERS_H__
+#define __RAPLCOUNTERS_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Energy counters
+//
+// Reads the RAPL (running average power limit) energy counters the
+// Linux powercap framework exposes under /sys/class/powercap. Every
+// intel-rapl zone named package-<n> adds to the package domain and
+// every zone named dram to the DRAM domain, so a multi-socket machine
+// reports the energy of all its sockets. Core, uncore and psys zones
+// overlap the package and are ignored.
+//
+// The counters are machine-wide: Joules() includes whatever else runs
+// during the measured region, and an integrated GPU is part of the
+// package while a discrete one is not counted at all. A counter wraps
+// at max_energy_range_uj; one wrap per region is corrected, so regions
+// must stay shorter than a wrap period (minutes at full load).
+//
+// Where powercap is missing (other systems, VMs, non-Intel/AMD CPUs)
+// or energy_uj is not readable (root only on recent kernels), Open()
+// returns false and every domain reads as unavailable.
+/////////////////////////////////////////////////////////////////
+
+#define RAPL_POWERCAP_PATH "/sys/class/powercap"
+
+enum raplDomain
+{
+  RAPL_PACKAGE = 0,
+  RAPL_DRAM,
+  RAPL_DOMAIN_COUNT
+};
+
+class RaplCounters
+{
+public:
+
+  RaplCounters();
+
+  // True if at least one domain has a readable zone under pRoot.
+  // Otherwise Error() says why.
+  bool Open(const char * pRoot = RAPL_POWERCAP_PATH);
+
+  // Energy between Start() and Stop() replaces the previous one
+  void Start();
+  void Stop();
+
+  bool Available(int domain) const { return !zones[domain].empty(); }
+  double Joules(int domain) const { return joules[domain]; }
+  const std::string& Error() const { return error; }
+
+  static const char * Name(int domain);
+
+private:
+
+  struct raplZone
+  {
+    std::string energyPath;	// energy_uj of the zone
+    uint64_t nMaxRange;		// Microjoules at which energy_uj wraps to 0
+    uint64_t nStart;		// energy_uj at Start()
+  };
+
+  std::vector<raplZone> zones[RAPL_DOMAIN_COUNT];
+  double joules[RAPL_DOMAIN_COUNT];
+  std::string error;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////
+// ring_producer: stands in for a capture process in front of a
+// convolve -r <name> engine. The main thread writes frames into
+// /<name>_in, a second thread drains /<name>_out and measures the
+// end-to-end latency of every frame. See FrameRing.hpp.
+/////////////////////////////////////////////////////////////////
+
+#include "FrameRing.hpp"
+
+#include <iostream>
+#include <string>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+struct producerParamStruct
+{
+  const char * pRingName;
+  int nFrames;
+  double dFps;		// 0 = as fast as the engine takes them
+} producerParams;
+
+struct sinkStats
+{
+  frameRing * pOutput;
+  long nFrames;
+  double dTotalLatency;
+  double dMaxLatency;
+};
+
+void Usage(char * name)
+{
+  printf("\tUsage: %s -r <name> [-h] [-n <int>] [-p <float>]\n", name);
+  printf("   -h		Print this help menu.\n");
+  printf("   -r <name>	Rings of the convolve -r <name> engine.\n");
+  printf("   -n <int>	Number of frames.\n");
+  printf("   -p <float>	Frames per second, 0 for unthrottled.\n");
+}
+
+void ParseCommandLine(int argc, char * argv[])
+{
+  producerParams.pRingName = NULL;
+  producerParams.nFrames = 1000;
+  producerParams.dFps = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (argv[i][0] != '-' || argv[i][1] == 0)
+    {
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+    if (argv[i][1] == 'h')
+    {
+      Usage(argv[0]);
+      exit(1);
+    }
+    if (++i >= argc)
+    {
+      cerr << "Could not read argument after option " << argv[i-1] << endl;
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+
+    switch (argv[i-1][1])
+    {
+    case 'r': producerParams.pRingName = argv[i]; break;
+    case 'n': sscanf(argv[i], "%d", &producerParams.nFrames); break;
+    case 'p': sscanf(argv[i], "%lf", &producerParams.dFps); break;
+    default:
+      cerr << "Invalid argument " << argv[i-1] << endl;
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+  }
+
+  if (!producerParams.pRingName)
+  {
+    Usage(argv[0]);
+    throw(string("Missing ring name"));
+  }
+}
+
+void * DrainOutput(void * pArg)
+{
+  sinkStats * pStats = (sinkStats *) pArg;
+  uint64_t nTimestamp;
+
+  while (AcquireReadSlot(*pStats->pOutput, true, &nTimestamp))
+  {
+    const double dLatency = (MonotonicNanoseconds() - nTimestamp) * 1e-9;
+    ReleaseSlot(*pStats->pOutput);
+
+    pStats->nFrames++;
+    pStats->dTotalLatency += dLatency;
+    if (dLatency > pStats->dMaxLatency)
+      pStats->dMaxLatency = dLatency;
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[])
+{
+  try
+  {
+    ParseCommandLine(argc, argv);
+
+    const string inName = string("/") + producerParams.pRingName + "_in";
+    const string outName = string("/") + producerParams.pRingName + "_out";
+
+    frameRing input, output;
+    if (!OpenFrameRing(input, inName.c_str()) || !OpenFrameRing(output, outName.c_str()))
+      throw(string("Could not open ") + inName + " and " + outName + ", is the engine running?");
+
+    const int nWidth = input.pHeader->nWidth;
+    const int nHeight = input.pHeader->nHeight;
+    const int nPitch = input.pHeader->nPitch;
+
+    sinkStats stats = {&output, 0, 0, 0};
+    pthread_t sink;
+    if (pthread_create(&sink, NULL, DrainOutput, &stats) != 0)
+      throw(string("Could not start the output thread"));
+
+    const uint64_t nStart = MonotonicNanoseconds();
+    const double dPeriod = (producerParams.dFps > 0) ? 1e9 / producerParams.dFps : 0;
+
+    for (int f = 0; f < producerParams.nFrames; f++)
+    {
+      if (dPeriod > 0)
+      {
+	const uint64_t nDue = nStart + (uint64_t) (f * dPeriod);
+	const uint64_t nNow = MonotonicNanoseconds();
+	if (nDue > nNow)
+	  usleep((nDue - nNow) / 1000);
+      }
+
+      // A camera writes straight into the slot
+      float * pFrame = AcquireWriteSlot(input, true);
+      for (int y = 0; y < nHeight; y++)
+	for (int x = 0; x < nWidth; x++)
+	  pFrame[y * nPitch + x] = float((x + y + f) & 255) / 255.0f;
+
+      PublishSlot(input, MonotonicNanoseconds());
+    }
+
+    CloseFrameRingWriter(input);
+    pthread_join(sink, NULL);
+
+    const double dSeconds = (MonotonicNanoseconds() - nStart) * 1e-9;
+
+    cout << "Frames:         " << stats.nFrames << " of " << producerParams.nFrames << endl;
+    cout << "Throughput:     " << stats.nFrames / dSeconds << " fps" << endl;
+    cout << "Latency:        " << (stats.nFrames ? stats.dTotalLatency / stats.nFrames : 0)
+	 << "s (max " << stats.dMaxLatency << "s)" << endl;
+    cout << "Max depth:      " << input.pHeader->nMaxDepth << " / " << input.pHeader->nSlots << endl;
+    cout << "Producer waits: " << input.pHeader->nWriterWaits << endl;
+
+    CloseFrameRing(input, false);
+    CloseFrameRing(output, false);
+  }
+  catch (string msg)
+  {
+    cerr << "Exception caught in main(): " << msg << endl;
+  }
+
+  return 0;
+}
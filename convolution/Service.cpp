@@ -0,0 +1,135 @@
+#include "Service.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static bool FillAddress(const char * pPath, sockaddr_un * pAddr)
+{
+  memset(pAddr, 0, sizeof(*pAddr));
+  pAddr->sun_family = AF_UNIX;
+  if (strlen(pPath) >= sizeof(pAddr->sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(pAddr->sun_path, pPath);
+  return true;
+}
+
+int ServiceListen(const char * pPath)
+{
+  sockaddr_un addr;
+  if (!FillAddress(pPath, &addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  // A stale socket file from a previous run would make bind() fail
+  unlink(pPath);
+
+  if (bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+  {
+    const int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+int ServiceConnect(const char * pPath)
+{
+  sockaddr_un addr;
+  if (!FillAddress(pPath, &addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0)
+  {
+    const int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+bool SendAll(int fd, const void * pData, size_t nBytes)
+{
+  const char * p = (const char *) pData;
+  while (nBytes > 0)
+  {
+    const ssize_t n = send(fd, p, nBytes, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    nBytes -= n;
+  }
+  return true;
+}
+
+bool RecvAll(int fd, void * pData, size_t nBytes)
+{
+  char * p = (char *) pData;
+  while (nBytes > 0)
+  {
+    const ssize_t n = recv(fd, p, nBytes, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    nBytes -= n;
+  }
+  return true;
+}
+
+bool SkipAll(int fd, size_t nBytes)
+{
+  char buffer[4096];
+  while (nBytes > 0)
+  {
+    const size_t n = (nBytes < sizeof(buffer)) ? nBytes : sizeof(buffer);
+    if (!RecvAll(fd, buffer, n))
+      return false;
+    nBytes -= n;
+  }
+  return true;
+}
+
+float * MapSharedImage(const char * pName, size_t nBytes, bool bCreate)
+{
+  int fd = shm_open(pName, bCreate ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (bCreate ? (ftruncate(fd, nBytes) < 0) : (fstat(fd, &st) < 0 || (size_t) st.st_size < nBytes))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void * p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return (p == MAP_FAILED) ? NULL : (float *) p;
+}
+
+void UnmapSharedImage(float * pImage, size_t nBytes)
+{
+  if (pImage)
+    munmap(pImage, nBytes);
+}
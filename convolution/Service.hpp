@@ -0,0 +1,79 @@
+#ifndef __SERVICE_H__
+#define __SERVICE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/////////////////////////////////////////////////////////////////
+// Convolution service protocol
+//
+// The service (convolve -s <path>) keeps its OpenCL context,
+// program and host buffers alive and serves jobs over a Unix domain
+// stream socket. A connection carries any number of requests, each
+// answered by one reply:
+//
+//   client: serviceRequest, nFilterWidth^2 float taps,
+//           nWidth * nHeight float pixels unless sharedName is set
+//   server: serviceReply, nWidth * nHeight float pixels unless
+//           sharedName is set or nStatus != 0
+//
+// Images travel tightly packed, row after row. With sharedName set
+// the pixels stay in a POSIX shared-memory object of 2 * nWidth *
+// nHeight floats: the input followed by the output.
+//
+// A job that fails is answered with nStatus = -1 and the connection
+// stays open. A request with invalid sizes closes it after the reply,
+// since its payload size cannot be trusted.
+/////////////////////////////////////////////////////////////////
+
+#define SERVICE_MAGIC 0x564e4f43	// "CONV"
+#define SERVICE_NAME_LENGTH 64
+#define SERVICE_MAX_FILTER_WIDTH 255
+#define SERVICE_MAX_PIXELS (1 << 28)	// nWidth * nHeight, 1 GiB per float image
+
+enum serviceCommand
+{
+  SERVICE_CONVOLVE = 0,
+  SERVICE_SHUTDOWN
+};
+
+enum serviceDevice
+{
+  SERVICE_CPU = 0,
+  SERVICE_GPU
+};
+
+struct serviceRequest
+{
+  uint32_t nMagic;
+  int32_t nCommand;
+  int32_t nDevice;
+  int32_t nWidth;
+  int32_t nHeight;
+  int32_t nFilterWidth;
+  int32_t nBorderMode;
+  float fBorderValue;
+  char sharedName[SERVICE_NAME_LENGTH];
+};
+
+struct serviceReply
+{
+  int32_t nStatus;		// 0 on success
+  double dComputeTime;		// Seconds spent convolving, transfers excluded
+  char message[128];		// Error message when nStatus != 0
+};
+
+// Socket helpers, return -1 / false on failure with errno set
+int ServiceListen(const char * pPath);
+int ServiceConnect(const char * pPath);
+bool SendAll(int fd, const void * pData, size_t nBytes);
+bool RecvAll(int fd, void * pData, size_t nBytes);
+// Reads and discards nBytes, keeping the stream in step
+bool SkipAll(int fd, size_t nBytes);
+
+// Maps an existing (or new, if bCreate) shared-memory object of nBytes,
+// NULL on failure
+float * MapSharedImage(const char * pName, size_t nBytes, bool bCreate);
+void UnmapSharedImage(float * pImage, size_t nBytes);
+
+#endif
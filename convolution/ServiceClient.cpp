@@ -0,0 +1,232 @@
+/////////////////////////////////////////////////////////////////
+// convolve_client: sends jobs to a running convolve -s <path>
+// service and reports the round-trip latency next to the time the
+// service spent convolving. See Service.hpp for the protocol.
+/////////////////////////////////////////////////////////////////
+
+#include "Service.hpp"
+#include "Timer.hpp"
+#include "Workload.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+struct clientParamStruct
+{
+  const char * pServicePath;
+  int nDevice;		// 0=CPU, 1=GPU
+  int nWidth;
+  int nHeight;
+  int nFilterWidth;
+  int nBorderMode;
+  float fBorderValue;
+  int nJobs;		// Jobs sent over one connection
+  bool bShared;		// Pass pixels through shared memory
+  bool bShutdown;	// Stop the service instead
+} clientParams;
+
+void Usage(char * name)
+{
+  printf("\tUsage: %s -s <path> [-h] [-m <int>] [-x <int>] [-y <int>] [-f <int>] [-e <int>] [-v <float>] [-n <int>] [-z] [-q]\n", name);
+  printf("   -h		Print this help menu.\n");
+  printf("   -s <path>	Unix socket of the service.\n");
+  printf("   -m <int>	Device (0=CPU, 1=GPU).\n");
+  printf("   -x <int>	Sets the image width.\n");
+  printf("   -y <int>	Sets the image height.\n");
+  printf("   -f <int>	Sets the filter width.\n");
+  printf("   -e <int>	Border mode (0=clamp, 1=mirror, 2=wrap, 3=constant).\n");
+  printf("   -v <float>	Constant border value.\n");
+  printf("   -n <int>	Number of jobs.\n");
+  printf("   -z		Pass images through shared memory.\n");
+  printf("   -q		Shut the service down.\n");
+}
+
+void ParseCommandLine(int argc, char * argv[])
+{
+  clientParams.pServicePath = NULL;
+  clientParams.nDevice = 0;
+  clientParams.nWidth = 256;
+  clientParams.nHeight = 256;
+  clientParams.nFilterWidth = 3;
+  clientParams.nBorderMode = 0;
+  clientParams.fBorderValue = 0.0f;
+  clientParams.nJobs = 100;
+  clientParams.bShared = false;
+  clientParams.bShutdown = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (argv[i][0] != '-' || argv[i][1] == 0)
+    {
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+
+    switch (argv[i][1])
+    {
+    case 'z':
+      clientParams.bShared = true;
+      continue;
+    case 'q':
+      clientParams.bShutdown = true;
+      continue;
+    case 'h':
+      Usage(argv[0]);
+      exit(1);
+    }
+
+    if (++i >= argc)
+    {
+      cerr << "Could not read argument after option " << argv[i-1] << endl;
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+
+    switch (argv[i-1][1])
+    {
+    case 's': clientParams.pServicePath = argv[i]; break;
+    case 'm': sscanf(argv[i], "%d", &clientParams.nDevice); break;
+    case 'x': sscanf(argv[i], "%d", &clientParams.nWidth); break;
+    case 'y': sscanf(argv[i], "%d", &clientParams.nHeight); break;
+    case 'f': sscanf(argv[i], "%d", &clientParams.nFilterWidth); break;
+    case 'e': sscanf(argv[i], "%d", &clientParams.nBorderMode); break;
+    case 'v': sscanf(argv[i], "%f", &clientParams.fBorderValue); break;
+    case 'n': sscanf(argv[i], "%d", &clientParams.nJobs); break;
+    default:
+      cerr << "Invalid argument " << argv[i-1] << endl;
+      Usage(argv[0]);
+      throw(string("Invalid argument"));
+    }
+  }
+
+  if (!clientParams.pServicePath)
+  {
+    Usage(argv[0]);
+    throw(string("Missing service path"));
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  int fd = -1;
+  float * pShared = NULL;
+  char sharedName[SERVICE_NAME_LENGTH] = {0};
+  size_t nSharedBytes = 0;
+
+  try
+  {
+    ParseCommandLine(argc, argv);
+
+    fd = ServiceConnect(clientParams.pServicePath);
+    if (fd < 0)
+      throw(string("Could not connect to ") + clientParams.pServicePath + ": " + strerror(errno));
+
+    serviceRequest request;
+    memset(&request, 0, sizeof(request));
+    request.nMagic = SERVICE_MAGIC;
+
+    if (clientParams.bShutdown)
+    {
+      request.nCommand = SERVICE_SHUTDOWN;
+      SendAll(fd, &request, sizeof(request));
+      close(fd);
+      return 0;
+    }
+
+    const int nWidth = clientParams.nWidth;
+    const int nHeight = clientParams.nHeight;
+    const int nFilterSize = clientParams.nFilterWidth * clientParams.nFilterWidth;
+    const size_t nPixels = (size_t) nWidth * nHeight;
+
+    request.nCommand = SERVICE_CONVOLVE;
+    request.nDevice = clientParams.nDevice;
+    request.nWidth = nWidth;
+    request.nHeight = nHeight;
+    request.nFilterWidth = clientParams.nFilterWidth;
+    request.nBorderMode = clientParams.nBorderMode;
+    request.fBorderValue = clientParams.fBorderValue;
+
+    std::vector<float> filter(nFilterSize, 1.0f / nFilterSize);
+    std::vector<float> input(nPixels);
+    std::vector<float> output(nPixels);
+
+    for (size_t i = 0; i < nPixels; i++)
+      input[i] = WorkloadUniform(0, WORKLOAD_STREAM_INPUT, i);
+
+    if (clientParams.bShared)
+    {
+      snprintf(sharedName, sizeof(sharedName), "/convolve_client_%d", (int) getpid());
+      nSharedBytes = 2 * nPixels * sizeof(float);
+      pShared = MapSharedImage(sharedName, nSharedBytes, true);
+      if (!pShared)
+	throw(string("Could not create shared memory ") + sharedName);
+      memcpy(pShared, &input[0], nPixels * sizeof(float));
+      memcpy(request.sharedName, sharedName, sizeof(sharedName));
+    }
+
+    CPerfCounter counter;
+    double dComputeTime = 0;
+
+    counter.Reset();
+    counter.Start();
+
+    for (int j = 0; j < clientParams.nJobs; j++)
+    {
+      bool bOk = SendAll(fd, &request, sizeof(request)) &&
+	SendAll(fd, &filter[0], nFilterSize * sizeof(float));
+      if (bOk && !pShared)
+	bOk = SendAll(fd, &input[0], nPixels * sizeof(float));
+
+      // A rejected job is answered before its payload is read, so look
+      // for the reply even if sending failed
+      serviceReply reply;
+      if (!RecvAll(fd, &reply, sizeof(reply)))
+	throw(string("Connection to the service lost"));
+      if (reply.nStatus != 0)
+	throw(string("Service error: ") + reply.message);
+      if (!bOk)
+	throw(string("Connection to the service lost"));
+      if (!pShared && !RecvAll(fd, &output[0], nPixels * sizeof(float)))
+	throw(string("Connection to the service lost"));
+
+      dComputeTime += reply.dComputeTime;
+    }
+
+    counter.Stop();
+
+    const double dLatency = counter.GetElapsedTime() / clientParams.nJobs;
+    dComputeTime /= clientParams.nJobs;
+
+    cout << "Jobs:           " << clientParams.nJobs << endl;
+    cout << "Round trip:     " << dLatency << "s" << endl;
+    cout << "Compute:        " << dComputeTime << "s" << endl;
+    cout << "Overhead:       " << dLatency - dComputeTime << "s" << endl;
+  }
+  catch (string msg)
+  {
+    cerr << "Exception caught in main(): " << msg << endl;
+  }
+
+  if (pShared)
+  {
+    UnmapSharedImage(pShared, nSharedBytes);
+    shm_unlink(sharedName);
+  }
+  if (fd >= 0)
+    close(fd);
+
+  return 0;
+}
@@ -0,0 +1,173 @@
+#include "SparseFilter.hpp"
+
+#include <omp.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+
+void InitSparseFilter(sparseFilter& filter, const float * pFilter, const int nFilterWidth)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  filter.nFilterWidth = nFilterWidth;
+  filter.taps.clear();
+  filter.nMinDy = filter.nMaxDy = 0;
+  filter.nMinDx = filter.nMaxDx = 0;
+
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const float fWeight = pFilter[r * nFilterWidth + c];
+      if (fWeight == 0.0f)
+	continue;
+
+      filterTap tap;
+      tap.dy = r - nAnchor;
+      tap.dx = c - nAnchor;
+      tap.fWeight = fWeight;
+
+      if (filter.taps.empty())
+      {
+	filter.nMinDy = filter.nMaxDy = tap.dy;
+	filter.nMinDx = filter.nMaxDx = tap.dx;
+      }
+      filter.nMinDy = std::min(filter.nMinDy, tap.dy);
+      filter.nMaxDy = std::max(filter.nMaxDy, tap.dy);
+      filter.nMinDx = std::min(filter.nMinDx, tap.dx);
+      filter.nMaxDx = std::max(filter.nMaxDx, tap.dx);
+
+      filter.taps.push_back(tap);
+    }
+}
+
+bool SparseFilterPays(const sparseFilter& filter)
+{
+  return 2 * filter.taps.size() <= (size_t) (filter.nFilterWidth * filter.nFilterWidth);
+}
+
+static float SparseBorderPixel(const float * pInput, const sparseFilter& filter,
+			       const int nPitch, const int nWidth, const int nHeight,
+			       const int nBorderMode, const float fBorderValue,
+			       const int x, const int y)
+{
+  float sum = 0;
+  for (size_t t = 0; t < filter.taps.size(); t++)
+  {
+    const filterTap& tap = filter.taps[t];
+    const int xIn = BorderIndex(x + tap.dx, nWidth, nBorderMode);
+    const int yIn = BorderIndex(y + tap.dy, nHeight, nBorderMode);
+    sum += tap.fWeight * ((xIn < 0 || yIn < 0) ? fBorderValue : pInput[yIn * nPitch + xIn]);
+  }
+  return sum;
+}
+
+// Output row y, columns [x0, x1)
+static void ConvolveSparseRow(const float * pInput, const sparseFilter& filter, float * pOutput,
+			      const int nPitch, const int nWidth, const int nHeight,
+			      const int nBorderMode, const float fBorderValue,
+			      const int y, const int x0, const int x1)
+{
+  const int nTaps = (int) filter.taps.size();
+  float * pOut = pOutput + y * nPitch;
+
+  if (nTaps == 0)
+  {
+    for (int x = x0; x < x1; x++)
+      pOut[x] = 0.0f;
+    return;
+  }
+
+  // Columns whose taps are all inside the image
+  int xBegin = x0, xEnd = x0;
+  if (y + filter.nMinDy >= 0 && y + filter.nMaxDy < nHeight)
+  {
+    xBegin = std::min(std::max(x0, -filter.nMinDx), x1);
+    xEnd = std::max(xBegin, std::min(x1, nWidth - filter.nMaxDx));
+  }
+
+  for (int t = 0; t < nTaps; t++)
+  {
+    const filterTap& tap = filter.taps[t];
+    const float * pIn = pInput + (y + tap.dy) * nPitch + tap.dx;
+    const float fWeight = tap.fWeight;
+
+    if (t == 0)
+      for (int x = xBegin; x < xEnd; x++)
+	pOut[x] = fWeight * pIn[x];
+    else
+      for (int x = xBegin; x < xEnd; x++)
+	pOut[x] += fWeight * pIn[x];
+  }
+
+  // Border columns, or the whole row near the top and bottom
+  for (int x = x0; x < xBegin; x++)
+    pOut[x] = SparseBorderPixel(pInput, filter, nPitch, nWidth, nHeight, nBorderMode, fBorderValue, x, y);
+  for (int x = xEnd; x < x1; x++)
+    pOut[x] = SparseBorderPixel(pInput, filter, nPitch, nWidth, nHeight, nBorderMode, fBorderValue, x, y);
+}
+
+void ConvolveSparse(const float * pInput, const sparseFilter& filter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight,
+		    const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+#pragma omp parallel for num_threads(nNumThreads)
+  for (int y = 0; y < nHeight; y++)
+    ConvolveSparseRow(pInput, filter, pOutput, nPitch, nWidth, nHeight,
+		      nBorderMode, fBorderValue, y, 0, nWidth);
+}
+
+void ConvolveSparseTile(const float * pInput, const sparseFilter& filter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  for (int y = tile.y0; y < tile.y1; y++)
+    ConvolveSparseRow(pInput, filter, pOutput, nPitch, nWidth, nHeight,
+		      nBorderMode, fBorderValue, y, tile.x0, tile.x1);
+}
+
+// Weights are printed with enough digits to read back the same float
+std::string SparseKernelSource(const sparseFilter& filter, const char * pName)
+{
+  const int nTaps = (int) filter.taps.size();
+  std::ostringstream source;
+  char weight[32];
+
+  source << "\n__kernel void " << pName << "(const __global float * pInput,\n"
+	 << "\t\t__global float * pOutput,\n"
+	 << "\t\tconst int nPitch,\n"
+	 << "\t\tconst int nWidth,\n"
+	 << "\t\tconst int nHeight,\n"
+	 << "\t\tconst int nBorderMode,\n"
+	 << "\t\tconst float fBorderValue)\n"
+	 << "{\n"
+	 << "  const int xOut = get_global_id(0);\n"
+	 << "  const int yOut = get_global_id(1);\n"
+	 << "  float sum = 0;\n\n";
+
+  source << "  if (xOut + (" << filter.nMinDx << ") >= 0 && xOut + (" << filter.nMaxDx << ") < nWidth &&\n"
+	 << "      yOut + (" << filter.nMinDy << ") >= 0 && yOut + (" << filter.nMaxDy << ") < nHeight)\n"
+	 << "  {\n"
+	 << "    const __global float * p = pInput + yOut * nPitch + xOut;\n";
+  for (int t = 0; t < nTaps; t++)
+  {
+    snprintf(weight, sizeof(weight), "%.9ef", filter.taps[t].fWeight);
+    source << "    sum += " << weight << " * p[(" << filter.taps[t].dy << ") * nPitch + (" << filter.taps[t].dx << ")];\n";
+  }
+  source << "  }\n"
+	 << "  else\n"
+	 << "  {\n"
+	 << "    int idx;\n";
+  for (int t = 0; t < nTaps; t++)
+  {
+    snprintf(weight, sizeof(weight), "%.9ef", filter.taps[t].fWeight);
+    source << "    idx = input_index(xOut + (" << filter.taps[t].dx << "), yOut + (" << filter.taps[t].dy
+	   << "), nPitch, nWidth, nHeight, nBorderMode);\n"
+	   << "    sum += " << weight << " * (idx < 0 ? fBorderValue : pInput[idx]);\n";
+  }
+  source << "  }\n\n"
+	 << "  pOutput[yOut * nPitch + xOut] = sum;\n"
+	 << "}\n";
+
+  return source.str();
+}
@@ -0,0 +1,72 @@
+#ifndef __SPARSEFILTER_H__
+#define __SPARSEFILTER_H__
+
+#include "Border.hpp"
+
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Sparse filters
+//
+// Laplacian, cross-shaped and dilated (atrous) filters are mostly
+// zero taps. A sparseFilter is the compressed list of the non-zero
+// taps of a dense filter, as (dy, dx, weight) offsets from the anchor,
+// so the cost of a convolution follows the number of taps rather than
+// nFilterWidth^2.
+//
+// On the CPU every row of output is accumulated one tap at a time:
+// each tap is a unit-stride multiply-add of a shifted input row into
+// the output row, which vectorizes whatever the tap pattern. Outputs
+// whose taps are all inside the image are the interior; its bounds
+// come from the extent of the taps, not of the window, so a sparse
+// filter gets a larger interior than its dense equivalent.
+//
+// On the device the tap list is either read from constant memory
+// (convolve_sparse) or compiled into the kernel, one multiply-add per
+// tap with the weight and offsets as literals (SparseKernelSource()),
+// when the pattern is fixed for the whole run.
+//
+// Taps are summed in row-major order, as the direct engine does, so
+// results match ConvolveWithBorder() up to float rounding.
+/////////////////////////////////////////////////////////////////
+
+struct filterTap
+{
+  int dy;			// Tap row - anchor
+  int dx;			// Tap column - anchor
+  float fWeight;
+};
+
+struct sparseFilter
+{
+  int nFilterWidth;		// Width of the dense window
+  std::vector<filterTap> taps;	// Non-zero taps in row-major order
+
+  // Extent of the taps around the anchor, 0 when there are none
+  int nMinDy, nMaxDy;
+  int nMinDx, nMaxDx;
+};
+
+void InitSparseFilter(sparseFilter& filter, const float * pFilter, const int nFilterWidth);
+
+// True when skipping the zero taps pays: at most half of the window
+// is non-zero
+bool SparseFilterPays(const sparseFilter& filter);
+
+void ConvolveSparse(const float * pInput, const sparseFilter& filter, float * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight,
+		    const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// One output tile on the calling thread
+void ConvolveSparseTile(const float * pInput, const sparseFilter& filter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+// OpenCL source of a kernel pName(pInput, pOutput, nPitch, nWidth,
+// nHeight, nBorderMode, fBorderValue) with the taps of filter
+// unrolled. It uses the border helpers of convolution.cl and is built
+// appended to it.
+std::string SparseKernelSource(const sparseFilter& filter, const char * pName);
+
+#endif
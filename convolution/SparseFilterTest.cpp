@@ -0,0 +1,127 @@
+/////////////////////////////////////////////////////////////////
+// sparse_test: checks ConvolveSparse() and ConvolveSparseTile()
+// against a dense reference, on images and tiles narrower than the
+// extent of the taps. Every output pixel outside the image or the
+// tile starts as a sentinel and must keep it.
+/////////////////////////////////////////////////////////////////
+
+#include "SparseFilter.hpp"
+#include "Workload.hpp"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#define SENTINEL -999.0f
+#define TOLERANCE 1e-5f
+#define RUNS 50
+
+// Cross of width nFilterWidth: the anchor row and column only
+static void InitCross(std::vector<float>& filter, int nFilterWidth)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  filter.assign(nFilterWidth * nFilterWidth, 0.0f);
+  for (int i = 0; i < nFilterWidth; i++)
+  {
+    filter[nAnchor * nFilterWidth + i] = WorkloadUniform(1, WORKLOAD_STREAM_FILTER, i);
+    filter[i * nFilterWidth + nAnchor] = WorkloadUniform(1, WORKLOAD_STREAM_FILTER, nFilterWidth + i);
+  }
+}
+
+static float DensePixel(const float * pInput, const std::vector<float>& filter, int nFilterWidth,
+			int nPitch, int nWidth, int nHeight, int nBorderMode, float fBorderValue, int x, int y)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  float sum = 0;
+
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const int xIn = BorderIndex(x + c - nAnchor, nWidth, nBorderMode);
+      const int yIn = BorderIndex(y + r - nAnchor, nHeight, nBorderMode);
+      sum += filter[r * nFilterWidth + c] * ((xIn < 0 || yIn < 0) ? fBorderValue : pInput[yIn * nPitch + xIn]);
+    }
+  return sum;
+}
+
+// Pixels of tile must match the dense reference, every other pixel of
+// the nPitch x nHeight buffer must still be the sentinel
+static int CheckOutput(const float * pInput, const float * pOutput, const std::vector<float>& filter, int nFilterWidth,
+		       int nPitch, int nWidth, int nHeight, int nBorderMode, const imageRect& tile, const char * pCase)
+{
+  int nFailures = 0;
+
+  for (int y = 0; y < nHeight; y++)
+    for (int x = 0; x < nPitch; x++)
+    {
+      const bool bInside = x >= tile.x0 && x < tile.x1 && y >= tile.y0 && y < tile.y1;
+      const float fExpected = bInside ? DensePixel(pInput, filter, nFilterWidth, nPitch, nWidth, nHeight,
+						   nBorderMode, 0.5f, x, y) : SENTINEL;
+      const float fValue = pOutput[y * nPitch + x];
+
+      if (bInside ? !(fabsf(fValue - fExpected) <= TOLERANCE) : fValue != SENTINEL)
+      {
+	if (nFailures == 0)
+	  printf("%s, %s border: (%d, %d) = %g, expected %g\n",
+		 pCase, BorderModeName(nBorderMode), x, y, fValue, fExpected);
+	nFailures++;
+      }
+    }
+  return nFailures;
+}
+
+int main()
+{
+  int nChecks = 0, nFailures = 0;
+
+  // Narrow images, untiled: rows are split across threads, so a row
+  // writing past its end corrupts its neighbour's band
+  const int sizes[][3] = {{2, 200, 41}, {1, 64, 9}, {5, 37, 13}, {40, 3, 7}};
+  for (int s = 0; s < 4; s++)
+    for (int nBorderMode = 0; nBorderMode < BORDER_MODE_COUNT; nBorderMode++)
+    {
+      const int nWidth = sizes[s][0], nHeight = sizes[s][1], nFilterWidth = sizes[s][2];
+      const int nPitch = nWidth + 3;
+      std::vector<float> filter, input(nPitch * nHeight), output(nPitch * nHeight);
+      sparseFilter sparse;
+
+      InitCross(filter, nFilterWidth);
+      InitSparseFilter(sparse, &filter[0], nFilterWidth);
+      FillPattern(&input[0], nPitch, nWidth, nHeight, 1, PATTERN_UNIFORM, s, WORKLOAD_STREAM_INPUT, 1);
+
+      const imageRect image = {0, 0, nWidth, nHeight};
+      for (int run = 0; run < RUNS; run++)
+      {
+	output.assign(nPitch * nHeight, SENTINEL);
+	ConvolveSparse(&input[0], sparse, &output[0], nPitch, nWidth, nHeight, nBorderMode, 0.5f, 4);
+	nFailures += CheckOutput(&input[0], &output[0], filter, nFilterWidth, nPitch, nWidth, nHeight,
+				 nBorderMode, image, "narrow image") > 0;
+	nChecks++;
+      }
+    }
+
+  // Tiles narrower than the taps, at the edges and in the middle of a
+  // wider image
+  const imageRect tiles[] = {{0, 0, 4, 8}, {60, 8, 64, 16}, {30, 20, 31, 21}, {0, 0, 64, 1}, {10, 5, 13, 40}};
+  for (int t = 0; t < 5; t++)
+    for (int nBorderMode = 0; nBorderMode < BORDER_MODE_COUNT; nBorderMode++)
+    {
+      const int nWidth = 64, nHeight = 40, nPitch = 80, nFilterWidth = 41;
+      std::vector<float> filter, input(nPitch * nHeight), output(nPitch * nHeight, SENTINEL);
+      sparseFilter sparse;
+
+      InitCross(filter, nFilterWidth);
+      InitSparseFilter(sparse, &filter[0], nFilterWidth);
+      FillPattern(&input[0], nPitch, nWidth, nHeight, 1, PATTERN_UNIFORM, t, WORKLOAD_STREAM_INPUT, 1);
+
+      ConvolveSparseTile(&input[0], sparse, &output[0], nPitch, nWidth, nHeight, nBorderMode, 0.5f, tiles[t]);
+      nFailures += CheckOutput(&input[0], &output[0], filter, nFilterWidth, nPitch, nWidth, nHeight,
+			       nBorderMode, tiles[t], "narrow tile") > 0;
+      nChecks++;
+    }
+
+  printf("%d checks, %d failures\n", nChecks, nFailures);
+  return nFailures == 0 ? 0 : 1;
+}
@@ -18,6 +18,16 @@ void StatFile::add(int measure, double value)
   _ofs << measure << '\t' << value << std::endl;
 }
 
+void StatFile::add(int measure, int measure2, double value)
+{
+  _ofs << measure << '\t' << measure2 << '\t' << value << std::endl;
+}
+
+void StatFile::endBlock()
+{
+  _ofs << std::endl;
+}
+
 void StatFile::clearDirectory(const char* directory)
 {
   remove(directory);
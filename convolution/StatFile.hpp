@@ -15,6 +15,10 @@ class StatFile
   void close();
 
   void add(int measure, double value);
+  // Surface point; blocks of points sharing measure are separated by
+  // endBlock(), the layout of gnuplot splot
+  void add(int measure, int measure2, double value);
+  void endBlock();
 
   static void clearDirectory(const char* directory);
 };
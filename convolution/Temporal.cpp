@@ -0,0 +1,109 @@
+#include "Temporal.hpp"
+#include "Border.hpp"
+
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+void InitFrameWindow(frameWindow& window, int nFrames, int nPitch, int nHeight)
+{
+  window.nFrames = nFrames;
+  window.nPitch = nPitch;
+  window.nHeight = nHeight;
+  window.nPushed = 0;
+  window.pSlots = (float *) malloc((size_t) nFrames * nPitch * nHeight * sizeof(float));
+  if (!window.pSlots)
+    throw(std::string("InitFrameWindow()::Could not allocate memory"));
+}
+
+void ReleaseFrameWindow(frameWindow& window)
+{
+  free(window.pSlots);
+  window.pSlots = NULL;
+}
+
+void PushFrame(frameWindow& window, const float * pFrame, int nNumThreads)
+{
+  const size_t nFrameSize = (size_t) window.nPitch * window.nHeight;
+  float * pSlot = window.pSlots + (size_t) (window.nPushed % window.nFrames) * nFrameSize;
+
+#pragma omp parallel for num_threads(nNumThreads)
+  for (int y = 0; y < window.nHeight; y++)
+    memcpy(pSlot + (size_t) y * window.nPitch, pFrame + (size_t) y * window.nPitch, window.nPitch * sizeof(float));
+
+  window.nPushed++;
+}
+
+void WindowFrames(const frameWindow& window, const float ** ppFrames)
+{
+  const size_t nFrameSize = (size_t) window.nPitch * window.nHeight;
+
+  for (int j = 0; j < window.nFrames; j++)
+    ppFrames[j] = window.pSlots + TemporalSlot(window.nPushed - 1, window.nFrames, j) * nFrameSize;
+}
+
+static float TemporalBorderPixel(const float * const * ppFrames, int nFrames, const float * pFilter,
+				 const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+				 const int nBorderMode, const float fBorderValue, const int x, const int y)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  float sum = 0;
+
+  for (int j = 0; j < nFrames; j++)
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int yIn = BorderIndex(y + r - nAnchor, nHeight, nBorderMode);
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int xIn = BorderIndex(x + c - nAnchor, nWidth, nBorderMode);
+	const float fTap = pFilter[(j * nFilterWidth + r) * nFilterWidth + c];
+	sum += fTap * ((xIn < 0 || yIn < 0) ? fBorderValue : ppFrames[j][yIn * nPitch + xIn]);
+      }
+    }
+  return sum;
+}
+
+void ConvolveTemporal(const float * const * ppFrames, int nFrames, const float * pFilter, float * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		      const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nAfter = nFilterWidth - 1 - nAnchor;
+
+#pragma omp parallel for num_threads(nNumThreads)
+  for (int y = 0; y < nHeight; y++)
+  {
+    float * pOut = pOutput + y * nPitch;
+
+    // Columns whose taps are all inside the image
+    int xBegin = 0, xEnd = 0;
+    if (y >= nAnchor && y + nAfter < nHeight)
+    {
+      xBegin = std::min(nAnchor, nWidth);
+      xEnd = std::max(xBegin, nWidth - nAfter);
+    }
+
+    for (int x = xBegin; x < xEnd; x++)
+      pOut[x] = 0.0f;
+
+    for (int j = 0; j < nFrames; j++)
+      for (int r = 0; r < nFilterWidth; r++)
+	for (int c = 0; c < nFilterWidth; c++)
+	{
+	  const float fTap = pFilter[(j * nFilterWidth + r) * nFilterWidth + c];
+	  const float * pIn = ppFrames[j] + (y + r - nAnchor) * nPitch + c - nAnchor;
+
+	  for (int x = xBegin; x < xEnd; x++)
+	    pOut[x] += fTap * pIn[x];
+	}
+
+    for (int x = 0; x < xBegin; x++)
+      pOut[x] = TemporalBorderPixel(ppFrames, nFrames, pFilter, nPitch, nWidth, nHeight, nFilterWidth,
+				    nBorderMode, fBorderValue, x, y);
+    for (int x = xEnd; x < nWidth; x++)
+      pOut[x] = TemporalBorderPixel(ppFrames, nFrames, pFilter, nPitch, nWidth, nHeight, nFilterWidth,
+				    nBorderMode, fBorderValue, x, y);
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef __TEMPORAL_H__
+#define __TEMPORAL_H__
+
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////////
+// Spatio-temporal convolution
+//
+// A k x k x t filter over a stream of frames. Output frame n is the
+// sum over j of spatial slice j of the filter applied to frame
+// n - t + 1 + j: slice 0 weights the oldest frame of the window and
+// slice t - 1 the newest, so an output is ready as soon as its frame
+// arrives. Frames before the first one are the first one (clamped in
+// time); space uses the border modes of Border.hpp.
+//
+// A frameWindow keeps the last t frames in a ring of t slots. A new
+// frame is copied (on the device, uploaded) once, into the slot of
+// the frame leaving the window, and is then read in place by the
+// next t outputs. Nothing re-reads or re-assembles the t-frame volume
+// per output.
+//
+// On the CPU an output row is accumulated one tap at a time over the
+// t frames, each tap a unit-stride multiply-add of a shifted input
+// row into the output row, as the sparse engine does. Only the border
+// pixels pay for the remapping.
+/////////////////////////////////////////////////////////////////
+
+struct frameWindow
+{
+  int nFrames;			// t, frames of the window and slots of the ring
+  int nPitch;
+  int nHeight;
+  int nPushed;			// Frames pushed so far
+  float * pSlots;		// nFrames slots of nPitch * nHeight floats
+};
+
+// Ring slot of frame j of the window ending at frame nFrame, j = 0 the
+// oldest. Also the slot arithmetic of convolve_temporal.
+inline int TemporalSlot(int nFrame, int nFrames, int j)
+{
+  return std::max(nFrame - nFrames + 1 + j, 0) % nFrames;
+}
+
+void InitFrameWindow(frameWindow& window, int nFrames, int nPitch, int nHeight);
+void ReleaseFrameWindow(frameWindow& window);
+
+// Copies pFrame into the ring, replacing the oldest frame
+void PushFrame(frameWindow& window, const float * pFrame, int nNumThreads);
+
+// Frames of the window of the last pushed frame, oldest first
+void WindowFrames(const frameWindow& window, const float ** ppFrames);
+
+// ppFrames holds nFrames frames, oldest first, and pFilter nFrames
+// slices of nFilterWidth x nFilterWidth taps in the same order
+void ConvolveTemporal(const float * const * ppFrames, int nFrames, const float * pFilter, float * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		      const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+#endif
@@ -0,0 +1,324 @@
+#include "TileScheduler.hpp"
+
+#include <omp.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ADD(p, v) __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+
+// Polls of the generation counter before a worker goes to sleep
+#define SPIN_COUNT (1 << 16)
+
+const char * ScheduleName(int nSchedule)
+{
+  switch (nSchedule)
+  {
+  case SCHEDULE_ENGINE: return "engine";
+  case SCHEDULE_OMP_STATIC: return "static";
+  case SCHEDULE_OMP_DYNAMIC: return "dynamic";
+  case SCHEDULE_OMP_GUIDED: return "guided";
+  case SCHEDULE_POOL: return "pool";
+  }
+  return "unknown";
+}
+
+const char * TileOrderName(int nOrder)
+{
+  switch (nOrder)
+  {
+  case TILE_ORDER_ROW: return "row-major";
+  case TILE_ORDER_MORTON: return "morton";
+  }
+  return "unknown";
+}
+
+/////////////////////////////////////////////////////////////////
+// Tiles
+/////////////////////////////////////////////////////////////////
+
+// Bits of x in the even positions, y in the odd ones
+static uint32_t MortonCode(uint32_t x, uint32_t y)
+{
+  uint32_t code = 0;
+  for (int b = 0; b < 16; b++)
+    code |= ((x >> b) & 1) << (2 * b) | ((y >> b) & 1) << (2 * b + 1);
+  return code;
+}
+
+void BuildTiles(int nWidth, int nHeight, int nTileSize, int nOrder, std::vector<imageRect>& tiles)
+{
+  const int nTilesX = (nWidth + nTileSize - 1) / nTileSize;
+  const int nTilesY = (nHeight + nTileSize - 1) / nTileSize;
+
+  // Grid positions in traversal order. A grid that is not a power of
+  // two wide just skips the codes that fall outside it.
+  std::vector<std::pair<uint32_t, int> > order;
+  for (int ty = 0; ty < nTilesY; ty++)
+    for (int tx = 0; tx < nTilesX; tx++)
+    {
+      const uint32_t key = (nOrder == TILE_ORDER_MORTON) ? MortonCode(tx, ty) : ty * nTilesX + tx;
+      order.push_back(std::make_pair(key, ty * nTilesX + tx));
+    }
+  std::sort(order.begin(), order.end());
+
+  tiles.clear();
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const int tx = order[i].second % nTilesX;
+    const int ty = order[i].second / nTilesX;
+
+    imageRect tile;
+    tile.x0 = tx * nTileSize;
+    tile.y0 = ty * nTileSize;
+    tile.x1 = std::min(tile.x0 + nTileSize, nWidth);
+    tile.y1 = std::min(tile.y0 + nTileSize, nHeight);
+    tiles.push_back(tile);
+  }
+}
+
+/////////////////////////////////////////////////////////////////
+// Work-stealing pool
+/////////////////////////////////////////////////////////////////
+
+TilePool::TilePool(int nWorkers)
+  : nWorkers(nWorkers < 1 ? 1 : nWorkers),
+    pTiles(NULL), pFunction(NULL), pContext(NULL), nSteals(0),
+    nGeneration(0), nBusy(0), bStop(false)
+{
+  // Spinning only pays when every worker has a core of its own
+  bSpin = this->nWorkers <= sysconf(_SC_NPROCESSORS_ONLN);
+
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&workAvailable, NULL);
+  pthread_cond_init(&allDone, NULL);
+
+  queues.resize(this->nWorkers);
+  for (int i = 0; i < this->nWorkers; i++)
+  {
+    pthread_mutex_init(&queues[i].mutex, NULL);
+    queues[i].nBegin = queues[i].nEnd = 0;
+  }
+
+  for (int i = 1; i < this->nWorkers; i++)
+  {
+    workerInfo * pWorker = new workerInfo;
+    pWorker->pPool = this;
+    pWorker->nIndex = i;
+
+    if (pthread_create(&pWorker->thread, NULL, WorkerMain, pWorker) != 0)
+    {
+      delete pWorker;
+      break;
+    }
+    workers.push_back(pWorker);
+  }
+
+  // Fewer threads than asked for still make a working pool
+  this->nWorkers = (int) workers.size() + 1;
+}
+
+TilePool::~TilePool()
+{
+  pthread_mutex_lock(&mutex);
+  bStop = true;
+  ADD(&nGeneration, 1);
+  pthread_cond_broadcast(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    pthread_join(workers[i]->thread, NULL);
+    delete workers[i];
+  }
+
+  for (size_t i = 0; i < queues.size(); i++)
+    pthread_mutex_destroy(&queues[i].mutex);
+  pthread_cond_destroy(&allDone);
+  pthread_cond_destroy(&workAvailable);
+  pthread_mutex_destroy(&mutex);
+}
+
+void TilePool::Run(const std::vector<imageRect>& tiles, tileFunction pFunction, void * pContext)
+{
+  const int nTiles = (int) tiles.size();
+
+  this->pTiles = &tiles;
+  this->pFunction = pFunction;
+  this->pContext = pContext;
+  nSteals = 0;
+  error.clear();
+
+  // Contiguous runs of the list, so each worker starts on a compact
+  // block of the image
+  for (int i = 0; i < nWorkers; i++)
+  {
+    queues[i].nBegin = (int)((long long)nTiles * i / nWorkers);
+    queues[i].nEnd = (int)((long long)nTiles * (i+1) / nWorkers);
+  }
+
+  pthread_mutex_lock(&mutex);
+  nBusy = nWorkers - 1;
+  ADD(&nGeneration, 1);
+  pthread_cond_broadcast(&workAvailable);
+  pthread_mutex_unlock(&mutex);
+
+  Work(0);
+
+  if (bSpin)
+    for (int i = 0; i < SPIN_COUNT && LOAD(&nBusy) > 0; i++)
+      ;
+
+  pthread_mutex_lock(&mutex);
+  while (nBusy > 0)
+    pthread_cond_wait(&allDone, &mutex);
+  pthread_mutex_unlock(&mutex);
+
+  if (!error.empty())
+    throw(error);
+}
+
+int TilePool::Pop(int nWorker)
+{
+  workerQueue& queue = queues[nWorker];
+  int nTile = -1;
+
+  pthread_mutex_lock(&queue.mutex);
+  if (queue.nBegin < queue.nEnd)
+    nTile = queue.nBegin++;
+  pthread_mutex_unlock(&queue.mutex);
+
+  return nTile;
+}
+
+// Takes the back half of the first non-empty queue after our own:
+// runs the first tile of it now and queues the rest for Pop()
+int TilePool::Steal(int nWorker)
+{
+  for (int k = 1; k < nWorkers; k++)
+  {
+    workerQueue& victim = queues[(nWorker + k) % nWorkers];
+
+    pthread_mutex_lock(&victim.mutex);
+    const int nLeft = victim.nEnd - victim.nBegin;
+    if (nLeft <= 0)
+    {
+      pthread_mutex_unlock(&victim.mutex);
+      continue;
+    }
+    const int nBegin = victim.nEnd - (nLeft + 1) / 2;
+    const int nEnd = victim.nEnd;
+    victim.nEnd = nBegin;
+    pthread_mutex_unlock(&victim.mutex);
+
+    workerQueue& own = queues[nWorker];
+    pthread_mutex_lock(&own.mutex);
+    own.nBegin = nBegin + 1;
+    own.nEnd = nEnd;
+    pthread_mutex_unlock(&own.mutex);
+
+    ADD(&nSteals, 1);
+    return nBegin;
+  }
+
+  return -1;
+}
+
+void TilePool::Work(int nWorker)
+{
+  for (;;)
+  {
+    int nTile = Pop(nWorker);
+    if (nTile < 0)
+      nTile = Steal(nWorker);
+    if (nTile < 0)
+      break;
+
+    // A failed tile leaves its output untouched, the others still run
+    try
+    {
+      pFunction((*pTiles)[nTile], pContext);
+    }
+    catch (std::string msg)
+    {
+      pthread_mutex_lock(&mutex);
+      if (error.empty())
+	error = msg;
+      pthread_mutex_unlock(&mutex);
+    }
+  }
+}
+
+void * TilePool::WorkerMain(void * pArg)
+{
+  workerInfo * pWorker = (workerInfo *) pArg;
+  TilePool * pPool = pWorker->pPool;
+  unsigned int nSeen = 0;
+
+  for (;;)
+  {
+    if (pPool->bSpin)
+      for (int i = 0; i < SPIN_COUNT && LOAD(&pPool->nGeneration) == nSeen; i++)
+	;
+
+    pthread_mutex_lock(&pPool->mutex);
+    while (pPool->nGeneration == nSeen)
+      pthread_cond_wait(&pPool->workAvailable, &pPool->mutex);
+    nSeen = pPool->nGeneration;
+    const bool bStop = pPool->bStop;
+    pthread_mutex_unlock(&pPool->mutex);
+
+    if (bStop)
+      break;
+
+    pPool->Work(pWorker->nIndex);
+
+    pthread_mutex_lock(&pPool->mutex);
+    if (--pPool->nBusy == 0)
+      pthread_cond_broadcast(&pPool->allDone);
+    pthread_mutex_unlock(&pPool->mutex);
+  }
+
+  return NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+// Schedules
+/////////////////////////////////////////////////////////////////
+
+void RunTiles(int nSchedule, const std::vector<imageRect>& tiles,
+	      tileFunction pFunction, void * pContext,
+	      int nNumThreads, TilePool * pPool)
+{
+  const int nTiles = (int) tiles.size();
+
+  switch (nSchedule)
+  {
+  case SCHEDULE_OMP_STATIC:
+#pragma omp parallel for schedule(static) num_threads(nNumThreads)
+    for (int i = 0; i < nTiles; i++)
+      pFunction(tiles[i], pContext);
+    break;
+  case SCHEDULE_OMP_DYNAMIC:
+#pragma omp parallel for schedule(dynamic) num_threads(nNumThreads)
+    for (int i = 0; i < nTiles; i++)
+      pFunction(tiles[i], pContext);
+    break;
+  case SCHEDULE_OMP_GUIDED:
+#pragma omp parallel for schedule(guided) num_threads(nNumThreads)
+    for (int i = 0; i < nTiles; i++)
+      pFunction(tiles[i], pContext);
+    break;
+  case SCHEDULE_POOL:
+    if (!pPool)
+      throw(std::string("RunTiles()::No tile pool"));
+    pPool->Run(tiles, pFunction, pContext);
+    break;
+  default:
+    throw(std::string("RunTiles()::Not a tiled schedule"));
+  }
+}
@@ -0,0 +1,127 @@
+#ifndef __TILESCHEDULER_H__
+#define __TILESCHEDULER_H__
+
+#include "Border.hpp"
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Tile scheduling of the CPU engines
+//
+// By default an engine splits its own loops across an OpenMP team on
+// every call, one static band of rows per thread (SCHEDULE_ENGINE).
+// The other schedules cut the output into 2D tiles, which every
+// engine can convolve on its own (the Tile variants of the engine
+// functions), and differ only in who runs which tile:
+//
+// SCHEDULE_OMP_*  one OpenMP parallel for over the tile list, with
+//                 the static, dynamic or guided schedule
+// SCHEDULE_POOL   a TilePool: persistent workers, no fork per call,
+//                 each worker starts on its own contiguous run of the
+//                 list and steals half of a busy worker's remaining
+//                 run once its own is done
+//
+// The tile list order sets which tiles a worker visits back to back.
+// In Morton (Z) order consecutive tiles are 2D neighbours, so the
+// input rows under the filter margin of a tile are still in cache for
+// the next one, and a contiguous run of the list is a compact block
+// of the image rather than a thin band.
+/////////////////////////////////////////////////////////////////
+
+enum cpuSchedule
+{
+  SCHEDULE_ENGINE = 0,		// Engine's own OpenMP row bands
+  SCHEDULE_OMP_STATIC,
+  SCHEDULE_OMP_DYNAMIC,
+  SCHEDULE_OMP_GUIDED,
+  SCHEDULE_POOL,
+  SCHEDULE_COUNT
+};
+
+enum tileOrder
+{
+  TILE_ORDER_ROW = 0,		// Row-major
+  TILE_ORDER_MORTON,		// Z-order curve
+  TILE_ORDER_COUNT
+};
+
+const char * ScheduleName(int nSchedule);
+const char * TileOrderName(int nOrder);
+
+// Tiles of at most nTileSize x nTileSize covering nWidth x nHeight
+void BuildTiles(int nWidth, int nHeight, int nTileSize, int nOrder, std::vector<imageRect>& tiles);
+
+typedef void (*tileFunction)(const imageRect& tile, void * pContext);
+
+class TilePool
+{
+public:
+
+  // nWorkers - 1 threads, the thread calling Run() is worker 0
+  TilePool(int nWorkers);
+  ~TilePool();
+
+  // Runs pFunction on every tile and returns when all are done. The
+  // first std::string thrown by a tile is rethrown here, after the
+  // remaining tiles have run.
+  void Run(const std::vector<imageRect>& tiles, tileFunction pFunction, void * pContext);
+
+  int Workers() const { return nWorkers; }
+  // Tile runs taken from another worker during the last Run()
+  int Steals() const { return nSteals; }
+
+private:
+
+  // Tiles [nBegin, nEnd) of the list still to run. The owner takes
+  // from the front, thieves from the back.
+  struct workerQueue
+  {
+    pthread_mutex_t mutex;
+    int nBegin;
+    int nEnd;
+    char padding[64];		// Keep queues on separate cache lines
+  };
+
+  struct workerInfo
+  {
+    TilePool * pPool;
+    int nIndex;
+    pthread_t thread;
+  };
+
+  static void * WorkerMain(void * pArg);
+  void Work(int nWorker);
+  int Pop(int nWorker);
+  int Steal(int nWorker);
+
+  int nWorkers;
+  bool bSpin;			// Wait for the next Run() spinning, not sleeping
+  std::vector<workerQueue> queues;
+  std::vector<workerInfo *> workers;
+
+  // Current Run()
+  const std::vector<imageRect> * pTiles;
+  tileFunction pFunction;
+  void * pContext;
+  int nSteals;
+  std::string error;
+
+  unsigned int nGeneration;	// Incremented by every Run()
+  int nBusy;			// Threads still in the current Run()
+  bool bStop;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t workAvailable;
+  pthread_cond_t allDone;
+};
+
+// Runs pFunction on every tile with one of the tiled schedules,
+// nNumThreads wide. SCHEDULE_POOL needs pPool.
+void RunTiles(int nSchedule, const std::vector<imageRect>& tiles,
+	      tileFunction pFunction, void * pContext,
+	      int nNumThreads, TilePool * pPool);
+
+#endif
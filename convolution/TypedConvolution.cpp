@@ -0,0 +1,363 @@
+#include "TypedConvolution.hpp"
+#include "Border.hpp"
+
+#include <omp.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__F16C__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+const char * DataTypeName(int type)
+{
+  switch (type)
+  {
+  case DATA_FLOAT: return "float";
+  case DATA_U8: return "u8";
+  case DATA_U16: return "u16";
+  case DATA_HALF: return "half";
+  }
+  return "unknown";
+}
+size_t DataTypeSize(int type)
+{
+  switch (type)
+  {
+  case DATA_FLOAT: return sizeof(float);
+  case DATA_U8: return sizeof(uint8_t);
+  case DATA_U16: return sizeof(uint16_t);
+  case DATA_HALF: return sizeof(half_t);
+  }
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////
+// fp16 conversions
+/////////////////////////////////////////////////////////////////
+
+float HalfToFloat(half_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp  = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t bits;
+
+  if (exp == 0x1f)		// Inf / NaN
+    bits = sign | 0x7f800000 | (mant << 13);
+  else if (exp != 0)		// Normal
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  else if (mant == 0)		// Zero
+    bits = sign;
+  else				// Subnormal: renormalize
+  {
+    exp = 113;
+    while (!(mant & 0x400))
+    {
+      mant <<= 1;
+      exp--;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+  }
+
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+half_t FloatToHalf(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exp   = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff)	// Inf / NaN
+    return (half_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+  if (exp >= 0x1f)			// Overflow
+    return (half_t)(sign | 0x7c00);
+
+  if (exp <= 0)				// Subnormal or zero
+  {
+    if (exp < -10)
+      return (half_t)sign;
+    mant |= 0x800000;
+    uint32_t shift = 14 - exp;
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t mid = 1u << (shift - 1);
+    if (rem > mid || (rem == mid && (half & 1)))
+      half++;
+    return (half_t)(sign | half);
+  }
+
+  // Round to nearest even; a mantissa carry correctly bumps the exponent
+  uint32_t half = ((uint32_t)exp << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+    half++;
+  return (half_t)(sign | half);
+}
+
+void HalfToFloatArray(const half_t * pSrc, float * pDst, int n)
+{
+  int i = 0;
+#if defined(__AVX512F__)
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(pDst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(pSrc + i))));
+#endif
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(pDst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(pSrc + i))));
+#endif
+  for (; i < n; i++)
+    pDst[i] = HalfToFloat(pSrc[i]);
+}
+void FloatToHalfArray(const float * pSrc, half_t * pDst, int n)
+{
+  int i = 0;
+#if defined(__AVX512F__)
+  for (; i + 16 <= n; i += 16)
+    _mm256_storeu_si256((__m256i *)(pDst + i),
+			_mm512_cvtps_ph(_mm512_loadu_ps(pSrc + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128((__m128i *)(pDst + i),
+		     _mm256_cvtps_ph(_mm256_loadu_ps(pSrc + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+  for (; i < n; i++)
+    pDst[i] = FloatToHalf(pSrc[i]);
+}
+
+/////////////////////////////////////////////////////////////////
+// Filter quantization
+/////////////////////////////////////////////////////////////////
+
+void QuantizeFilter(const float * pFilter, int32_t * pFilterFixed,
+		    const int nFilterWidth, const int type)
+{
+  const int nFilterSize = nFilterWidth * nFilterWidth;
+  const double dScale = double(1 << FILTER_FRAC_BITS);
+
+  int64_t nAbsSum = 0;
+  for (int i = 0; i < nFilterSize; i++)
+  {
+    pFilterFixed[i] = (int32_t)lrint(pFilter[i] * dScale);
+    nAbsSum += pFilterFixed[i] < 0 ? -pFilterFixed[i] : pFilterFixed[i];
+  }
+
+  const int64_t nMaxInput = (type == DATA_U8) ? 0xff : 0xffff;
+  if (nAbsSum * nMaxInput + (1 << (FILTER_FRAC_BITS-1)) > INT32_MAX)
+    throw(std::string("QuantizeFilter()::Filter would overflow the int32 accumulator"));
+}
+
+/////////////////////////////////////////////////////////////////
+// Typed convolution on CPU
+/////////////////////////////////////////////////////////////////
+
+struct u8Ops
+{
+  typedef uint8_t storage;
+  typedef int32_t acc;
+
+  static int32_t load(uint8_t v) { return v; }
+  static void widen(const uint8_t * pSrc, int32_t * pDst, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDst[i] = pSrc[i];
+  }
+  static uint8_t narrow(int32_t sum)
+  {
+    sum = (sum + (1 << (FILTER_FRAC_BITS-1))) >> FILTER_FRAC_BITS;
+    return (uint8_t)(sum < 0 ? 0 : (sum > 0xff ? 0xff : sum));
+  }
+};
+
+struct u16Ops
+{
+  typedef uint16_t storage;
+  typedef int32_t acc;
+
+  static int32_t load(uint16_t v) { return v; }
+  static void widen(const uint16_t * pSrc, int32_t * pDst, int n)
+  {
+    for (int i = 0; i < n; i++)
+      pDst[i] = pSrc[i];
+  }
+  static uint16_t narrow(int32_t sum)
+  {
+    sum = (sum + (1 << (FILTER_FRAC_BITS-1))) >> FILTER_FRAC_BITS;
+    return (uint16_t)(sum < 0 ? 0 : (sum > 0xffff ? 0xffff : sum));
+  }
+};
+
+struct halfOps
+{
+  typedef half_t storage;
+  typedef float acc;
+
+  static float load(half_t v) { return HalfToFloat(v); }
+  static void widen(const half_t * pSrc, float * pDst, int n)
+  {
+    HalfToFloatArray(pSrc, pDst, n);
+  }
+  static half_t narrow(float sum)
+  {
+    return FloatToHalf(sum);
+  }
+};
+
+// Valid convolution of an nWidth x nHeight region: reads nWidth +
+// nFilterWidth - 1 columns and rows of pInput
+template <class Ops>
+static void ConvolveRing(const typename Ops::storage * pInput,
+			 const typename Ops::acc * pFilter,
+			 typename Ops::storage * pOutput,
+			 const int nPitch, const int nWidth, const int nHeight,
+			 const int nFilterWidth, const int nNumThreads)
+{
+  typedef typename Ops::acc acc;
+
+  const int nInWidth = nWidth + nFilterWidth - 1;
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    // Contiguous row block per thread so that each input row is widened
+    // once and then reused by nFilterWidth output rows.
+    const int nThreads = omp_get_num_threads();
+    const int tid = omp_get_thread_num();
+    const int yBegin = (int)((long long)nHeight * tid / nThreads);
+    const int yEnd = (int)((long long)nHeight * (tid+1) / nThreads);
+
+    std::vector<acc> ring(nFilterWidth * nInWidth);
+    std::vector<acc> rowOut(nWidth);
+
+    for (int r = 0; r < nFilterWidth-1 && yBegin < yEnd; r++)
+      Ops::widen(pInput + (yBegin + r) * nPitch, &ring[((yBegin + r) % nFilterWidth) * nInWidth], nInWidth);
+
+    for (int yOut = yBegin; yOut < yEnd; yOut++)
+    {
+      const int yLast = yOut + nFilterWidth - 1;
+      Ops::widen(pInput + yLast * nPitch, &ring[(yLast % nFilterWidth) * nInWidth], nInWidth);
+
+      for (int xOut = 0; xOut < nWidth; xOut++)
+	rowOut[xOut] = 0;
+
+      for (int r = 0; r < nFilterWidth; r++)
+      {
+	const acc * pRow = &ring[((yOut + r) % nFilterWidth) * nInWidth];
+	const acc * pF = pFilter + r * nFilterWidth;
+
+	for (int c = 0; c < nFilterWidth; c++)
+	{
+	  const acc f = pF[c];
+	  const acc * pIn = pRow + c;
+	  for (int xOut = 0; xOut < nWidth; xOut++)
+	    rowOut[xOut] += f * pIn[xOut];
+	}
+      }
+
+      typename Ops::storage * pOut = pOutput + yOut * nPitch;
+      for (int xOut = 0; xOut < nWidth; xOut++)
+	pOut[xOut] = Ops::narrow(rowOut[xOut]);
+    }
+  }
+}
+
+template <class Ops>
+static void ConvolveTyped(const typename Ops::storage * pInput,
+			  const typename Ops::acc * pFilter,
+			  typename Ops::storage * pOutput,
+			  const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+			  const int nBorderMode, const typename Ops::acc borderValue, const int nNumThreads)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nInteriorWidth = nWidth - nFilterWidth + 1;
+  const int nInteriorHeight = nHeight - nFilterWidth + 1;
+
+  if (nInteriorWidth > 0 && nInteriorHeight > 0)
+    ConvolveRing<Ops>(pInput, pFilter, pOutput + nAnchor * nPitch + nAnchor,
+		      nPitch, nInteriorWidth, nInteriorHeight, nFilterWidth, nNumThreads);
+
+  ConvolveBorderT<Ops>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+		       nFilterWidth, nBorderMode, borderValue, nNumThreads);
+}
+
+template <class Ops>
+static void ConvolveTypedTile(const typename Ops::storage * pInput,
+			      const typename Ops::acc * pFilter,
+			      typename Ops::storage * pOutput,
+			      const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+			      const int nBorderMode, const typename Ops::acc borderValue,
+			      const imageRect& tile)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const imageRect interior = TileInterior(tile, nWidth, nHeight, nFilterWidth);
+
+  if (!RectEmpty(interior))
+    ConvolveRing<Ops>(pInput + (interior.y0 - nAnchor) * nPitch + interior.x0 - nAnchor, pFilter,
+		      pOutput + interior.y0 * nPitch + interior.x0,
+		      nPitch, interior.x1 - interior.x0, interior.y1 - interior.y0, nFilterWidth, 1);
+
+  ConvolveBorderTileT<Ops>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+			   nFilterWidth, nBorderMode, borderValue, tile);
+}
+
+// Integer border values are rounded and saturated like the outputs
+static int32_t ClampBorderValue(float fBorderValue, int32_t nMax)
+{
+  int32_t v = (int32_t) lrintf(fBorderValue);
+  return v < 0 ? 0 : (v > nMax ? nMax : v);
+}
+
+void ConvolveU8(const uint8_t * pInput, const int32_t * pFilterFixed, uint8_t * pOutput,
+		const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  ConvolveTyped<u8Ops>(pInput, pFilterFixed, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+		       nBorderMode, ClampBorderValue(fBorderValue, 0xff), nNumThreads);
+}
+
+void ConvolveU16(const uint16_t * pInput, const int32_t * pFilterFixed, uint16_t * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		 const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  ConvolveTyped<u16Ops>(pInput, pFilterFixed, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+			nBorderMode, ClampBorderValue(fBorderValue, 0xffff), nNumThreads);
+}
+
+void ConvolveHalf(const half_t * pInput, const float * pFilter, half_t * pOutput,
+		  const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		  const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  ConvolveTyped<halfOps>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+			 nBorderMode, halfOps::load(FloatToHalf(fBorderValue)), nNumThreads);
+}
+
+void ConvolveU8Tile(const uint8_t * pInput, const int32_t * pFilterFixed, uint8_t * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		    const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  ConvolveTypedTile<u8Ops>(pInput, pFilterFixed, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+			   nBorderMode, ClampBorderValue(fBorderValue, 0xff), tile);
+}
+
+void ConvolveU16Tile(const uint16_t * pInput, const int32_t * pFilterFixed, uint16_t * pOutput,
+		     const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		     const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  ConvolveTypedTile<u16Ops>(pInput, pFilterFixed, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+			    nBorderMode, ClampBorderValue(fBorderValue, 0xffff), tile);
+}
+
+void ConvolveHalfTile(const half_t * pInput, const float * pFilter, half_t * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		      const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  ConvolveTypedTile<halfOps>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nFilterWidth,
+			     nBorderMode, halfOps::load(FloatToHalf(fBorderValue)), tile);
+}
@@ -0,0 +1,95 @@
+#ifndef __TYPEDCONVOLUTION_H__
+#define __TYPEDCONVOLUTION_H__
+
+#include "Border.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/////////////////////////////////////////////////////////////////
+// Storage types
+//
+// DATA_FLOAT  fp32 storage, fp32 accumulation (reference path).
+// DATA_U8     8-bit unsigned storage, int32 accumulation.
+// DATA_U16    16-bit unsigned storage, int32 accumulation.
+// DATA_HALF   IEEE fp16 storage, fp32 accumulation.
+//
+// Integer modes use a fixed-point filter with FILTER_FRAC_BITS
+// fractional bits. Each output is (acc + 2^(FILTER_FRAC_BITS-1))
+// >> FILTER_FRAC_BITS (round half up) saturated to [0, 2^bits-1].
+// QuantizeFilter() refuses filters for which the int32 accumulator
+// could overflow on a full-scale input.
+//
+// The fp16 mode rounds the fp32 sum to the nearest even half, so
+// results above 65504 become +inf as in IEEE 754.
+/////////////////////////////////////////////////////////////////
+
+enum dataType
+{
+  DATA_FLOAT = 0,
+  DATA_U8,
+  DATA_U16,
+  DATA_HALF,
+  DATA_TYPE_COUNT
+};
+
+#define FILTER_FRAC_BITS 14
+
+typedef uint16_t half_t;
+
+const char * DataTypeName(int type);
+size_t DataTypeSize(int type);
+
+/////////////////////////////////////////////////////////////////
+// fp16 conversions (F16C / AVX-512 when compiled in)
+/////////////////////////////////////////////////////////////////
+
+float HalfToFloat(half_t h);
+half_t FloatToHalf(float f);
+
+void HalfToFloatArray(const half_t * pSrc, float * pDst, int n);
+void FloatToHalfArray(const float * pSrc, half_t * pDst, int n);
+
+/////////////////////////////////////////////////////////////////
+// Filter quantization
+/////////////////////////////////////////////////////////////////
+
+void QuantizeFilter(const float * pFilter, int32_t * pFilterFixed,
+		    const int nFilterWidth, const int type);
+
+/////////////////////////////////////////////////////////////////
+// Typed convolution on CPU
+//
+// Same geometry as the float path, see Border.hpp. In the interior
+// every input row is widened once per thread into a ring of
+// nFilterWidth accumulator-typed rows, so the narrow data is only
+// read once from memory. The constant border value is given in
+// storage units.
+/////////////////////////////////////////////////////////////////
+
+void ConvolveU8(const uint8_t * pInput, const int32_t * pFilterFixed, uint8_t * pOutput,
+		const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+void ConvolveU16(const uint16_t * pInput, const int32_t * pFilterFixed, uint16_t * pOutput,
+		 const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		 const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+void ConvolveHalf(const half_t * pInput, const float * pFilter, half_t * pOutput,
+		  const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		  const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// One output tile on the calling thread
+void ConvolveU8Tile(const uint8_t * pInput, const int32_t * pFilterFixed, uint8_t * pOutput,
+		    const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		    const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+void ConvolveU16Tile(const uint16_t * pInput, const int32_t * pFilterFixed, uint16_t * pOutput,
+		     const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		     const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+void ConvolveHalfTile(const half_t * pInput, const float * pFilter, half_t * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight, const int nFilterWidth,
+		      const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+#endif
@@ -0,0 +1,427 @@
+#include "Winograd.hpp"
+#include "Border.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////
+// Transform matrices
+/////////////////////////////////////////////////////////////////
+
+template <int m, int r>
+struct winograd
+{
+  enum { alpha = m + r - 1 };
+
+  static const float BT[alpha][alpha];
+  static const float AT[m][alpha];
+  static const float G[alpha][r];
+};
+
+// Points 0, 1, -1, infinity
+template <> const float winograd<2, 3>::BT[4][4] = {
+  {1,  0, -1, 0},
+  {0,  1,  1, 0},
+  {0, -1,  1, 0},
+  {0, -1,  0, 1}
+};
+template <> const float winograd<2, 3>::AT[2][4] = {
+  {1, 1,  1, 0},
+  {0, 1, -1, 1}
+};
+template <> const float winograd<2, 3>::G[4][3] = {
+  {1.0f,  0.0f, 0.0f},
+  {0.5f,  0.5f, 0.5f},
+  {0.5f, -0.5f, 0.5f},
+  {0.0f,  0.0f, 1.0f}
+};
+
+// Points 0, 1, -1, 2, -2, infinity, shared by both alpha = 6 variants
+#define WINOGRAD_BT6 {				\
+    {4,  0, -5,  0,  1, 0},			\
+    {0,  4,  4, -1, -1, 0},			\
+    {0, -4,  4,  1, -1, 0},			\
+    {0, -2, -1,  2,  1, 0},			\
+    {0,  2, -1, -2,  1, 0},			\
+    {0,  4,  0, -5,  0, 1}			\
+  }
+
+template <> const float winograd<4, 3>::BT[6][6] = WINOGRAD_BT6;
+template <> const float winograd<4, 3>::AT[4][6] = {
+  {1, 1,  1, 1,  1, 0},
+  {0, 1, -1, 2, -2, 0},
+  {0, 1,  1, 4,  4, 0},
+  {0, 1, -1, 8, -8, 1}
+};
+template <> const float winograd<4, 3>::G[6][3] = {
+  {1.0f / 4,   0.0f,       0.0f},
+  {1.0f / 6,   1.0f / 6,   1.0f / 6},
+  {1.0f / 6,  -1.0f / 6,   1.0f / 6},
+  {1.0f / 24,  1.0f / 12,  1.0f / 6},
+  {1.0f / 24, -1.0f / 12,  1.0f / 6},
+  {0.0f,       0.0f,       1.0f}
+};
+
+template <> const float winograd<2, 5>::BT[6][6] = WINOGRAD_BT6;
+template <> const float winograd<2, 5>::AT[2][6] = {
+  {1, 1,  1, 1,  1, 0},
+  {0, 1, -1, 2, -2, 1}
+};
+template <> const float winograd<2, 5>::G[6][5] = {
+  {1.0f / 4,   0.0f,       0.0f,      0.0f,      0.0f},
+  {1.0f / 6,   1.0f / 6,   1.0f / 6,  1.0f / 6,  1.0f / 6},
+  {1.0f / 6,  -1.0f / 6,   1.0f / 6, -1.0f / 6,  1.0f / 6},
+  {1.0f / 24,  1.0f / 12,  1.0f / 6,  1.0f / 3,  2.0f / 3},
+  {1.0f / 24, -1.0f / 12,  1.0f / 6, -1.0f / 3,  2.0f / 3},
+  {0.0f,       0.0f,       0.0f,      0.0f,      1.0f}
+};
+
+bool WinogradSupported(int nFilterWidth, int nOutputTile)
+{
+  return (nFilterWidth == 3 && (nOutputTile == 2 || nOutputTile == 4)) ||
+    (nFilterWidth == 5 && nOutputTile == 2);
+}
+
+int WinogradMatrices(int nFilterWidth, int nOutputTile, const float ** ppBT, const float ** ppAT)
+{
+  if (nFilterWidth == 3 && nOutputTile == 2)
+  {
+    *ppBT = &winograd<2, 3>::BT[0][0];
+    *ppAT = &winograd<2, 3>::AT[0][0];
+    return winograd<2, 3>::alpha;
+  }
+  if (nFilterWidth == 3 && nOutputTile == 4)
+  {
+    *ppBT = &winograd<4, 3>::BT[0][0];
+    *ppAT = &winograd<4, 3>::AT[0][0];
+    return winograd<4, 3>::alpha;
+  }
+  *ppBT = &winograd<2, 5>::BT[0][0];
+  *ppAT = &winograd<2, 5>::AT[0][0];
+  return winograd<2, 5>::alpha;
+}
+
+template <int m, int r>
+static void FilterTransform(const float * pFilter, float * pU)
+{
+  typedef winograd<m, r> w;
+  const int alpha = w::alpha;
+
+  // G g, then (G g) GT, in double
+  double Gg[alpha][r];
+  for (int i = 0; i < alpha; i++)
+    for (int c = 0; c < r; c++)
+    {
+      Gg[i][c] = 0;
+      for (int k = 0; k < r; k++)
+	Gg[i][c] += (double) w::G[i][k] * pFilter[k * r + c];
+    }
+
+  for (int i = 0; i < alpha; i++)
+    for (int j = 0; j < alpha; j++)
+    {
+      double u = 0;
+      for (int c = 0; c < r; c++)
+	u += Gg[i][c] * w::G[j][c];
+      pU[i * alpha + j] = (float) u;
+    }
+}
+
+void WinogradFilterTransform(const float * pFilter, int nFilterWidth, int nOutputTile, float * pU)
+{
+  if (nFilterWidth == 3 && nOutputTile == 2)
+    FilterTransform<2, 3>(pFilter, pU);
+  else if (nFilterWidth == 3 && nOutputTile == 4)
+    FilterTransform<4, 3>(pFilter, pU);
+  else
+    FilterTransform<2, 5>(pFilter, pU);
+}
+
+/////////////////////////////////////////////////////////////////
+// CPU engine
+/////////////////////////////////////////////////////////////////
+
+// The 1D transforms of the matrices above, written out so that each
+// is a handful of adds over n-long unit-stride rows. s and d are
+// arrays of row pointers.
+
+template <int alpha>
+static void InputTransform(const float * const * s, float * const * d, const int n);
+
+template <>
+void InputTransform<4>(const float * const * s, float * const * d, const int n)
+{
+  const float * s0 = s[0], * s1 = s[1], * s2 = s[2], * s3 = s[3];
+  float * d0 = d[0], * d1 = d[1], * d2 = d[2], * d3 = d[3];
+
+  for (int t = 0; t < n; t++)
+  {
+    d0[t] = s0[t] - s2[t];
+    d1[t] = s1[t] + s2[t];
+    d2[t] = s2[t] - s1[t];
+    d3[t] = s3[t] - s1[t];
+  }
+}
+
+template <>
+void InputTransform<6>(const float * const * s, float * const * d, const int n)
+{
+  const float * s0 = s[0], * s1 = s[1], * s2 = s[2], * s3 = s[3], * s4 = s[4], * s5 = s[5];
+  float * d0 = d[0], * d1 = d[1], * d2 = d[2], * d3 = d[3], * d4 = d[4], * d5 = d[5];
+
+  for (int t = 0; t < n; t++)
+  {
+    const float a = s4[t] - s2[t];
+    const float b = s3[t] - s1[t];
+    d0[t] = 4 * s0[t] - 5 * s2[t] + s4[t];
+    d1[t] = 4 * (s1[t] + s2[t]) - (s3[t] + s4[t]);
+    d2[t] = 4 * (s2[t] - s1[t]) + (s3[t] - s4[t]);
+    d3[t] = 2 * b + a;
+    d4[t] = a - 2 * b;
+    d5[t] = 4 * s1[t] - 5 * s3[t] + s5[t];
+  }
+}
+
+template <int m, int alpha>
+static void OutputTransform(const float * const * s, float * const * d, const int n);
+
+template <>
+void OutputTransform<2, 4>(const float * const * s, float * const * d, const int n)
+{
+  const float * s0 = s[0], * s1 = s[1], * s2 = s[2], * s3 = s[3];
+  float * d0 = d[0], * d1 = d[1];
+
+  for (int t = 0; t < n; t++)
+  {
+    d0[t] = s0[t] + s1[t] + s2[t];
+    d1[t] = s1[t] - s2[t] + s3[t];
+  }
+}
+
+template <>
+void OutputTransform<4, 6>(const float * const * s, float * const * d, const int n)
+{
+  const float * s0 = s[0], * s1 = s[1], * s2 = s[2], * s3 = s[3], * s4 = s[4], * s5 = s[5];
+  float * d0 = d[0], * d1 = d[1], * d2 = d[2], * d3 = d[3];
+
+  for (int t = 0; t < n; t++)
+  {
+    const float p12 = s1[t] + s2[t], m12 = s1[t] - s2[t];
+    const float p34 = s3[t] + s4[t], m34 = s3[t] - s4[t];
+    d0[t] = s0[t] + p12 + p34;
+    d1[t] = m12 + 2 * m34;
+    d2[t] = p12 + 4 * p34;
+    d3[t] = m12 + 8 * m34 + s5[t];
+  }
+}
+
+template <>
+void OutputTransform<2, 6>(const float * const * s, float * const * d, const int n)
+{
+  const float * s0 = s[0], * s1 = s[1], * s2 = s[2], * s3 = s[3], * s4 = s[4], * s5 = s[5];
+  float * d0 = d[0], * d1 = d[1];
+
+  for (int t = 0; t < n; t++)
+  {
+    d0[t] = s0[t] + s1[t] + s2[t] + s3[t] + s4[t];
+    d1[t] = s1[t] - s2[t] + 2 * (s3[t] - s4[t]) + s5[t];
+  }
+}
+
+// Per-thread rows of one tile row
+struct winogradScratch
+{
+  std::vector<float> T1;	// alpha rows of BT d, nStride each, zero past nWidth
+  int nStride;
+  std::vector<float> phases;	// m column phases of a T1 row
+  std::vector<float> M;		// alpha x alpha planes of U . V, one float per tile
+  std::vector<float> Z;		// m x alpha planes of AT M
+  std::vector<float> Y;		// m column phases of an output row
+};
+
+// nCount tiles starting m apart at column x0 of the valid region.
+// Column x0 + t m + l of a T1 row is element t + l / m of phase l % m,
+// so the transform across columns reads unit-stride rows.
+template <int m, int r>
+static void TransformTiles(winogradScratch& s, const int x0, const int nCount,
+			   const float * pU, float * pOut, const int nPitch)
+{
+  const int alpha = m + r - 1;
+  const int nPhase = nCount + (alpha + m - 1) / m;
+
+  const float * src[alpha];
+  float * dst[alpha];
+
+  // M = U . (T1 B)
+  for (int i = 0; i < alpha; i++)
+  {
+    const float * pT1 = &s.T1[i * s.nStride] + x0;
+    for (int p = 0; p < m; p++)
+    {
+      float * pPhase = &s.phases[p * nPhase];
+      for (int t = 0; t < nPhase; t++)
+	pPhase[t] = pT1[t * m + p];
+    }
+
+    for (int l = 0; l < alpha; l++)
+      src[l] = &s.phases[(l % m) * nPhase] + l / m;
+    for (int j = 0; j < alpha; j++)
+      dst[j] = &s.M[(i * alpha + j) * nCount];
+    InputTransform<alpha>(src, dst, nCount);
+
+    for (int j = 0; j < alpha; j++)
+    {
+      const float u = pU[i * alpha + j];
+      for (int t = 0; t < nCount; t++)
+	dst[j][t] *= u;
+    }
+  }
+
+  // Z = AT M, column by column
+  for (int j = 0; j < alpha; j++)
+  {
+    for (int i = 0; i < alpha; i++)
+      src[i] = &s.M[(i * alpha + j) * nCount];
+    for (int a = 0; a < m; a++)
+      dst[a] = &s.Z[(a * alpha + j) * nCount];
+    OutputTransform<m, alpha>(src, dst, nCount);
+  }
+
+  // Y = Z A, row by row, then back from phases to columns
+  for (int a = 0; a < m; a++)
+  {
+    for (int j = 0; j < alpha; j++)
+      src[j] = &s.Z[(a * alpha + j) * nCount];
+    for (int b = 0; b < m; b++)
+      dst[b] = &s.Y[b * nCount];
+    OutputTransform<m, alpha>(src, dst, nCount);
+
+    float * pDst = pOut + a * nPitch + x0;
+    for (int b = 0; b < m; b++)
+      for (int t = 0; t < nCount; t++)
+	pDst[t * m + b] = s.Y[b * nCount + t];
+  }
+}
+
+// Valid convolution of the nWidth - r + 1 x nHeight - r + 1 interior
+template <int m, int r>
+static void ConvolveInterior(const float * pInput, const float * pFilter, float * pOutput,
+			     const int nPitch, const int nWidth, const int nHeight,
+			     const int nNumThreads)
+{
+  const int alpha = m + r - 1;
+
+  const int nValidWidth = nWidth - r + 1;
+  const int nValidHeight = nHeight - r + 1;
+  const int nAnchor = FilterAnchor(r);
+  float * pValid = pOutput + nAnchor * nPitch + nAnchor;
+
+  float U[alpha * alpha];
+  FilterTransform<m, r>(pFilter, U);
+
+  // Full tiles, then one tile shifted back onto the right edge
+  const int nTiles = nValidWidth / m;
+  const bool bTail = (nValidWidth % m) != 0;
+  const int nTileRows = (nValidHeight + m - 1) / m;
+
+#pragma omp parallel num_threads(nNumThreads)
+  {
+    winogradScratch s;
+    s.nStride = nWidth + alpha + m;
+    s.T1.resize(alpha * s.nStride, 0);
+    s.phases.resize(m * (nTiles + alpha));
+    s.M.resize(alpha * alpha * nTiles);
+    s.Z.resize(m * alpha * nTiles);
+    s.Y.resize(m * nTiles);
+
+    const float * src[alpha];
+    float * dst[alpha];
+    for (int i = 0; i < alpha; i++)
+      dst[i] = &s.T1[i * s.nStride];
+
+#pragma omp for schedule(static)
+    for (int ty = 0; ty < nTileRows; ty++)
+    {
+      const int y0 = (ty * m + m <= nValidHeight) ? ty * m : nValidHeight - m;
+
+      // T1 = BT d down whole rows
+      for (int k = 0; k < alpha; k++)
+	src[k] = pInput + (y0 + k) * nPitch;
+      InputTransform<alpha>(src, dst, nWidth);
+
+      float * pOut = pValid + y0 * nPitch;
+      TransformTiles<m, r>(s, 0, nTiles, U, pOut, nPitch);
+      if (bTail)
+	TransformTiles<m, r>(s, nValidWidth - m, 1, U, pOut, nPitch);
+    }
+  }
+}
+
+// Interiors smaller than one tile
+static void ConvolveInteriorDirect(const float * pInput, const float * pFilter, float * pOutput,
+				   const int nPitch, const int nWidth, const int nHeight,
+				   const int nFilterWidth)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+
+  for (int y = 0; y + nFilterWidth <= nHeight; y++)
+    for (int x = 0; x + nFilterWidth <= nWidth; x++)
+    {
+      float sum = 0;
+      for (int r = 0; r < nFilterWidth; r++)
+	for (int c = 0; c < nFilterWidth; c++)
+	  sum += pFilter[r * nFilterWidth + c] * pInput[(y + r) * nPitch + x + c];
+      pOutput[(y + nAnchor) * nPitch + x + nAnchor] = sum;
+    }
+}
+
+static void ConvolveWinogradInterior(const float * pInput, const float * pFilter, float * pOutput,
+				    const int nPitch, const int nWidth, const int nHeight,
+				    const int nFilterWidth, const int nOutputTile, const int nNumThreads)
+{
+  const int nValid = std::min(nWidth, nHeight) - nFilterWidth + 1;
+
+  if (nValid < nOutputTile)
+    ConvolveInteriorDirect(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nFilterWidth);
+  else if (nFilterWidth == 3 && nOutputTile == 2)
+    ConvolveInterior<2, 3>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nNumThreads);
+  else if (nFilterWidth == 3 && nOutputTile == 4)
+    ConvolveInterior<4, 3>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nNumThreads);
+  else
+    ConvolveInterior<2, 5>(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, nNumThreads);
+}
+
+void ConvolveWinograd(const float * pInput, const float * pFilter, float * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight,
+		      const int nFilterWidth, const int nOutputTile,
+		      const int nBorderMode, const float fBorderValue, const int nNumThreads)
+{
+  ConvolveWinogradInterior(pInput, pFilter, pOutput, nPitch, nWidth, nHeight,
+			   nFilterWidth, nOutputTile, nNumThreads);
+
+  ConvolveBorder(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+		 nFilterWidth, nBorderMode, fBorderValue, nNumThreads);
+}
+
+// The interior of the tile is the valid region of the sub-image that
+// starts one anchor above and left of it
+void ConvolveWinogradTile(const float * pInput, const float * pFilter, float * pOutput,
+			  const int nPitch, const int nWidth, const int nHeight,
+			  const int nFilterWidth, const int nOutputTile,
+			  const int nBorderMode, const float fBorderValue, const imageRect& tile)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const imageRect interior = TileInterior(tile, nWidth, nHeight, nFilterWidth);
+
+  if (!RectEmpty(interior))
+  {
+    const int nOffset = (interior.y0 - nAnchor) * nPitch + interior.x0 - nAnchor;
+    ConvolveWinogradInterior(pInput + nOffset, pFilter, pOutput + nOffset, nPitch,
+			     interior.x1 - interior.x0 + nFilterWidth - 1,
+			     interior.y1 - interior.y0 + nFilterWidth - 1,
+			     nFilterWidth, nOutputTile, 1);
+  }
+
+  ConvolveBorderTile(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+		     nFilterWidth, nBorderMode, fBorderValue, tile);
+}
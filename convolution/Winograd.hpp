@@ -0,0 +1,68 @@
+#ifndef __WINOGRAD_H__
+#define __WINOGRAD_H__
+
+#include "Border.hpp"
+
+/////////////////////////////////////////////////////////////////
+// Winograd minimal filtering
+//
+// F(m x m, r x r) computes an m x m block of outputs from an
+// alpha x alpha input tile, alpha = m + r - 1, as
+//
+//   Y = AT [(G g GT) . (BT d B)] A
+//
+// where . is the element-wise product. The filter transform U = G g GT
+// is done once per call, so each tile costs alpha^2 multiplies instead
+// of m^2 r^2, plus additions and small constant multiplies in the
+// transforms:
+//
+//   F(2x2, 3x3)   16 / 4  = 4    multiplies per output (direct: 9)
+//   F(4x4, 3x3)   36 / 16 = 2.25 multiplies per output (direct: 9)
+//   F(2x2, 5x5)   36 / 4  = 9    multiplies per output (direct: 25)
+//
+// The matrices come from Toom-Cook interpolation at 0, 1, -1 (alpha
+// = 4) or 0, 1, -1, 2, -2 (alpha = 6), plus infinity. Larger tiles
+// need larger points, which amplify rounding. The error against the
+// exact sum is bounded by c eps beta^2 sum |g d| for a small constant
+// c, where beta = max_i sum_j |AT_ij| (|G| 1)_j (|BT| 1)_j is the 1D
+// growth of the transforms. Measured on random data in [-1, 1], as
+// max |error| / sum |g d| against a double reference:
+//
+//   F(2x2, 3x3)   beta = 8     observed  4 eps
+//   F(4x4, 3x3)   beta = 48    observed 60 eps
+//   F(2x2, 5x5)   beta = 58    observed 18 eps
+//
+// That is well within what image filtering needs, but the results
+// are not bit-identical to the direct engines.
+//
+// The CPU engine computes the interior one row of tiles at a time.
+// The input transform runs down whole rows first. Each transformed
+// row is then split into its m column phases, so the transform across
+// tiles and the element-wise product are unit-stride loops over tiles
+// that vectorize. A last tile, shifted back onto the edge, covers
+// interior widths and heights that are not multiples of m.
+// ConvolveBorder() computes the rest.
+/////////////////////////////////////////////////////////////////
+
+// Supported (filter width, output tile) pairs: (3, 2), (3, 4), (5, 2)
+bool WinogradSupported(int nFilterWidth, int nOutputTile);
+
+// Input tile width alpha, and the BT (alpha x alpha) and AT
+// (m x alpha) matrices in row-major order
+int WinogradMatrices(int nFilterWidth, int nOutputTile, const float ** ppBT, const float ** ppAT);
+
+// pU receives the alpha x alpha filter transform G g GT
+void WinogradFilterTransform(const float * pFilter, int nFilterWidth, int nOutputTile, float * pU);
+
+void ConvolveWinograd(const float * pInput, const float * pFilter, float * pOutput,
+		      const int nPitch, const int nWidth, const int nHeight,
+		      const int nFilterWidth, const int nOutputTile,
+		      const int nBorderMode, const float fBorderValue, const int nNumThreads);
+
+// One output tile on the calling thread
+void ConvolveWinogradTile(const float * pInput, const float * pFilter, float * pOutput,
+			  const int nPitch, const int nWidth, const int nHeight,
+			  const int nFilterWidth, const int nOutputTile,
+			  const int nBorderMode, const float fBorderValue, const imageRect& tile);
+
+#endif
@@ -0,0 +1,76 @@
+#include "Workload.hpp"
+
+#include <math.h>
+
+const char * InputPatternName(int nPattern)
+{
+  switch (nPattern)
+  {
+  case PATTERN_UNIFORM: return "uniform";
+  case PATTERN_NORMAL: return "normal";
+  case PATTERN_CONSTANT: return "constant";
+  case PATTERN_GRADIENT: return "gradient";
+  case PATTERN_SPARSE: return "sparse";
+  }
+  return "unknown";
+}
+
+void FillUniform(float * pBuffer, size_t n, uint64_t nSeed, uint64_t nStream, int nNumThreads)
+{
+  const long nCount = (long) n;
+
+#pragma omp parallel for schedule(static) num_threads(nNumThreads)
+  for (long i = 0; i < nCount; i++)
+    pBuffer[i] = WorkloadUniform(nSeed, nStream, i);
+}
+
+void FillPattern(float * pImage, int nPitch, int nWidth, int nHeight, int nChannels,
+		 int nPattern, uint64_t nSeed, uint64_t nStream, int nNumThreads)
+{
+  const int nRowValues = nWidth * nChannels;
+  const float fRamp = 1.0f / float(nWidth + nHeight > 2 ? nWidth + nHeight - 2 : 1);
+
+#pragma omp parallel for schedule(static) num_threads(nNumThreads)
+  for (int y = 0; y < nHeight; y++)
+  {
+    float * pRow = pImage + (size_t) y * nPitch * nChannels;
+    const uint64_t nFirst = (uint64_t) y * nPitch * nChannels;
+
+    switch (nPattern)
+    {
+    case PATTERN_UNIFORM:
+      for (int i = 0; i < nRowValues; i++)
+	pRow[i] = WorkloadUniform(nSeed, nStream, nFirst + i);
+      break;
+    case PATTERN_NORMAL:
+      // Box-Muller on the two halves of one hash
+      for (int i = 0; i < nRowValues; i++)
+      {
+	const uint64_t h = WorkloadHash(nSeed, nStream, nFirst + i);
+	const float u1 = (float((h >> 40) & 0xffffff) + 1.0f) * (1.0f / 16777217.0f);
+	const float u2 = float((h >> 8) & 0xffffff) * (1.0f / 16777216.0f);
+	const float v = 0.5f + 0.125f * sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+	pRow[i] = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+      }
+      break;
+    case PATTERN_CONSTANT:
+      for (int i = 0; i < nRowValues; i++)
+	pRow[i] = 0.5f;
+      break;
+    case PATTERN_GRADIENT:
+      for (int i = 0; i < nRowValues; i++)
+	pRow[i] = float(i / nChannels + y) * fRamp;
+      break;
+    case PATTERN_SPARSE:
+      for (int i = 0; i < nRowValues; i++)
+      {
+	const uint64_t h = WorkloadHash(nSeed, nStream, nFirst + i);
+	pRow[i] = ((h & 15) == 0) ? float(h >> 40) * (1.0f / 16777216.0f) : 0.0f;
+      }
+      break;
+    }
+
+    for (int i = nRowValues; i < nPitch * nChannels; i++)
+      pRow[i] = 0;
+  }
+}
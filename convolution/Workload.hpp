@@ -0,0 +1,62 @@
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////
+// Synthetic workload
+//
+// Every generated value is a pure function of (seed, stream,
+// counter), hashed with the SplitMix64 finalizer. There is no
+// generator state, so any thread can produce any element. Fills are
+// split across threads and vectorize, and they give the same data for
+// every thread count and every run with the same seed.
+//
+// Each buffer draws from its own stream (WORKLOAD_STREAM_*), so the
+// input does not change when, say, the filter width does.
+/////////////////////////////////////////////////////////////////
+
+enum inputPattern
+{
+  PATTERN_UNIFORM = 0,		// Uniform in [0, 1)
+  PATTERN_NORMAL,		// Normal, mean 0.5, deviation 0.125, clamped to [0, 1]
+  PATTERN_CONSTANT,		// 0.5 everywhere
+  PATTERN_GRADIENT,		// Diagonal ramp from 0 at (0, 0) to 1 at the far corner
+  PATTERN_SPARSE,		// Uniform on 1 pixel in 16, 0 elsewhere
+  PATTERN_COUNT
+};
+
+enum workloadStream
+{
+  WORKLOAD_STREAM_INPUT = 0,
+  WORKLOAD_STREAM_FILTER,
+  WORKLOAD_STREAM_JOBS,
+  WORKLOAD_STREAM_PIPELINE	// One more per pipeline stage
+};
+
+const char * InputPatternName(int nPattern);
+
+inline uint64_t WorkloadHash(uint64_t nSeed, uint64_t nStream, uint64_t nCounter)
+{
+  uint64_t z = nSeed * 0x9e3779b97f4a7c15ULL + (nStream << 48) + nCounter;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1) from the top 24 bits, exact in float
+inline float WorkloadUniform(uint64_t nSeed, uint64_t nStream, uint64_t nCounter)
+{
+  return float(WorkloadHash(nSeed, nStream, nCounter) >> 40) * (1.0f / 16777216.0f);
+}
+
+// n values of WorkloadUniform() for counters 0 .. n - 1
+void FillUniform(float * pBuffer, size_t n, uint64_t nSeed, uint64_t nStream, int nNumThreads);
+
+// nWidth x nHeight pixels of nChannels interleaved floats, rows nPitch
+// pixels apart. The padding past nWidth is zeroed.
+void FillPattern(float * pImage, int nPitch, int nWidth, int nHeight, int nChannels,
+		 int nPattern, uint64_t nSeed, uint64_t nStream, int nNumThreads);
+
+#endif
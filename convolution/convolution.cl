@@ -0,0 +1,1077 @@
+/////////////////////////////////////////////////////////////////
+// Direct 2D convolution, one work-item per output pixel.
+//
+// Input and output are nWidth x nHeight with a row pitch of nPitch
+// pixels, and the filter is read from constant memory. Work-items
+// whose window lies inside the image take a branch-free path; only
+// those near the edges remap their taps, see Border.hpp.
+/////////////////////////////////////////////////////////////////
+
+#define BORDER_CLAMP    0
+#define BORDER_MIRROR   1
+#define BORDER_WRAP     2
+#define BORDER_CONSTANT 3
+
+inline int border_index(int i, int n, int mode)
+{
+  if (i >= 0 && i < n)
+    return i;
+
+  switch (mode)
+  {
+  case BORDER_CLAMP:
+    return clamp(i, 0, n - 1);
+  case BORDER_MIRROR:
+    i %= 2 * n;
+    if (i < 0)
+      i += 2 * n;
+    return i < n ? i : 2 * n - 1 - i;
+  case BORDER_WRAP:
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+  return -1;
+}
+
+// Index of input pixel (x, y) after remapping, -1 for a constant border
+inline int input_index(int x, int y, int nPitch, int nWidth, int nHeight, int mode)
+{
+  x = border_index(x, nWidth, mode);
+  y = border_index(y, nHeight, mode);
+  return (x < 0 || y < 0) ? -1 : y * nPitch + x;
+}
+
+inline bool is_interior(int xOut, int yOut, int nWidth, int nHeight, int nFilterWidth)
+{
+  const int nAnchor = (nFilterWidth - 1) / 2;
+  const int nAfter = nFilterWidth - 1 - nAnchor;
+  return xOut >= nAnchor && yOut >= nAnchor && xOut + nAfter < nWidth && yOut + nAfter < nHeight;
+}
+
+inline float convolve_at(const __global float * pInput,
+			 __constant float * pFilter,
+			 const int xOut,
+			 const int yOut,
+			 const int nPitch,
+			 const int nFilterWidth,
+			 const int nWidth,
+			 const int nHeight,
+			 const int nBorderMode,
+			 const float fBorderValue)
+{
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  float sum = 0;
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * pInput[idxIntmp + c];
+    }
+  }
+  else
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? fBorderValue : pInput[idx]);
+      }
+  }
+  return sum;
+}
+
+__kernel void convolve(const __global float * pInput,
+		       __constant float * pFilter,
+		       __global float * pOutput,
+		       const int nPitch,
+		       const int nFilterWidth,
+		       const int nWidth,
+		       const int nHeight,
+		       const int nBorderMode,
+		       const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+
+  pOutput[yOut * nPitch + xOut] = convolve_at(pInput, pFilter, xOut, yOut, nPitch, nFilterWidth,
+					      nWidth, nHeight, nBorderMode, fBorderValue);
+}
+
+/////////////////////////////////////////////////////////////////
+// Local-memory variant: each LOCAL_TILE x LOCAL_TILE work-group
+// stages its input window of (LOCAL_TILE + nFilterWidth - 1)^2
+// pixels in pTile, remapping the border while loading, so the taps
+// are read from local memory without any edge test. The global
+// range is rounded up to whole tiles.
+/////////////////////////////////////////////////////////////////
+
+#define LOCAL_TILE 16
+
+__kernel __attribute__((reqd_work_group_size(LOCAL_TILE, LOCAL_TILE, 1)))
+void convolve_local(const __global float * pInput,
+		    __constant float * pFilter,
+		    __global float * pOutput,
+		    const int nPitch,
+		    const int nFilterWidth,
+		    const int nWidth,
+		    const int nHeight,
+		    const int nBorderMode,
+		    const float fBorderValue,
+		    __local float * pTile)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int xLocal = get_local_id(0);
+  const int yLocal = get_local_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+  const int nTileWidth = LOCAL_TILE + nFilterWidth - 1;
+  const int xBase = get_group_id(0) * LOCAL_TILE - nAnchor;
+  const int yBase = get_group_id(1) * LOCAL_TILE - nAnchor;
+
+  for (int ty = yLocal; ty < nTileWidth; ty += LOCAL_TILE)
+    for (int tx = xLocal; tx < nTileWidth; tx += LOCAL_TILE)
+    {
+      const int idx = input_index(xBase + tx, yBase + ty, nPitch, nWidth, nHeight, nBorderMode);
+      pTile[ty * nTileWidth + tx] = (idx < 0) ? fBorderValue : pInput[idx];
+    }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (xOut >= nWidth || yOut >= nHeight)
+    return;
+
+  float sum = 0;
+  for (int r = 0; r < nFilterWidth; r++)
+  {
+    const int idxFtmp = r * nFilterWidth;
+    const int idxTiletmp = (yLocal + r) * nTileWidth + xLocal;
+
+    for (int c = 0; c < nFilterWidth; c++)
+      sum += pFilter[idxFtmp + c] * pTile[idxTiletmp + c];
+  }
+
+  pOutput[yOut * nPitch + xOut] = sum;
+}
+
+/////////////////////////////////////////////////////////////////
+// Image variant: the input is a CL_R / CL_FLOAT image read through
+// a sampler whose addressing mode implements the border, so no
+// work-item remaps its taps. Clamp uses CLK_ADDRESS_CLAMP_TO_EDGE,
+// mirror and wrap use CLK_ADDRESS_MIRRORED_REPEAT and
+// CLK_ADDRESS_REPEAT, which need normalized coordinates. Constant
+// uses CLK_ADDRESS_CLAMP, which reads 0 outside the image, and the
+// border value is added back for the taps that fall outside.
+/////////////////////////////////////////////////////////////////
+
+__kernel void convolve_image(__read_only image2d_t input,
+			     __constant float * pFilter,
+			     __global float * pOutput,
+			     const int nPitch,
+			     const int nFilterWidth,
+			     const int nWidth,
+			     const int nHeight,
+			     const int nBorderMode,
+			     const float fBorderValue,
+			     sampler_t sampler)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  const bool bNormalized = (nBorderMode == BORDER_MIRROR || nBorderMode == BORDER_WRAP);
+  const float2 scale = bNormalized ? (float2)(1.0f / nWidth, 1.0f / nHeight) : (float2)(1.0f, 1.0f);
+
+  float sum = 0;
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const float2 coord = ((float2)((float)(xOut + c - nAnchor), (float)(yOut + r - nAnchor)) + 0.5f) * scale;
+      sum += pFilter[r * nFilterWidth + c] * read_imagef(input, sampler, coord).x;
+    }
+
+  if (nBorderMode == BORDER_CONSTANT && !is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    float outside = 0;
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+	if (input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, BORDER_CONSTANT) < 0)
+	  outside += pFilter[r * nFilterWidth + c];
+    sum += outside * fBorderValue;
+  }
+
+  pOutput[yOut * nPitch + xOut] = sum;
+}
+
+/////////////////////////////////////////////////////////////////
+// Typed variants, see TypedConvolution.hpp for the semantics.
+//
+// Integer kernels take a fixed-point filter with nFracBits fractional
+// bits, accumulate in int and round half up before saturating.
+// The half kernel only uses half as a storage format through
+// vload_half()/vstore_half_rte(), which are core built-ins, so it
+// does not require cl_khr_fp16.
+/////////////////////////////////////////////////////////////////
+
+__kernel void convolve_u8(const __global uchar * pInput,
+			  __constant int * pFilter,
+			  __global uchar * pOutput,
+			  const int nPitch,
+			  const int nFilterWidth,
+			  const int nWidth,
+			  const int nHeight,
+			  const int nBorderMode,
+			  const float fBorderValue,
+			  const int nFracBits)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  int sum = 0;
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * (int)pInput[idxIntmp + c];
+    }
+  }
+  else
+  {
+    const int nBorderValue = clamp(convert_int_rte(fBorderValue), 0, 0xff);
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? nBorderValue : (int)pInput[idx]);
+      }
+  }
+
+  sum = (sum + (1 << (nFracBits-1))) >> nFracBits;
+  pOutput[yOut * nPitch + xOut] = convert_uchar_sat(sum);
+}
+
+__kernel void convolve_u16(const __global ushort * pInput,
+			   __constant int * pFilter,
+			   __global ushort * pOutput,
+			   const int nPitch,
+			   const int nFilterWidth,
+			   const int nWidth,
+			   const int nHeight,
+			   const int nBorderMode,
+			   const float fBorderValue,
+			   const int nFracBits)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  int sum = 0;
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * (int)pInput[idxIntmp + c];
+    }
+  }
+  else
+  {
+    const int nBorderValue = clamp(convert_int_rte(fBorderValue), 0, 0xffff);
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? nBorderValue : (int)pInput[idx]);
+      }
+  }
+
+  sum = (sum + (1 << (nFracBits-1))) >> nFracBits;
+  pOutput[yOut * nPitch + xOut] = convert_ushort_sat(sum);
+}
+
+__kernel void convolve_half(const __global half * pInput,
+			    __constant float * pFilter,
+			    __global half * pOutput,
+			    const int nPitch,
+			    const int nFilterWidth,
+			    const int nWidth,
+			    const int nHeight,
+			    const int nBorderMode,
+			    const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  float sum = 0;
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * vload_half(idxIntmp + c, pInput);
+    }
+  }
+  else
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? fBorderValue : vload_half(idx, pInput));
+      }
+  }
+
+  vstore_half_rte(sum, yOut * nPitch + xOut, pOutput);
+}
+
+/////////////////////////////////////////////////////////////////
+// Multi-channel variants, see MultiChannel.hpp for the layouts.
+//
+// Interleaved kernels convolve every channel of a pixel in one pass
+// with a single vector load per tap.
+/////////////////////////////////////////////////////////////////
+
+__kernel void convolve_rgba(const __global float4 * pInput,
+			    __constant float * pFilter,
+			    __global float4 * pOutput,
+			    const int nPitch,
+			    const int nFilterWidth,
+			    const int nWidth,
+			    const int nHeight,
+			    const int nBorderMode,
+			    const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  float4 sum = (float4)(0.0f);
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * pInput[idxIntmp + c];
+    }
+  }
+  else
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? (float4)(fBorderValue) : pInput[idx]);
+      }
+  }
+
+  pOutput[yOut * nPitch + xOut] = sum;
+}
+
+__kernel void convolve_rgb(const __global float * pInput,
+			   __constant float * pFilter,
+			   __global float * pOutput,
+			   const int nPitch,
+			   const int nFilterWidth,
+			   const int nWidth,
+			   const int nHeight,
+			   const int nBorderMode,
+			   const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  float3 sum = (float3)(0.0f);
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * vload3(idxIntmp + c, pInput);
+    }
+  }
+  else
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? (float3)(fBorderValue) : vload3(idx, pInput));
+      }
+  }
+
+  vstore3(sum, yOut * nPitch + xOut, pOutput);
+}
+
+// One plane per global z index, planes are nPitch * nHeight apart
+__kernel void convolve_planar(const __global float * pInput,
+			      __constant float * pFilter,
+			      __global float * pOutput,
+			      const int nPitch,
+			      const int nFilterWidth,
+			      const int nWidth,
+			      const int nHeight,
+			      const int nBorderMode,
+			      const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int ch = get_global_id(2);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  const __global float * pInPlane = pInput + ch * nPitch * nHeight;
+
+  float sum = 0;
+  if (is_interior(xOut, yOut, nWidth, nHeight, nFilterWidth))
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+    {
+      const int idxFtmp = r * nFilterWidth;
+      const int idxIntmp = (yOut + r - nAnchor) * nPitch + xOut - nAnchor;
+
+      for (int c = 0; c < nFilterWidth; c++)
+	sum += pFilter[idxFtmp + c] * pInPlane[idxIntmp + c];
+    }
+  }
+  else
+  {
+    for (int r = 0; r < nFilterWidth; r++)
+      for (int c = 0; c < nFilterWidth; c++)
+      {
+	const int idx = input_index(xOut + c - nAnchor, yOut + r - nAnchor, nPitch, nWidth, nHeight, nBorderMode);
+	sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? fBorderValue : pInPlane[idx]);
+      }
+  }
+
+  pOutput[(ch * nHeight + yOut) * nPitch + xOut] = sum;
+}
+
+/////////////////////////////////////////////////////////////////
+// Box (mean) filter, see BoxFilter.hpp.
+//
+// box_rows scans each padded row in local memory (one work-group of
+// BOX_GROUP_SIZE work-items per row) and takes the difference of two
+// prefix sums per output. box_columns then slides a running sum down
+// each column, one work-item per column so that rows are read
+// coalesced. Both passes cost O(1) per pixel whatever the filter
+// width.
+/////////////////////////////////////////////////////////////////
+
+#define BOX_GROUP_SIZE 256
+
+__kernel void box_rows(const __global float * pInput,
+		       __global float * pPrefix,
+		       __global float * pRowSum,
+		       const int nPitch,
+		       const int nFilterWidth,
+		       const int nWidth,
+		       const int nHeight,
+		       const int nBorderMode,
+		       const float fBorderValue,
+		       const int nPrefixPitch)
+{
+  __local float scan[BOX_GROUP_SIZE];
+
+  const int lid = get_local_id(0);
+  const int y = get_group_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+  const int n = nWidth + nFilterWidth - 1;
+
+  __global float * pP = pPrefix + y * nPrefixPitch;
+  const __global float * pRow = pInput + y * nPitch;
+
+  if (lid == 0)
+    pP[0] = 0;
+
+  float carry = 0;
+  for (int base = 0; base < n; base += BOX_GROUP_SIZE)
+  {
+    const int i = base + lid;
+
+    float v = 0;
+    if (i < n)
+    {
+      const int x = border_index(i - nAnchor, nWidth, nBorderMode);
+      v = (x < 0) ? fBorderValue : pRow[x];
+    }
+    scan[lid] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Inclusive Hillis-Steele scan of the chunk
+    for (int offset = 1; offset < BOX_GROUP_SIZE; offset <<= 1)
+    {
+      const float t = (lid >= offset) ? scan[lid - offset] : 0;
+      barrier(CLK_LOCAL_MEM_FENCE);
+      scan[lid] += t;
+      barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (i < n)
+      pP[i + 1] = carry + scan[lid];
+    carry += scan[BOX_GROUP_SIZE - 1];
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  barrier(CLK_GLOBAL_MEM_FENCE);
+
+  for (int x = lid; x < nWidth; x += BOX_GROUP_SIZE)
+    pRowSum[y * nPitch + x] = pP[x + nFilterWidth] - pP[x];
+}
+
+__kernel void box_columns(const __global float * pRowSum,
+			  __global float * pOutput,
+			  const int nPitch,
+			  const int nFilterWidth,
+			  const int nWidth,
+			  const int nHeight,
+			  const int nBorderMode,
+			  const float fBorderValue,
+			  const float fWeight)
+{
+  const int x = get_global_id(0);
+  if (x >= nWidth)
+    return;
+
+  const int nAnchor = (nFilterWidth - 1) / 2;
+  const float fConstantRow = fBorderValue * nFilterWidth;
+
+  float sum = 0;
+  for (int r = 0; r < nFilterWidth - 1; r++)
+  {
+    const int yIn = border_index(r - nAnchor, nHeight, nBorderMode);
+    sum += (yIn < 0) ? fConstantRow : pRowSum[yIn * nPitch + x];
+  }
+
+  for (int y = 0; y < nHeight; y++)
+  {
+    const int yAdd = border_index(y + nFilterWidth - 1 - nAnchor, nHeight, nBorderMode);
+    const int ySub = border_index(y - nAnchor, nHeight, nBorderMode);
+
+    sum += (yAdd < 0) ? fConstantRow : pRowSum[yAdd * nPitch + x];
+    pOutput[y * nPitch + x] = sum * fWeight;
+    sum -= (ySub < 0) ? fConstantRow : pRowSum[ySub * nPitch + x];
+  }
+}
+
+/////////////////////////////////////////////////////////////////
+// Filter pipeline, see Pipeline.hpp. Pointwise ops are given as
+// codes in pOps with two arguments each in pOpArgs and are applied
+// to a pixel right after the convolution that precedes them.
+//
+// pipeline_convolve2 fuses two consecutive convolutions: a
+// LOCAL_TILE x LOCAL_TILE work-group loads its input window, computes
+// the part of the intermediate image its outputs read into local
+// memory, and never writes it to global memory. Intermediate pixels
+// outside the image are then copied from their remapped position in
+// the tile, which holds for clamp, mirror and constant borders but
+// not for wrap, which the host runs unfused.
+/////////////////////////////////////////////////////////////////
+
+#define STAGE_SCALE     1
+#define STAGE_CLAMP     2
+#define STAGE_ABS       3
+#define STAGE_THRESHOLD 4
+
+inline float apply_ops(float v, __constant int * pOps, __constant float * pOpArgs, const int nOps)
+{
+  for (int i = 0; i < nOps; i++)
+  {
+    const float a = pOpArgs[2 * i];
+    const float b = pOpArgs[2 * i + 1];
+
+    switch (pOps[i])
+    {
+    case STAGE_SCALE: v = v * a + b; break;
+    case STAGE_CLAMP: v = v < a ? a : (v > b ? b : v); break;
+    case STAGE_ABS: v = fabs(v); break;
+    case STAGE_THRESHOLD: v = v >= a ? 1.0f : 0.0f; break;
+    }
+  }
+  return v;
+}
+
+__kernel void pipeline_pointwise(const __global float * pInput,
+				 __global float * pOutput,
+				 const int nPitch,
+				 __constant int * pOps,
+				 __constant float * pOpArgs,
+				 const int nOps)
+{
+  const int idx = get_global_id(1) * nPitch + get_global_id(0);
+  pOutput[idx] = apply_ops(pInput[idx], pOps, pOpArgs, nOps);
+}
+
+__kernel void pipeline_convolve(const __global float * pInput,
+				__constant float * pFilter,
+				__global float * pOutput,
+				const int nPitch,
+				const int nFilterWidth,
+				const int nWidth,
+				const int nHeight,
+				const int nBorderMode,
+				const float fBorderValue,
+				__constant int * pOps,
+				__constant float * pOpArgs,
+				const int nOps)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+
+  const float sum = convolve_at(pInput, pFilter, xOut, yOut, nPitch, nFilterWidth,
+				nWidth, nHeight, nBorderMode, fBorderValue);
+  pOutput[yOut * nPitch + xOut] = apply_ops(sum, pOps, pOpArgs, nOps);
+}
+
+// pOps / pOpArgs hold the nOps1 ops of the first convolution followed
+// by the nOps2 ops of the second
+__kernel __attribute__((reqd_work_group_size(LOCAL_TILE, LOCAL_TILE, 1)))
+void pipeline_convolve2(const __global float * pInput,
+			__constant float * pFilter1,
+			__constant float * pFilter2,
+			__global float * pOutput,
+			const int nPitch,
+			const int nFilterWidth1,
+			const int nFilterWidth2,
+			const int nWidth,
+			const int nHeight,
+			const int nBorderMode,
+			const float fBorderValue,
+			__constant int * pOps,
+			__constant float * pOpArgs,
+			const int nOps1,
+			const int nOps2,
+			__local float * pTile,
+			__local float * pMid)
+{
+  const int xLocal = get_local_id(0);
+  const int yLocal = get_local_id(1);
+  const int nAnchor1 = (nFilterWidth1 - 1) / 2;
+  const int nAnchor2 = (nFilterWidth2 - 1) / 2;
+
+  // The intermediate tile covers what the outputs read, the input
+  // tile what the intermediate tile reads
+  const int nMidWidth = LOCAL_TILE + nFilterWidth2 - 1;
+  const int nTileWidth = nMidWidth + nFilterWidth1 - 1;
+  const int xMid = get_group_id(0) * LOCAL_TILE - nAnchor2;
+  const int yMid = get_group_id(1) * LOCAL_TILE - nAnchor2;
+  const int xBase = xMid - nAnchor1;
+  const int yBase = yMid - nAnchor1;
+
+  for (int ty = yLocal; ty < nTileWidth; ty += LOCAL_TILE)
+    for (int tx = xLocal; tx < nTileWidth; tx += LOCAL_TILE)
+    {
+      const int idx = input_index(xBase + tx, yBase + ty, nPitch, nWidth, nHeight, nBorderMode);
+      pTile[ty * nTileWidth + tx] = (idx < 0) ? fBorderValue : pInput[idx];
+    }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Intermediate pixels inside the image
+  for (int my = yLocal; my < nMidWidth; my += LOCAL_TILE)
+    for (int mx = xLocal; mx < nMidWidth; mx += LOCAL_TILE)
+    {
+      const int x = xMid + mx;
+      const int y = yMid + my;
+      if (x < 0 || y < 0 || x >= nWidth || y >= nHeight)
+	continue;
+
+      float sum = 0;
+      for (int r = 0; r < nFilterWidth1; r++)
+	for (int c = 0; c < nFilterWidth1; c++)
+	  sum += pFilter1[r * nFilterWidth1 + c] * pTile[(my + r) * nTileWidth + mx + c];
+      pMid[my * nMidWidth + mx] = apply_ops(sum, pOps, pOpArgs, nOps1);
+    }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Intermediate pixels outside the image take their border value.
+  // Those an output reads always remap into the tile.
+  for (int my = yLocal; my < nMidWidth; my += LOCAL_TILE)
+    for (int mx = xLocal; mx < nMidWidth; mx += LOCAL_TILE)
+    {
+      const int x = xMid + mx;
+      const int y = yMid + my;
+      if (x >= 0 && y >= 0 && x < nWidth && y < nHeight)
+	continue;
+
+      const int xIn = border_index(x, nWidth, nBorderMode) - xMid;
+      const int yIn = border_index(y, nHeight, nBorderMode) - yMid;
+      if (nBorderMode == BORDER_CONSTANT)
+	pMid[my * nMidWidth + mx] = fBorderValue;
+      else if (xIn >= 0 && yIn >= 0 && xIn < nMidWidth && yIn < nMidWidth)
+	pMid[my * nMidWidth + mx] = pMid[yIn * nMidWidth + xIn];
+    }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  if (xOut >= nWidth || yOut >= nHeight)
+    return;
+
+  float sum = 0;
+  for (int r = 0; r < nFilterWidth2; r++)
+    for (int c = 0; c < nFilterWidth2; c++)
+      sum += pFilter2[r * nFilterWidth2 + c] * pMid[(yLocal + r) * nMidWidth + xLocal + c];
+
+  pOutput[yOut * nPitch + xOut] = apply_ops(sum, pOps + nOps1, pOpArgs + 2 * nOps1, nOps2);
+}
+
+/////////////////////////////////////////////////////////////////
+// Gaussian / Laplacian pyramid, see Pyramid.hpp
+//
+// pyramid_reduce runs one work-item per retained pixel of the
+// coarse level. pyramid_expand writes fine = src + fSign * 4 *
+// expand(coarse) and only visits the taps of its own parity.
+/////////////////////////////////////////////////////////////////
+
+__kernel void pyramid_reduce(const __global float * pInput,
+			     __constant float * pFilter,
+			     __global float * pOutput,
+			     const int nInPitch,
+			     const int nOutPitch,
+			     const int nFilterWidth,
+			     const int nInWidth,
+			     const int nInHeight,
+			     const int nBorderMode,
+			     const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  float sum = 0;
+  for (int r = 0; r < nFilterWidth; r++)
+    for (int c = 0; c < nFilterWidth; c++)
+    {
+      const int idx = input_index(2 * xOut + c - nAnchor, 2 * yOut + r - nAnchor,
+				  nInPitch, nInWidth, nInHeight, nBorderMode);
+      sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? fBorderValue : pInput[idx]);
+    }
+
+  pOutput[yOut * nOutPitch + xOut] = sum;
+}
+
+__kernel void pyramid_expand(const __global float * pCoarse,
+			     const __global float * pSrc,
+			     __constant float * pFilter,
+			     __global float * pDst,
+			     const int nCoarsePitch,
+			     const int nFinePitch,
+			     const int nFilterWidth,
+			     const int nCoarseWidth,
+			     const int nCoarseHeight,
+			     const int nBorderMode,
+			     const float fBorderValue,
+			     const float fSign)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  // First tap row / column that lands on a coarse pixel
+  const int r0 = (y + nAnchor) & 1;
+  const int c0 = (x + nAnchor) & 1;
+
+  float sum = 0;
+  for (int r = r0; r < nFilterWidth; r += 2)
+    for (int c = c0; c < nFilterWidth; c += 2)
+    {
+      const int idx = input_index((x + nAnchor - c) / 2, (y + nAnchor - r) / 2,
+				  nCoarsePitch, nCoarseWidth, nCoarseHeight, nBorderMode);
+      sum += pFilter[r * nFilterWidth + c] * (idx < 0 ? fBorderValue : pCoarse[idx]);
+    }
+
+  const int i = y * nFinePitch + x;
+  pDst[i] = pSrc[i] + 4 * fSign * sum;
+}
+
+/////////////////////////////////////////////////////////////////
+// Winograd F(m x m, r x r), see Winograd.hpp
+//
+// One work-item per m x m output tile. pU is the alpha x alpha
+// transformed filter and pBT / pAT the transform matrices, so one
+// kernel serves every supported (m, r) pair. Tiles whose input lies
+// inside the image skip the border remapping.
+/////////////////////////////////////////////////////////////////
+
+#define WINOGRAD_MAX_ALPHA 6
+
+__kernel void convolve_winograd(const __global float * pInput,
+				__constant float * pU,
+				__global float * pOutput,
+				const int nPitch,
+				const int nFilterWidth,
+				const int nWidth,
+				const int nHeight,
+				const int nBorderMode,
+				const float fBorderValue,
+				__constant float * pBT,
+				__constant float * pAT,
+				const int nOutputTile)
+{
+  const int m = nOutputTile;
+  const int alpha = m + nFilterWidth - 1;
+  const int nAnchor = (nFilterWidth - 1) / 2;
+
+  const int x0 = get_global_id(0) * m;
+  const int y0 = get_global_id(1) * m;
+  if (x0 >= nWidth || y0 >= nHeight)
+    return;
+
+  const int xIn = x0 - nAnchor;
+  const int yIn = y0 - nAnchor;
+  const bool bInside = xIn >= 0 && yIn >= 0 && xIn + alpha <= nWidth && yIn + alpha <= nHeight;
+
+  float d[WINOGRAD_MAX_ALPHA][WINOGRAD_MAX_ALPHA];
+  float t[WINOGRAD_MAX_ALPHA][WINOGRAD_MAX_ALPHA];
+
+  for (int k = 0; k < alpha; k++)
+    for (int l = 0; l < alpha; l++)
+    {
+      if (bInside)
+	d[k][l] = pInput[(yIn + k) * nPitch + xIn + l];
+      else
+      {
+	const int idx = input_index(xIn + l, yIn + k, nPitch, nWidth, nHeight, nBorderMode);
+	d[k][l] = (idx < 0) ? fBorderValue : pInput[idx];
+      }
+    }
+
+  // t = BT d
+  for (int i = 0; i < alpha; i++)
+    for (int l = 0; l < alpha; l++)
+    {
+      float sum = 0;
+      for (int k = 0; k < alpha; k++)
+	sum += pBT[i * alpha + k] * d[k][l];
+      t[i][l] = sum;
+    }
+
+  // d = U . (t B)
+  for (int i = 0; i < alpha; i++)
+    for (int j = 0; j < alpha; j++)
+    {
+      float sum = 0;
+      for (int l = 0; l < alpha; l++)
+	sum += t[i][l] * pBT[j * alpha + l];
+      d[i][j] = pU[i * alpha + j] * sum;
+    }
+
+  // t = AT d
+  for (int a = 0; a < m; a++)
+    for (int j = 0; j < alpha; j++)
+    {
+      float sum = 0;
+      for (int i = 0; i < alpha; i++)
+	sum += pAT[a * alpha + i] * d[i][j];
+      t[a][j] = sum;
+    }
+
+  // Y = t A
+  for (int a = 0; a < m; a++)
+    for (int b = 0; b < m; b++)
+    {
+      if (y0 + a >= nHeight || x0 + b >= nWidth)
+	continue;
+
+      float sum = 0;
+      for (int j = 0; j < alpha; j++)
+	sum += t[a][j] * pAT[b * alpha + j];
+      pOutput[(y0 + a) * nPitch + x0 + b] = sum;
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// Filter bank, see FilterBank.hpp. One tiled matrix product
+// Out = F . P over every filter, P being read from the padded input
+// rather than built.
+//
+// A work-group computes BANK_TILE_M filters x BANK_TILE_N output
+// pixels, taken in row-major order over the whole image. For each
+// BANK_TILE_K taps it stages the filter block and the patch block in
+// local memory, then every work-item accumulates BANK_WPT pixels of
+// one filter, BANK_TILE_N / BANK_WPT apart so that local reads do
+// not conflict. The local size is (BANK_TILE_N / BANK_WPT,
+// BANK_TILE_M) and the global range is rounded up to whole tiles.
+/////////////////////////////////////////////////////////////////
+
+#define BANK_TILE_M 16
+#define BANK_TILE_N 64
+#define BANK_TILE_K 16
+#define BANK_WPT 4
+#define BANK_GROUP_N (BANK_TILE_N / BANK_WPT)
+
+__kernel __attribute__((reqd_work_group_size(BANK_GROUP_N, BANK_TILE_M, 1)))
+void filter_bank_gemm(const __global float * pPadded,
+		      const __global float * pFilters,
+		      __global float * pOutputs,
+		      const int nPaddedPitch,
+		      const int nPitch,
+		      const int nPlaneSize,
+		      const int nFilterWidth,
+		      const int nWidth,
+		      const int nHeight,
+		      const int nFilters)
+{
+  __local float pTileF[BANK_TILE_M][BANK_TILE_K];
+  __local float pTileP[BANK_TILE_K][BANK_TILE_N];
+
+  const int tx = get_local_id(0);
+  const int ty = get_local_id(1);
+  const int f = get_group_id(1) * BANK_TILE_M + ty;
+  const int nPixelBase = get_group_id(0) * BANK_TILE_N;
+  const int nPixels = nWidth * nHeight;
+  const int K = nFilterWidth * nFilterWidth;
+
+  // Padded offset of the window of each pixel this work-item loads
+  int pOffset[BANK_WPT];
+  for (int w = 0; w < BANK_WPT; w++)
+  {
+    const int p = min(nPixelBase + tx + w * BANK_GROUP_N, nPixels - 1);
+    pOffset[w] = (p / nWidth) * nPaddedPitch + p % nWidth;
+  }
+
+  float acc[BANK_WPT];
+  for (int w = 0; w < BANK_WPT; w++)
+    acc[w] = 0.0f;
+
+  for (int k0 = 0; k0 < K; k0 += BANK_TILE_K)
+  {
+    // Filter block: one tap per work-item
+    pTileF[ty][tx] = (f < nFilters && k0 + tx < K) ? pFilters[f * K + k0 + tx] : 0.0f;
+
+    // Patch block: tap k0 + ty of BANK_WPT pixels per work-item
+    const int k = k0 + ty;
+    const int r = k / nFilterWidth;
+    const int nTapOffset = r * nPaddedPitch + k - r * nFilterWidth;
+    for (int w = 0; w < BANK_WPT; w++)
+      pTileP[ty][tx + w * BANK_GROUP_N] = (k < K) ? pPadded[pOffset[w] + nTapOffset] : 0.0f;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int kk = 0; kk < BANK_TILE_K; kk++)
+    {
+      const float a = pTileF[ty][kk];
+      for (int w = 0; w < BANK_WPT; w++)
+	acc[w] += a * pTileP[kk][tx + w * BANK_GROUP_N];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (f >= nFilters)
+    return;
+
+  for (int w = 0; w < BANK_WPT; w++)
+  {
+    const int p = nPixelBase + tx + w * BANK_GROUP_N;
+    if (p < nPixels)
+      pOutputs[f * nPlaneSize + (p / nWidth) * nPitch + p % nWidth] = acc[w];
+  }
+}
+
+/////////////////////////////////////////////////////////////////
+// Sparse filter, see SparseFilter.hpp: only the nTaps non-zero taps
+// are visited, as (dx, dy) offsets from the anchor in pTapOffsets and
+// their weights in pTapWeights. The box of the taps, nMinDx to nMaxDy,
+// sets the interior.
+//
+// When the tap pattern is fixed for a run the host builds a variant
+// of this kernel with the taps compiled in instead, see
+// SparseKernelSource().
+/////////////////////////////////////////////////////////////////
+
+__kernel void convolve_sparse(const __global float * pInput,
+			      __constant int2 * pTapOffsets,
+			      __constant float * pTapWeights,
+			      __global float * pOutput,
+			      const int nPitch,
+			      const int nTaps,
+			      const int nMinDx,
+			      const int nMinDy,
+			      const int nMaxDx,
+			      const int nMaxDy,
+			      const int nWidth,
+			      const int nHeight,
+			      const int nBorderMode,
+			      const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+
+  float sum = 0;
+  if (xOut + nMinDx >= 0 && yOut + nMinDy >= 0 &&
+      xOut + nMaxDx < nWidth && yOut + nMaxDy < nHeight)
+  {
+    const __global float * p = pInput + yOut * nPitch + xOut;
+    for (int t = 0; t < nTaps; t++)
+      sum += pTapWeights[t] * p[pTapOffsets[t].y * nPitch + pTapOffsets[t].x];
+  }
+  else
+  {
+    for (int t = 0; t < nTaps; t++)
+    {
+      const int idx = input_index(xOut + pTapOffsets[t].x, yOut + pTapOffsets[t].y,
+				  nPitch, nWidth, nHeight, nBorderMode);
+      sum += pTapWeights[t] * (idx < 0 ? fBorderValue : pInput[idx]);
+    }
+  }
+
+  pOutput[yOut * nPitch + xOut] = sum;
+}
+
+/////////////////////////////////////////////////////////////////
+// Spatio-temporal convolution, see Temporal.hpp: pRing holds the
+// nFrames slots of the frame ring, nPitch x nHeight pixels each, and
+// slice j of pFilter weights frame nFrame - nFrames + 1 + j, clamped
+// to frame 0. Only the newest frame is uploaded per output.
+/////////////////////////////////////////////////////////////////
+
+__kernel void convolve_temporal(const __global float * pRing,
+				__constant float * pFilter,
+				__global float * pOutput,
+				const int nPitch,
+				const int nFilterWidth,
+				const int nFrames,
+				const int nFrame,
+				const int nWidth,
+				const int nHeight,
+				const int nBorderMode,
+				const float fBorderValue)
+{
+  const int xOut = get_global_id(0);
+  const int yOut = get_global_id(1);
+  const int nFilterSize = nFilterWidth * nFilterWidth;
+
+  float sum = 0;
+  for (int j = 0; j < nFrames; j++)
+  {
+    const int nSlot = max(nFrame - nFrames + 1 + j, 0) % nFrames;
+    sum += convolve_at(pRing + (size_t) nSlot * nPitch * nHeight, pFilter + j * nFilterSize,
+		       xOut, yOut, nPitch, nFilterWidth, nWidth, nHeight, nBorderMode, fBorderValue);
+  }
+
+  pOutput[yOut * nPitch + xOut] = sum;
+}
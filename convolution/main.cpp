@@ -7,9 +7,17 @@
 #include <CL/cl.hpp>
 
 #include <omp.h>
+#include <math.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <string>
 #include <iomanip>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <new>
 
 using std::cout;
 using std::cerr;
@@ -17,6 +25,18 @@ using std::endl;
 using std::setw;
 using std::string;
 
+hostBufferStruct hostBuffers;
+timerStruct timers;
+statFileStruct stats;
+gpuDeviceStruct gpuDevice;
+DeviceRegistry registry;
+tileSchedulerStruct scheduler;
+paramStruct params;
+
+convolutionState driverState = {&params, &hostBuffers, &timers, &stats, &scheduler};
+
+int benchmarkFilterWidths[BENCHMARK_FILTER_COUNT] = {2, 3, 4, 5, 8, 16, 32, 64};
+
 /////////////////////////////////////////////////////////////////
 // Host buffers
 /////////////////////////////////////////////////////////////////
@@ -25,29 +45,123 @@ void InitHostBuffers()
 {
   hostBuffers.pInput  = NULL;
   hostBuffers.pOutputCPU = NULL;
+  hostBuffers.pOutputGPU = NULL;
   hostBuffers.pFilter = NULL;
+  hostBuffers.pInputTyped = NULL;
+  hostBuffers.pFilterFixed = NULL;
+  hostBuffers.pOutputTyped = NULL;
+  hostBuffers.pInputInterleaved = NULL;
+  hostBuffers.pOutputInterleaved = NULL;
+  hostBuffers.pInputPlanar = NULL;
+  hostBuffers.pOutputPlanar = NULL;
 
   /////////////////////////////////////////////////////////////////
   // Allocate and initialize memory used by host
   /////////////////////////////////////////////////////////////////
-  int sizeInBytes = params.nInWidth * params.nInHeight * sizeof(float);
+  int sizeInBytes = params.nPitch * params.nHeight * sizeof(float);
   hostBuffers.pInput = (float *) malloc(sizeInBytes);
   if (!hostBuffers.pInput)
     throw(string("InitHostBuffers()::Could not allocate memory"));
 
-  int sizeOutBytes = params.nWidth * params.nHeight * sizeof(float);
+  int sizeOutBytes = params.nPitch * params.nHeight * sizeof(float);
   hostBuffers.pOutputCPU = (float *) malloc(sizeOutBytes);
   if (!hostBuffers.pOutputCPU)
     throw(string("InitHostBuffers()::Could not allocate memory"));
 
-  srand(0);
-#pragma omp parallel for num_threads(DEFAULT_NUM_THREADS)
-  for (int i = 0; i < params.nInWidth * params.nInHeight; i++)
+  hostBuffers.pOutputGPU = (float *) malloc(sizeOutBytes);
+  if (!hostBuffers.pOutputGPU)
+    throw(string("InitHostBuffers()::Could not allocate memory"));
+
+  FillPattern(hostBuffers.pInput, params.nPitch, params.nWidth, params.nHeight, 1,
+	      params.nInputPattern, params.nSeed, WORKLOAD_STREAM_INPUT, DEFAULT_NUM_THREADS);
+
+  if (params.nDataType != DATA_FLOAT)
+    InitTypedHostBuffers();
+  if (params.nChannels > 1)
+    InitMultiChannelHostBuffers();
+
+  InitFilterHostBuffer(params.nFilterWidth);
+}
+void InitTypedHostBuffers()
+{
+  const int type = params.nDataType;
+  const int nSize = params.nTypedPitch * params.nHeight;
+
+  hostBuffers.pInputTyped = malloc(nSize * DataTypeSize(type));
+  if (!hostBuffers.pInputTyped)
+    throw(string("InitTypedHostBuffers()::Could not allocate memory"));
+
+  hostBuffers.pOutputTyped = malloc(nSize * DataTypeSize(type));
+  if (!hostBuffers.pOutputTyped)
+    throw(string("InitTypedHostBuffers()::Could not allocate memory"));
+
+  // Rescale the float input from [0,1] to the full range of the type,
+  // so that every mode convolves the same pattern
+  for (int y = 0; y < params.nHeight; y++)
+    for (int x = 0; x < params.nTypedPitch; x++)
+    {
+      const int i = y * params.nTypedPitch + x;
+      const float v = (x < params.nWidth) ? hostBuffers.pInput[y * params.nPitch + x] : 0.0f;
+      switch (type)
+      {
+      case DATA_U8: ((uint8_t *) hostBuffers.pInputTyped)[i] = (uint8_t) lrintf(v * 255.0f); break;
+      case DATA_U16: ((uint16_t *) hostBuffers.pInputTyped)[i] = (uint16_t) lrintf(v * 65535.0f); break;
+      case DATA_HALF: ((half_t *) hostBuffers.pInputTyped)[i] = FloatToHalf(v); break;
+      }
+    }
+}
+void InitMultiChannelHostBuffers()
+{
+  const int nPixels = params.nPitch * params.nHeight;
+  const int nSizeBytes = nPixels * params.nChannels * sizeof(float);
+
+  hostBuffers.pInputInterleaved = (float *) malloc(nSizeBytes);
+  hostBuffers.pOutputInterleaved = (float *) malloc(nSizeBytes);
+  hostBuffers.pInputPlanar = (float *) malloc(nSizeBytes);
+  hostBuffers.pOutputPlanar = (float *) malloc(nSizeBytes);
+  if (!hostBuffers.pInputInterleaved || !hostBuffers.pOutputInterleaved ||
+      !hostBuffers.pInputPlanar || !hostBuffers.pOutputPlanar)
+    throw(string("InitMultiChannelHostBuffers()::Could not allocate memory"));
+
+  FillPattern(hostBuffers.pInputInterleaved, params.nPitch, params.nWidth, params.nHeight, params.nChannels,
+	      params.nInputPattern, params.nSeed, WORKLOAD_STREAM_INPUT, DEFAULT_NUM_THREADS);
+
+  InterleavedToPlanar(hostBuffers.pInputInterleaved, hostBuffers.pInputPlanar,
+		      nPixels, params.nChannels, DEFAULT_NUM_THREADS);
+}
+// Taps of params.nFilterType, zero off the params.nDilation grid.
+// Random taps take the workload counters from nCounter on.
+void InitFilterTaps(float * pFilter, int width, int nCounter)
+{
+  const int nAnchor = FilterAnchor(width);
+  const bool bCross = (params.nFilterType == FILTER_CROSS || params.nFilterType == FILTER_LAPLACIAN);
+
+  double dFilterSum = 0;
+  for (int r = 0; r < width; r++)
+    for (int c = 0; c < width; c++)
+    {
+      const int i = r * width + c;
+      const bool bTap = (r - nAnchor) % params.nDilation == 0 && (c - nAnchor) % params.nDilation == 0
+	&& (!bCross || r == nAnchor || c == nAnchor);
+
+      if (!bTap)
+	pFilter[i] = 0.0f;
+      else if (params.nFilterType == FILTER_BOX || params.nFilterType == FILTER_LAPLACIAN)
+	pFilter[i] = 1.0f;
+      else
+	pFilter[i] = WorkloadUniform(params.nSeed, WORKLOAD_STREAM_FILTER, nCounter + i);
+      dFilterSum += pFilter[i];
+    }
+
+  // The Laplacian sums to zero and is not normalized
+  if (params.nFilterType == FILTER_LAPLACIAN)
   {
-    hostBuffers.pInput[i] = float(rand());
+    pFilter[nAnchor * width + nAnchor] = float(1.0 - dFilterSum);
+    return;
   }
 
-  InitFilterHostBuffer(params.nFilterWidth);
+  for (int i = 0; i < width * width; i++)
+    pFilter[i] /= dFilterSum;
 }
 void InitFilterHostBuffer(int width)
 {
@@ -59,21 +173,28 @@ void InitFilterHostBuffer(int width)
   if (!hostBuffers.pFilter)
     throw(string("InitFilterHostBuffer()::Could not allocate memory"));
 
-  double dFilterSum = 0;
   int nFilterSize = width * width;
-  for (int i = 0; i < nFilterSize; i++)
+  InitFilterTaps(hostBuffers.pFilter, width, 0);
+
+  hostBuffers.bBoxFilter = IsConstantFilter(hostBuffers.pFilter, width, &hostBuffers.fBoxWeight);
+  InitSparseFilter(hostBuffers.sparse, hostBuffers.pFilter, width);
+
+  if (params.nDataType == DATA_U8 || params.nDataType == DATA_U16)
   {
-    hostBuffers.pFilter[i] = float(rand());
-    dFilterSum += hostBuffers.pFilter[i];
+    FREE(hostBuffers.pFilterFixed, NULL);
+
+    hostBuffers.pFilterFixed = (int32_t *) malloc(nFilterSize * sizeof(int32_t));
+    if (!hostBuffers.pFilterFixed)
+      throw(string("InitFilterHostBuffer()::Could not allocate memory"));
+
+    QuantizeFilter(hostBuffers.pFilter, hostBuffers.pFilterFixed, width, params.nDataType);
   }
-  for (int i = 0; i < nFilterSize; i++)
-    hostBuffers.pFilter[i] /= dFilterSum;
 }
 
 void ClearBuffer(float * pBuf)
 {
 #pragma omp parallel for num_threads(DEFAULT_NUM_THREADS)
-  for (int i = 0; i < params.nWidth*params.nHeight; i++)
+  for (int i = 0; i < params.nPitch*params.nHeight; i++)
   {
     pBuf[i] = -999.999f;
   }
@@ -83,7 +204,15 @@ void ReleaseHostBuffers()
 {
   FREE(hostBuffers.pInput, NULL);
   FREE(hostBuffers.pOutputCPU, NULL);
+  FREE(hostBuffers.pOutputGPU, NULL);
   FREE(hostBuffers.pFilter, NULL);
+  FREE(hostBuffers.pInputTyped, NULL);
+  FREE(hostBuffers.pFilterFixed, NULL);
+  FREE(hostBuffers.pOutputTyped, NULL);
+  FREE(hostBuffers.pInputInterleaved, NULL);
+  FREE(hostBuffers.pOutputInterleaved, NULL);
+  FREE(hostBuffers.pInputPlanar, NULL);
+  FREE(hostBuffers.pOutputPlanar, NULL);
 }
 
 /////////////////////////////////////////////////////////////////
@@ -97,7 +226,25 @@ void PrintInfo()
   cout << "Height:         " << params.nHeight << endl;
   cout << "Filter Size:    " << params.nFilterWidth << " x "
        << params.nFilterWidth << endl;
+  if (params.nDilation > 1)
+    cout << "Dilation:       " << params.nDilation << endl;
   cout << "Iterations:     " << params.nIterations << endl;
+  cout << "Data type:      " << DataTypeName(params.nDataType) << endl;
+  cout << "Border:         " << BorderModeName(params.nBorderMode);
+  if (params.nBorderMode == BORDER_CONSTANT)
+    cout << " (" << params.fBorderValue << ")";
+  cout << endl;
+  cout << "Input:          " << InputPatternName(params.nInputPattern) << " (seed " << params.nSeed << ")" << endl;
+  cout << "Channels:       " << params.nChannels;
+  if (params.nChannels > 1)
+    cout << (params.nLayout == LAYOUT_PLANAR ? " (planar)" : " (interleaved)");
+  cout << endl;
+
+  cout << "CPU schedule:   " << ScheduleName(params.nSchedule);
+  if (params.nSchedule != SCHEDULE_ENGINE)
+    cout << " (" << TileOrderName(params.nTileOrder) << ", "
+	 << params.nTileSize << " x " << params.nTileSize << " tiles)";
+  cout << endl;
 
   cout << "Mode:           ";
   switch (params.nMode)
@@ -112,6 +259,8 @@ void PrintInfo()
   if (params.nMode < 1)
     for (int run = 0; run < params.nOmpRuns; run++)
       cout << "CPU (" << params.ompThreads[run] << "-threads) , ";
+  if (params.nMode != 0)
+    cout << "GPU";
 
   cout << endl << endl;
 }
@@ -119,7 +268,120 @@ void PrintInfo()
 void PrintCPUTime(int run)
 {
   if (params.nMode < 1)
-    cout << "CPU (" << params.ompThreads[run] << "-threads): " << timers.dCpuTime << endl;
+  {
+    cout << "CPU (" << params.ompThreads[run] << "-threads): " << timers.dCpuTime;
+    if (params.bHwCounters)
+      cout << HwCounterSummary(driverState);
+    if (params.bEnergy)
+      cout << EnergySummary(driverState, timers.dCpuTime);
+    cout << endl;
+  }
+}
+// Opened before the first OpenMP region so that the worker threads
+// inherit the events
+void OpenHwCounters()
+{
+  if (!params.bHwCounters)
+    return;
+
+  if (!timers.hwCounters.Open())
+  {
+    cerr << "Hardware counters unavailable (" << timers.hwCounters.Error() << "), timing only" << endl;
+    return;
+  }
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    if (!timers.hwCounters.Available(i))
+      cerr << "Hardware counter unavailable: " << HwCounters::Name(i) << endl;
+}
+
+// IPC and events per output pixel of the last TimeCPU() call
+std::string HwCounterSummary(const convolutionState& state)
+{
+  const paramStruct& params = *state.pParams;
+  const timerStruct& timers = *state.pTimers;
+  const HwCounters& hw = timers.hwCounters;
+  const double dPixels = double(params.nWidth) * params.nHeight * params.nIterations;
+  const char * names[HW_COUNTER_COUNT] = {NULL, NULL, "LLC", "dTLB", "branch"};
+
+  bool bAny = false;
+  for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    bAny = bAny || hw.Available(i);
+  if (!bAny)
+    return "";
+
+  std::ostringstream summary;
+  summary << " [";
+  if (hw.Available(HW_CYCLES) && hw.Available(HW_INSTRUCTIONS) && hw.Value(HW_CYCLES) > 0)
+    summary << "IPC " << hw.Value(HW_INSTRUCTIONS) / hw.Value(HW_CYCLES);
+  else
+    summary << "IPC n/a";
+  for (int i = HW_LLC_MISSES; i < HW_COUNTER_COUNT; i++)
+    if (hw.Available(i))
+      summary << ", " << names[i] << " " << hw.Value(i) / dPixels << "/px";
+  summary << "]";
+
+  return summary.str();
+}
+
+// Opened once; a missing or unreadable powercap is reported and the
+// runs are only timed
+void OpenEnergyCounters()
+{
+  if (!params.bEnergy)
+    return;
+
+  if (!timers.energy.Open())
+  {
+    cerr << "Energy counters unavailable (" << timers.energy.Error() << "), timing only" << endl;
+    return;
+  }
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+    if (!timers.energy.Available(d))
+      cerr << "Energy counter unavailable: " << RaplCounters::Name(d) << endl;
+}
+
+// Energy per frame of the last timed region, dTime seconds per frame
+// over params.nIterations frames. The power and frames per joule are
+// of all the available domains together.
+std::string EnergySummary(const convolutionState& state, double dTime)
+{
+  const paramStruct& params = *state.pParams;
+  const timerStruct& timers = *state.pTimers;
+  const RaplCounters& energy = timers.energy;
+  double dJoules = 0;
+  bool bAny = false;
+
+  std::ostringstream summary;
+  summary << " [";
+  for (int d = 0; d < RAPL_DOMAIN_COUNT; d++)
+    if (energy.Available(d))
+    {
+      summary << (bAny ? ", " : "") << RaplCounters::Name(d) << " "
+	      << energy.Joules(d) * 1e3 / params.nIterations << " mJ/frame";
+      dJoules += energy.Joules(d);
+      bAny = true;
+    }
+  if (!bAny)
+    return "";
+
+  const double dFrameJoules = dJoules / params.nIterations;
+  if (dTime > 0)
+    summary << ", " << dFrameJoules / dTime << " W";
+  if (dFrameJoules > 0)
+    summary << ", " << 1.0 / dFrameJoules << " frames/J";
+  else
+    summary << ", frames/J n/a";
+  summary << "]";
+
+  return summary.str();
+}
+
+void PrintGPUTime()
+{
+  cout << "GPU: " << timers.dGpuTime;
+  if (params.bEnergy)
+    cout << EnergySummary(driverState, timers.dGpuTime);
+  cout << endl;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -130,19 +392,49 @@ void InitStatFiles()
 {
   StatFile::clearDirectory("data");
 
-  stats.cpu4Threads.open("data/cpu_4_threads.dat");
+  if (params.nMode < 1)
+    for (int e = 0; e < CPU_ENGINE_COUNT; e++)
+      if (CPUEngineEnabled(driverState, e))
+      {
+	// The reference engine keeps its historical file name
+	string filename = "data/cpu_4_threads";
+	if (e != CPU_DIRECT)
+	  filename += string("_") + CPUEngineName(e);
+	stats.cpu[e].open((filename + ".dat").c_str());
+      }
+
+  if (params.nMode < 1 && params.benchmark)
+    for (int s = 0; s < SCHEDULE_COUNT; s++)
+      stats.schedule[s].open((string("data/cpu_4_threads_schedule_") + ScheduleName(s) + ".dat").c_str());
+
+  if (params.nMode != 0)
+    for (int e = 0; e < GPU_ENGINE_COUNT; e++)
+      if (GPUEngineEnabled(driverState, e))
+      {
+	string filename = "data/gpu";
+	if (e != GPU_DIRECT)
+	  filename += string("_") + GPUEngineName(e);
+	stats.gpu[e].open((filename + ".dat").c_str());
+      }
 }
 void ReleaseStatFiles()
 {
-  stats.cpu4Threads.close();
+  for (int e = 0; e < CPU_ENGINE_COUNT; e++)
+    stats.cpu[e].close();
+  for (int s = 0; s < SCHEDULE_COUNT; s++)
+    stats.schedule[s].close();
+  for (int e = 0; e < GPU_ENGINE_COUNT; e++)
+    stats.gpu[e].close();
 }
 
 /////////////////////////////////////////////////////////////////
 // Convolution on CPU
 /////////////////////////////////////////////////////////////////
 
+// Valid convolution of an nWidth x nHeight region: reads nWidth +
+// nFilterWidth - 1 columns and rows of pInput
 void Convolve(float * pInput, float * pFilter, float * pOutput,
-	      const int nInWidth, const int nWidth, const int nHeight,
+	      const int nPitch, const int nWidth, const int nHeight,
 	      const int nFilterWidth, const int nNumThreads)
 {
 #pragma omp parallel for num_threads(nNumThreads)
@@ -160,7 +452,7 @@ void Convolve(float * pInput, float * pFilter, float * pOutput,
 	const int idxFtmp = r * nFilterWidth;
 
 	const int yIn = yInTopLeft + r;
-	const int idxIntmp = yIn * nInWidth + xInTopLeft;
+	const int idxIntmp = yIn * nPitch + xInTopLeft;
 
 	for (int c = 0; c < nFilterWidth; c++)
 	{
@@ -170,33 +462,415 @@ void Convolve(float * pInput, float * pFilter, float * pOutput,
 	}
       } //for (int r = 0...
 
-      const int idxOut = yOut * nWidth + xOut;
+      const int idxOut = yOut * nPitch + xOut;
       pOutput[idxOut] = sum;
 
     } //for (int xOut = 0...
   } //for (int yOut = 0...
 }
 
-void RunCPU(int ompThreadCount)
+void ConvolveWithBorder(float * pInput, float * pFilter, float * pOutput,
+			const int nPitch, const int nWidth, const int nHeight,
+			const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			const int nNumThreads)
 {
-  cout << "\n********    Starting CPU (" << ompThreadCount << "-threads) run    ********" << endl;
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const int nInteriorWidth = nWidth - nFilterWidth + 1;
+  const int nInteriorHeight = nHeight - nFilterWidth + 1;
 
-  if (!params.benchmark)
+  if (nInteriorWidth > 0 && nInteriorHeight > 0)
+    Convolve(pInput, pFilter, pOutput + nAnchor * nPitch + nAnchor,
+	     nPitch, nInteriorWidth, nInteriorHeight,
+	     nFilterWidth, nNumThreads);
+
+  ConvolveBorder(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+		 nFilterWidth, nBorderMode, fBorderValue, nNumThreads);
+}
+
+void ConvolveWithBorderTile(float * pInput, float * pFilter, float * pOutput,
+			    const int nPitch, const int nWidth, const int nHeight,
+			    const int nFilterWidth, const int nBorderMode, const float fBorderValue,
+			    const imageRect& tile)
+{
+  const int nAnchor = FilterAnchor(nFilterWidth);
+  const imageRect interior = TileInterior(tile, nWidth, nHeight, nFilterWidth);
+
+  if (!RectEmpty(interior))
+    Convolve(pInput + (interior.y0 - nAnchor) * nPitch + interior.x0 - nAnchor, pFilter,
+	     pOutput + interior.y0 * nPitch + interior.x0,
+	     nPitch, interior.x1 - interior.x0, interior.y1 - interior.y0,
+	     nFilterWidth, 1);
+
+  ConvolveBorderTile(pInput, pFilter, pOutput, nPitch, nWidth, nHeight, 1,
+		     nFilterWidth, nBorderMode, fBorderValue, tile);
+}
+
+const char * CPUEngineName(int engine)
+{
+  switch (engine)
   {
-    timers.counter.Reset();
-    timers.counter.Start();
+  case CPU_DIRECT: return "direct";
+  case CPU_TYPED: return DataTypeName(params.nDataType);
+  case CPU_INTERLEAVED: return "interleaved";
+  case CPU_PLANAR: return "planar";
+  case CPU_PLANAR_TRANSPOSED: return "planar_transposed";
+  case CPU_BOX: return "box";
+  case CPU_WINOGRAD_F2: return "winograd_f2";
+  case CPU_WINOGRAD_F4: return "winograd_f4";
+  case CPU_SPARSE: return "sparse";
+  }
+  return "unknown";
+}
+bool CPUEngineEnabled(const convolutionState& state, int engine)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
 
-    for (int i = 0; i < params.nIterations; i++)
-      Convolve(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
-	       params.nInWidth,
-	       params.nWidth, params.nHeight,
-	       params.nFilterWidth,
-	       ompThreadCount);
+  switch (engine)
+  {
+  case CPU_DIRECT:
+  case CPU_WINOGRAD_F2:
+  case CPU_WINOGRAD_F4: return params.nChannels == 1;
+  case CPU_SPARSE: return params.nChannels == 1 && params.nDataType == DATA_FLOAT;
+  case CPU_TYPED: return params.nDataType != DATA_FLOAT;
+  case CPU_INTERLEAVED:
+  case CPU_PLANAR:
+  case CPU_PLANAR_TRANSPOSED: return params.nChannels > 1;
+  case CPU_BOX: return hostBuffers.bBoxFilter && params.nChannels == 1 && params.nDataType == DATA_FLOAT;
+  }
+  return false;
+}
+// Filter widths an engine handles
+bool CPUEngineSupported(int engine, int nFilterWidth)
+{
+  switch (engine)
+  {
+  case CPU_WINOGRAD_F2: return WinogradSupported(nFilterWidth, 2);
+  case CPU_WINOGRAD_F4: return WinogradSupported(nFilterWidth, 4);
+  }
+  return true;
+}
+int SelectedCPUEngine(const convolutionState& state, int nFilterWidth)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
 
-    timers.counter.Stop();
-    timers.dCpuTime = timers.counter.GetElapsedTime()/double(params.nIterations);
+  if (params.nChannels > 1)
+    return params.nLayout == LAYOUT_PLANAR ? CPU_PLANAR : CPU_INTERLEAVED;
+  if (params.nDataType != DATA_FLOAT)
+    return CPU_TYPED;
+  if (hostBuffers.bBoxFilter)
+    return CPU_BOX;
+  if (SparseFilterPays(hostBuffers.sparse))
+    return CPU_SPARSE;
+  if (CPUEngineSupported(CPU_WINOGRAD_F4, nFilterWidth))
+    return CPU_WINOGRAD_F4;
+  if (CPUEngineSupported(CPU_WINOGRAD_F2, nFilterWidth))
+    return CPU_WINOGRAD_F2;
+  return CPU_DIRECT;
+}
+
+// One output tile of an engine on the calling thread
+void ConvolveCPUTile(const convolutionState& state, int engine, int nFilterWidth, const imageRect& tile)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+
+  switch (engine)
+  {
+  case CPU_DIRECT:
+    ConvolveWithBorderTile(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
+			   params.nPitch,
+			   params.nWidth, params.nHeight,
+			   nFilterWidth,
+			   params.nBorderMode, params.fBorderValue,
+			   tile);
+    break;
+  case CPU_TYPED:
+    switch (params.nDataType)
+    {
+    case DATA_U8:
+      ConvolveU8Tile((uint8_t *) hostBuffers.pInputTyped, hostBuffers.pFilterFixed, (uint8_t *) hostBuffers.pOutputTyped,
+		     params.nTypedPitch,
+		     params.nWidth, params.nHeight,
+		     nFilterWidth,
+		     params.nBorderMode, params.fBorderValue,
+		     tile);
+      break;
+    case DATA_U16:
+      ConvolveU16Tile((uint16_t *) hostBuffers.pInputTyped, hostBuffers.pFilterFixed, (uint16_t *) hostBuffers.pOutputTyped,
+		      params.nTypedPitch,
+		      params.nWidth, params.nHeight,
+		      nFilterWidth,
+		      params.nBorderMode, params.fBorderValue,
+		      tile);
+      break;
+    case DATA_HALF:
+      ConvolveHalfTile((half_t *) hostBuffers.pInputTyped, hostBuffers.pFilter, (half_t *) hostBuffers.pOutputTyped,
+		       params.nTypedPitch,
+		       params.nWidth, params.nHeight,
+		       nFilterWidth,
+		       params.nBorderMode, params.fBorderValue,
+		       tile);
+      break;
+    }
+    break;
+  case CPU_INTERLEAVED:
+    ConvolveInterleavedTile(hostBuffers.pInputInterleaved, hostBuffers.pFilter, hostBuffers.pOutputInterleaved,
+			    params.nPitch,
+			    params.nWidth, params.nHeight,
+			    params.nChannels, nFilterWidth,
+			    params.nBorderMode, params.fBorderValue,
+			    tile);
+    break;
+  case CPU_PLANAR:
+  case CPU_PLANAR_TRANSPOSED:
+    ConvolvePlanarTile(hostBuffers.pInputPlanar, hostBuffers.pFilter, hostBuffers.pOutputPlanar,
+		       params.nPitch,
+		       params.nWidth, params.nHeight,
+		       params.nChannels, nFilterWidth,
+		       params.nBorderMode, params.fBorderValue,
+		       tile);
+    break;
+  case CPU_BOX:
+    ConvolveBoxTile(hostBuffers.pInput, hostBuffers.pOutputCPU,
+		    params.nPitch,
+		    params.nWidth, params.nHeight,
+		    nFilterWidth, hostBuffers.fBoxWeight,
+		    params.nBorderMode, params.fBorderValue,
+		    tile);
+    break;
+  case CPU_WINOGRAD_F2:
+  case CPU_WINOGRAD_F4:
+    ConvolveWinogradTile(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
+			 params.nPitch,
+			 params.nWidth, params.nHeight,
+			 nFilterWidth, (engine == CPU_WINOGRAD_F4) ? 4 : 2,
+			 params.nBorderMode, params.fBorderValue,
+			 tile);
+    break;
+  case CPU_SPARSE:
+    ConvolveSparseTile(hostBuffers.pInput, hostBuffers.sparse, hostBuffers.pOutputCPU,
+		       params.nPitch,
+		       params.nWidth, params.nHeight,
+		       params.nBorderMode, params.fBorderValue,
+		       tile);
+    break;
+  }
+}
+
+struct cpuTileContext
+{
+  const convolutionState * pState;
+  int engine;
+  int nFilterWidth;
+};
+
+static void ConvolveCPUTileFunction(const imageRect& tile, void * pContext)
+{
+  const cpuTileContext * pTileContext = (const cpuTileContext *) pContext;
+  ConvolveCPUTile(*pTileContext->pState, pTileContext->engine, pTileContext->nFilterWidth, tile);
+}
+
+// Tiled schedules: the planar transposes stay whole-image OpenMP
+// passes, only the convolution between them is tiled
+static void ConvolveCPUTiled(const convolutionState& state, int engine, int nFilterWidth, int nNumThreads, int nSchedule)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+  const tileSchedulerStruct& scheduler = *state.pScheduler;
+  const int nPixels = params.nPitch * params.nHeight;
+
+  cpuTileContext context;
+  context.pState = &state;
+  context.engine = engine;
+  context.nFilterWidth = nFilterWidth;
+
+  if (engine == CPU_PLANAR_TRANSPOSED)
+    InterleavedToPlanar(hostBuffers.pInputInterleaved, hostBuffers.pInputPlanar,
+			nPixels, params.nChannels, nNumThreads);
+
+  RunTiles(nSchedule, scheduler.tiles, ConvolveCPUTileFunction, &context,
+	   nNumThreads, scheduler.pPool);
+
+  if (engine == CPU_PLANAR_TRANSPOSED)
+    PlanarToInterleaved(hostBuffers.pOutputPlanar, hostBuffers.pOutputInterleaved,
+			nPixels, params.nChannels, nNumThreads);
+}
 
-    PrintCPUTime(ompThreadCount);
+void ConvolveCPU(const convolutionState& state, int engine, int nFilterWidth, int nNumThreads, int nSchedule)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+
+  if (nSchedule != SCHEDULE_ENGINE)
+  {
+    ConvolveCPUTiled(state, engine, nFilterWidth, nNumThreads, nSchedule);
+    return;
+  }
+
+  const int nPixels = params.nPitch * params.nHeight;
+
+  switch (engine)
+  {
+  case CPU_DIRECT:
+    ConvolveWithBorder(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
+		       params.nPitch,
+		       params.nWidth, params.nHeight,
+		       nFilterWidth,
+		       params.nBorderMode, params.fBorderValue,
+		       nNumThreads);
+    break;
+  case CPU_TYPED:
+    switch (params.nDataType)
+    {
+    case DATA_U8:
+      ConvolveU8((uint8_t *) hostBuffers.pInputTyped, hostBuffers.pFilterFixed, (uint8_t *) hostBuffers.pOutputTyped,
+		 params.nTypedPitch,
+		 params.nWidth, params.nHeight,
+		 nFilterWidth,
+		 params.nBorderMode, params.fBorderValue,
+		 nNumThreads);
+      break;
+    case DATA_U16:
+      ConvolveU16((uint16_t *) hostBuffers.pInputTyped, hostBuffers.pFilterFixed, (uint16_t *) hostBuffers.pOutputTyped,
+		  params.nTypedPitch,
+		  params.nWidth, params.nHeight,
+		  nFilterWidth,
+		  params.nBorderMode, params.fBorderValue,
+		  nNumThreads);
+      break;
+    case DATA_HALF:
+      ConvolveHalf((half_t *) hostBuffers.pInputTyped, hostBuffers.pFilter, (half_t *) hostBuffers.pOutputTyped,
+		   params.nTypedPitch,
+		   params.nWidth, params.nHeight,
+		   nFilterWidth,
+		   params.nBorderMode, params.fBorderValue,
+		   nNumThreads);
+      break;
+    }
+    break;
+  case CPU_INTERLEAVED:
+    ConvolveInterleaved(hostBuffers.pInputInterleaved, hostBuffers.pFilter, hostBuffers.pOutputInterleaved,
+			params.nPitch,
+			params.nWidth, params.nHeight,
+			params.nChannels, nFilterWidth,
+			params.nBorderMode, params.fBorderValue,
+			nNumThreads);
+    break;
+  case CPU_PLANAR_TRANSPOSED:
+    InterleavedToPlanar(hostBuffers.pInputInterleaved, hostBuffers.pInputPlanar,
+			nPixels, params.nChannels, nNumThreads);
+    // Fall through
+  case CPU_PLANAR:
+    ConvolvePlanar(hostBuffers.pInputPlanar, hostBuffers.pFilter, hostBuffers.pOutputPlanar,
+		   params.nPitch,
+		   params.nWidth, params.nHeight,
+		   params.nChannels, nFilterWidth,
+		   params.nBorderMode, params.fBorderValue,
+		   nNumThreads);
+    if (engine == CPU_PLANAR_TRANSPOSED)
+      PlanarToInterleaved(hostBuffers.pOutputPlanar, hostBuffers.pOutputInterleaved,
+			  nPixels, params.nChannels, nNumThreads);
+    break;
+  case CPU_BOX:
+    ConvolveBox(hostBuffers.pInput, hostBuffers.pOutputCPU,
+		params.nPitch,
+		params.nWidth, params.nHeight,
+		nFilterWidth, hostBuffers.fBoxWeight,
+		params.nBorderMode, params.fBorderValue,
+		nNumThreads);
+    break;
+  case CPU_WINOGRAD_F2:
+  case CPU_WINOGRAD_F4:
+    ConvolveWinograd(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
+		     params.nPitch,
+		     params.nWidth, params.nHeight,
+		     nFilterWidth, (engine == CPU_WINOGRAD_F4) ? 4 : 2,
+		     params.nBorderMode, params.fBorderValue,
+		     nNumThreads);
+    break;
+  case CPU_SPARSE:
+    ConvolveSparse(hostBuffers.pInput, hostBuffers.sparse, hostBuffers.pOutputCPU,
+		   params.nPitch,
+		   params.nWidth, params.nHeight,
+		   params.nBorderMode, params.fBorderValue,
+		   nNumThreads);
+    break;
+  }
+}
+
+double TimeCPU(const convolutionState& state, int engine, int nFilterWidth, int nNumThreads, int nSchedule)
+{
+  const paramStruct& params = *state.pParams;
+  timerStruct& timers = *state.pTimers;
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  if (params.bHwCounters)
+    timers.hwCounters.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+    ConvolveCPU(state, engine, nFilterWidth, nNumThreads, nSchedule);
+
+  timers.counter.Stop();
+  if (params.bHwCounters)
+    timers.hwCounters.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// Times the selected engine of the current filter under every CPU
+// schedule
+static void CompareSchedules(const convolutionState& state, int nFilterWidth, int nNumThreads)
+{
+  const paramStruct& params = *state.pParams;
+  timerStruct& timers = *state.pTimers;
+  statFileStruct& stats = *state.pStats;
+  const tileSchedulerStruct& scheduler = *state.pScheduler;
+
+  const int engine = SelectedCPUEngine(state, nFilterWidth);
+
+  cout << "Filter size = " << nFilterWidth << ": CPU schedules (" << CPUEngineName(engine) << ")";
+
+  for (int s = 0; s < SCHEDULE_COUNT; s++)
+  {
+    timers.dCpuTime = TimeCPU(state, engine, nFilterWidth, nNumThreads, s);
+    stats.schedule[s].add(nFilterWidth, timers.dCpuTime);
+
+    cout << " " << ScheduleName(s) << " = " << timers.dCpuTime << "s";
+    if (s == SCHEDULE_POOL)
+      cout << " (" << scheduler.pPool->Steals() << " steals)";
+    if (params.bHwCounters)
+      cout << HwCounterSummary(state);
+    if (params.bEnergy)
+      cout << EnergySummary(state, timers.dCpuTime);
+  }
+  cout << endl;
+}
+
+// run indexes params.ompThreads
+void RunCPU(int run)
+{
+  const int ompThreadCount = params.ompThreads[run];
+
+  cout << "\n********    Starting CPU (" << ompThreadCount << "-threads) run    ********" << endl;
+
+  // Workers live for the whole run, so the timed loops only pay for
+  // waking them
+  TilePool pool(ompThreadCount);
+  scheduler.pPool = &pool;
+  BuildTiles(params.nWidth, params.nHeight, params.nTileSize, params.nTileOrder, scheduler.tiles);
+
+  if (!params.benchmark)
+  {
+    timers.dCpuTime = TimeCPU(driverState, SelectedCPUEngine(driverState, params.nFilterWidth), params.nFilterWidth,
+			      ompThreadCount, params.nSchedule);
+
+    PrintCPUTime(run);
   }
   else
   {
@@ -204,24 +878,34 @@ void RunCPU(int ompThreadCount)
     {
       InitFilterHostBuffer(benchmarkFilterWidths[j]);
 
-      timers.counter.Reset();
-      timers.counter.Start();
+      cout << "Filter size = " << benchmarkFilterWidths[j] << ": CPU time";
 
-      for (int i = 0; i < params.nIterations; i++)
-	Convolve(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
-		 params.nInWidth,
-		 params.nWidth, params.nHeight,
-		 benchmarkFilterWidths[j],
-		 ompThreadCount);
+      for (int e = 0; e < CPU_ENGINE_COUNT; e++)
+      {
+	if (!CPUEngineEnabled(driverState, e))
+	  continue;
+	if (!CPUEngineSupported(e, benchmarkFilterWidths[j]))
+	{
+	  cout << " " << CPUEngineName(e) << " = n/a";
+	  continue;
+	}
 
-      timers.counter.Stop();
-      timers.dCpuTime = timers.counter.GetElapsedTime()/double(params.nIterations);
+	timers.dCpuTime = TimeCPU(driverState, e, benchmarkFilterWidths[j], ompThreadCount, params.nSchedule);
+	stats.cpu[e].add(benchmarkFilterWidths[j], timers.dCpuTime);
 
-      stats.cpu4Threads.add(benchmarkFilterWidths[j], timers.dCpuTime);
+	cout << " " << CPUEngineName(e) << " = " << timers.dCpuTime << "s";
+	if (params.bHwCounters)
+	  cout << HwCounterSummary(driverState);
+	if (params.bEnergy)
+	  cout << EnergySummary(driverState, timers.dCpuTime);
+      }
+      cout << endl;
 
-      cout << "Filter size = " << benchmarkFilterWidths[j] << ": CPU time = " << timers.dCpuTime << "s" << endl;
+      CompareSchedules(driverState, benchmarkFilterWidths[j], ompThreadCount);
     }
   }
+
+  scheduler.pPool = NULL;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -230,51 +914,2457 @@ void RunCPU(int ompThreadCount)
 
 #define CONVOLUTION_CL_FILENAME "convolution.cl"
 
-void RunGPU()
+const char * GPUEngineName(int engine)
+{
+  switch (engine)
+  {
+  case GPU_DIRECT: return "direct";
+  case GPU_TYPED: return DataTypeName(params.nDataType);
+  case GPU_INTERLEAVED: return "interleaved";
+  case GPU_PLANAR: return "planar";
+  case GPU_BOX: return "box";
+  case GPU_LOCAL: return "local";
+  case GPU_IMAGE: return "image";
+  case GPU_WINOGRAD_F2: return "winograd_f2";
+  case GPU_WINOGRAD_F4: return "winograd_f4";
+  case GPU_SPARSE: return "sparse";
+  case GPU_SPARSE_FIXED: return "sparse_fixed";
+  }
+  return "unknown";
+}
+bool GPUEngineEnabled(const convolutionState& state, int engine)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+
+  switch (engine)
+  {
+  case GPU_DIRECT:
+  case GPU_LOCAL:
+  case GPU_IMAGE:
+  case GPU_WINOGRAD_F2:
+  case GPU_WINOGRAD_F4: return params.nChannels == 1;
+  case GPU_TYPED: return params.nDataType != DATA_FLOAT;
+  case GPU_INTERLEAVED:
+  case GPU_PLANAR: return params.nChannels > 1;
+  case GPU_BOX: return hostBuffers.bBoxFilter && params.nChannels == 1 && params.nDataType == DATA_FLOAT;
+  case GPU_SPARSE:
+  case GPU_SPARSE_FIXED: return params.nChannels == 1 && params.nDataType == DATA_FLOAT;
+  }
+  return false;
+}
+int SelectedGPUEngine(const convolutionState& state)
 {
-  std::vector<cl::Device> devices;
-  const int targetDevice = 1;
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
 
-  cl::Context context;
-  cl::CommandQueue queue;
-  cl::Program program;
+  if (params.nChannels > 1)
+    return params.nLayout == LAYOUT_PLANAR ? GPU_PLANAR : GPU_INTERLEAVED;
+  if (params.nDataType != DATA_FLOAT)
+    return GPU_TYPED;
+  if (hostBuffers.bBoxFilter)
+    return GPU_BOX;
+  if (SparseFilterPays(hostBuffers.sparse))
+    return GPU_SPARSE_FIXED;
+  if (params.nGpuInput == GPU_INPUT_LOCAL)
+    return GPU_LOCAL;
+  if (params.nGpuInput == GPU_INPUT_IMAGE)
+    return GPU_IMAGE;
+  if (WinogradSupported(params.nFilterWidth, 4))
+    return GPU_WINOGRAD_F4;
+  if (WinogradSupported(params.nFilterWidth, 2))
+    return GPU_WINOGRAD_F2;
+  return GPU_DIRECT;
+}
 
-  CLHelpers::getAllDevices(devices);
+#define LOCAL_TILE 16		// Must match convolution.cl
 
-  context = cl::Context(devices[targetDevice]);
-  queue = cl::CommandQueue(context, devices[targetDevice]);
+static size_t LocalTileBytes(int nFilterWidth)
+{
+  const size_t nTileWidth = LOCAL_TILE + nFilterWidth - 1;
+  return nTileWidth * nTileWidth * sizeof(float);
+}
 
-  try
+// Device limits, checked per filter width
+bool GPUEngineSupported(int engine, int nFilterWidth)
+{
+  switch (engine)
   {
-    program = cl::Program(context, util::loadProgram(CONVOLUTION_CL_FILENAME));
-    program.build();
+  case GPU_LOCAL: return LocalTileBytes(nFilterWidth) <= gpuDevice.nLocalMemSize;
+  case GPU_IMAGE: return gpuDevice.bImageSupport;
+  case GPU_WINOGRAD_F2: return WinogradSupported(nFilterWidth, 2);
+  case GPU_WINOGRAD_F4: return WinogradSupported(nFilterWidth, 4);
   }
-  catch (cl::Error e)
+  return true;
+}
+
+static cl_addressing_mode ImageAddressingMode(int nBorderMode)
+{
+  switch (nBorderMode)
   {
-    std::string log;
+  case BORDER_MIRROR: return CL_ADDRESS_MIRRORED_REPEAT;
+  case BORDER_WRAP: return CL_ADDRESS_REPEAT;
+  case BORDER_CONSTANT: return CL_ADDRESS_CLAMP;
+  }
+  return CL_ADDRESS_CLAMP_TO_EDGE;
+}
+
+double RunGPUConvolution(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+			 const cl::Program& program, int engine, int nFilterWidth)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+  timerStruct& timers = *state.pTimers;
+  const char * typedKernelNames[DATA_TYPE_COUNT] = {"convolve", "convolve_u8", "convolve_u16", "convolve_half"};
+
+  if (engine == GPU_BOX)
+    return RunGPUBox(state, context, queue, program, nFilterWidth);
+  if (engine == GPU_WINOGRAD_F2 || engine == GPU_WINOGRAD_F4)
+    return RunGPUWinograd(state, context, queue, program, nFilterWidth, (engine == GPU_WINOGRAD_F4) ? 4 : 2);
+  if (engine == GPU_SPARSE || engine == GPU_SPARSE_FIXED)
+    return RunGPUSparse(state, context, queue, program, engine == GPU_SPARSE_FIXED);
+
+  const char * kernelName = "convolve";
+  void * pInput = hostBuffers.pInput;
+  size_t elemSize = sizeof(float);
+  int nPitch = params.nPitch;
+  cl::NDRange globalRange(params.nWidth, params.nHeight);
+  cl::NDRange localRange = cl::NullRange;
+
+  switch (engine)
+  {
+  case GPU_TYPED:
+    kernelName = typedKernelNames[params.nDataType];
+    pInput = hostBuffers.pInputTyped;
+    elemSize = DataTypeSize(params.nDataType);
+    nPitch = params.nTypedPitch;
+    break;
+  case GPU_INTERLEAVED:
+    kernelName = (params.nChannels == 4) ? "convolve_rgba" : "convolve_rgb";
+    pInput = hostBuffers.pInputInterleaved;
+    elemSize = params.nChannels * sizeof(float);
+    break;
+  case GPU_PLANAR:
+    kernelName = "convolve_planar";
+    pInput = hostBuffers.pInputPlanar;
+    elemSize = params.nChannels * sizeof(float);
+    globalRange = cl::NDRange(params.nWidth, params.nHeight, params.nChannels);
+    break;
+  case GPU_LOCAL:
+    kernelName = "convolve_local";
+    globalRange = cl::NDRange((params.nWidth + LOCAL_TILE - 1) / LOCAL_TILE * LOCAL_TILE,
+			      (params.nHeight + LOCAL_TILE - 1) / LOCAL_TILE * LOCAL_TILE);
+    localRange = cl::NDRange(LOCAL_TILE, LOCAL_TILE);
+    break;
+  case GPU_IMAGE:
+    kernelName = "convolve_image";
+    break;
+  }
+
+  const size_t sizeBytes = (size_t) nPitch * params.nHeight * elemSize;
+
+  // Integer modes use the fixed-point filter, everything else the float one
+  const bool bFixed = (engine == GPU_TYPED && (params.nDataType == DATA_U8 || params.nDataType == DATA_U16));
+  void * pFilter = bFixed ? (void *) hostBuffers.pFilterFixed : (void *) hostBuffers.pFilter;
+  const size_t filterSizeBytes = nFilterWidth * nFilterWidth * (bFixed ? sizeof(int32_t) : sizeof(float));
 
-    program.getBuildInfo(devices[targetDevice], CL_PROGRAM_BUILD_LOG, &log);
+  cl::Buffer filterBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filterSizeBytes, pFilter);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, sizeBytes);
 
-    fprintf(stderr, "Exception: %s\r\n", e.what());
-    fprintf(stderr, "\r\n%s\r\n", log.c_str());
+  cl::Kernel kernel(program, kernelName);
 
-    exit(EXIT_FAILURE);
+  // The image engine reads the same pitched host rows through a sampler
+  cl::Buffer inputBuffer;
+  cl::Image2D inputImage;
+  cl::Sampler sampler;
+  if (engine == GPU_IMAGE)
+  {
+    const bool bNormalized = (params.nBorderMode == BORDER_MIRROR || params.nBorderMode == BORDER_WRAP);
+    inputImage = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(CL_R, CL_FLOAT),
+			     params.nWidth, params.nHeight, nPitch * elemSize, pInput);
+    sampler = cl::Sampler(context, bNormalized ? CL_TRUE : CL_FALSE,
+			  ImageAddressingMode(params.nBorderMode), CL_FILTER_NEAREST);
+    kernel.setArg(0, inputImage);
+    kernel.setArg(9, sampler);
+  }
+  else
+  {
+    inputBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, pInput);
+    kernel.setArg(0, inputBuffer);
   }
+  kernel.setArg(1, filterBuffer);
+  kernel.setArg(2, outputBuffer);
+  kernel.setArg(3, nPitch);
+  kernel.setArg(4, nFilterWidth);
+  kernel.setArg(5, params.nWidth);
+  kernel.setArg(6, params.nHeight);
+  kernel.setArg(7, params.nBorderMode);
+  kernel.setArg(8, params.fBorderValue);
+  if (bFixed)
+    kernel.setArg(9, FILTER_FRAC_BITS);
+  if (engine == GPU_LOCAL)
+    kernel.setArg(9, cl::Local(LocalTileBytes(nFilterWidth)));
 
-  
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
 
+  for (int i = 0; i < params.nIterations; i++)
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalRange, localRange);
+  queue.finish();
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  // Multi-channel results go to the host buffer of their layout
+  void * pOutput = hostBuffers.pOutputGPU;
+  if (engine == GPU_INTERLEAVED)
+    pOutput = hostBuffers.pOutputInterleaved;
+  else if (engine == GPU_PLANAR)
+    pOutput = hostBuffers.pOutputPlanar;
+  queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, sizeBytes, pOutput);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
 }
 
-/////////////////////////////////////////////////////////////////
-// Main
-/////////////////////////////////////////////////////////////////
+#define BOX_GROUP_SIZE 256	// Must match convolution.cl
 
-int main(int argc, char * argv[])
+double RunGPUBox(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		 const cl::Program& program, int nFilterWidth)
 {
-  try
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+  timerStruct& timers = *state.pTimers;
+  const size_t sizeBytes = params.nPitch * params.nHeight * sizeof(float);
+  const int nPrefixPitch = params.nWidth + nFilterWidth;
+
+  cl::Buffer inputBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, hostBuffers.pInput);
+  cl::Buffer prefixBuffer(context, CL_MEM_READ_WRITE, nPrefixPitch * params.nHeight * sizeof(float));
+  cl::Buffer rowSumBuffer(context, CL_MEM_READ_WRITE, sizeBytes);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, sizeBytes);
+
+  cl::Kernel rowsKernel(program, "box_rows");
+  rowsKernel.setArg(0, inputBuffer);
+  rowsKernel.setArg(1, prefixBuffer);
+  rowsKernel.setArg(2, rowSumBuffer);
+  rowsKernel.setArg(3, params.nPitch);
+  rowsKernel.setArg(4, nFilterWidth);
+  rowsKernel.setArg(5, params.nWidth);
+  rowsKernel.setArg(6, params.nHeight);
+  rowsKernel.setArg(7, params.nBorderMode);
+  rowsKernel.setArg(8, params.fBorderValue);
+  rowsKernel.setArg(9, nPrefixPitch);
+
+  cl::Kernel columnsKernel(program, "box_columns");
+  columnsKernel.setArg(0, rowSumBuffer);
+  columnsKernel.setArg(1, outputBuffer);
+  columnsKernel.setArg(2, params.nPitch);
+  columnsKernel.setArg(3, nFilterWidth);
+  columnsKernel.setArg(4, params.nWidth);
+  columnsKernel.setArg(5, params.nHeight);
+  columnsKernel.setArg(6, params.nBorderMode);
+  columnsKernel.setArg(7, params.fBorderValue);
+  columnsKernel.setArg(8, hostBuffers.fBoxWeight);
+
+  const size_t columnsGlobal = (params.nWidth + 63) / 64 * 64;
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
   {
-    InitParams(argc, argv);
-    PrintInfo();
+    queue.enqueueNDRangeKernel(rowsKernel, cl::NullRange,
+			       cl::NDRange(BOX_GROUP_SIZE, params.nHeight), cl::NDRange(BOX_GROUP_SIZE, 1));
+    queue.enqueueNDRangeKernel(columnsKernel, cl::NullRange, cl::NDRange(columnsGlobal), cl::NDRange(64));
+  }
+  queue.finish();
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, sizeBytes, hostBuffers.pOutputGPU);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// The filter transform is done once on the host, see Winograd.hpp
+double RunGPUWinograd(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		      const cl::Program& program, int nFilterWidth, int nOutputTile)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+  timerStruct& timers = *state.pTimers;
+  const float * pBT;
+  const float * pAT;
+  const int nAlpha = WinogradMatrices(nFilterWidth, nOutputTile, &pBT, &pAT);
+
+  std::vector<float> transformedFilter(nAlpha * nAlpha);
+  WinogradFilterTransform(hostBuffers.pFilter, nFilterWidth, nOutputTile, &transformedFilter[0]);
+
+  const size_t sizeBytes = params.nPitch * params.nHeight * sizeof(float);
+
+  cl::Buffer inputBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, hostBuffers.pInput);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, sizeBytes);
+  cl::Buffer filterBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			  nAlpha * nAlpha * sizeof(float), &transformedFilter[0]);
+  cl::Buffer btBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		      nAlpha * nAlpha * sizeof(float), (void *) pBT);
+  cl::Buffer atBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		      nOutputTile * nAlpha * sizeof(float), (void *) pAT);
+
+  cl::Kernel kernel(program, "convolve_winograd");
+  kernel.setArg(0, inputBuffer);
+  kernel.setArg(1, filterBuffer);
+  kernel.setArg(2, outputBuffer);
+  kernel.setArg(3, params.nPitch);
+  kernel.setArg(4, nFilterWidth);
+  kernel.setArg(5, params.nWidth);
+  kernel.setArg(6, params.nHeight);
+  kernel.setArg(7, params.nBorderMode);
+  kernel.setArg(8, params.fBorderValue);
+  kernel.setArg(9, btBuffer);
+  kernel.setArg(10, atBuffer);
+  kernel.setArg(11, nOutputTile);
+
+  const cl::NDRange globalRange((params.nWidth + nOutputTile - 1) / nOutputTile,
+				(params.nHeight + nOutputTile - 1) / nOutputTile);
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, globalRange, cl::NullRange);
+  queue.finish();
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, sizeBytes, hostBuffers.pOutputGPU);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// The fixed variant builds its own program, convolution.cl followed
+// by the generated kernel; only the runs are timed
+double RunGPUSparse(const convolutionState& state, const cl::Context& context, const cl::CommandQueue& queue,
+		    const cl::Program& program, bool bFixed)
+{
+  const paramStruct& params = *state.pParams;
+  const hostBufferStruct& hostBuffers = *state.pBuffers;
+  timerStruct& timers = *state.pTimers;
+  const sparseFilter& filter = hostBuffers.sparse;
+  const size_t sizeBytes = params.nPitch * params.nHeight * sizeof(float);
+
+  cl::Buffer inputBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, hostBuffers.pInput);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, sizeBytes);
+
+  cl::Kernel kernel;
+  cl::Buffer offsetBuffer, weightBuffer;
+  if (bFixed)
+  {
+    const std::string source = util::loadProgram(CONVOLUTION_CL_FILENAME)
+      + SparseKernelSource(filter, "convolve_sparse_fixed");
+    cl::Program fixedProgram(context, source);
+    try
+    {
+      fixedProgram.build();
+    }
+    catch (cl::Error e)
+    {
+      std::vector<cl::Device> devices;
+      std::string log;
+      context.getInfo(CL_CONTEXT_DEVICES, &devices);
+      fixedProgram.getBuildInfo(devices[0], CL_PROGRAM_BUILD_LOG, &log);
+      cerr << log << endl;
+      throw(string("RunGPUSparse()::Could not build the generated kernel"));
+    }
+
+    kernel = cl::Kernel(fixedProgram, "convolve_sparse_fixed");
+    kernel.setArg(0, inputBuffer);
+    kernel.setArg(1, outputBuffer);
+    kernel.setArg(2, params.nPitch);
+    kernel.setArg(3, params.nWidth);
+    kernel.setArg(4, params.nHeight);
+    kernel.setArg(5, params.nBorderMode);
+    kernel.setArg(6, params.fBorderValue);
+  }
+  else
+  {
+    // An all-zero filter still gets one zero tap, constant buffers
+    // cannot be empty
+    const int nTaps = std::max((int) filter.taps.size(), 1);
+    std::vector<cl_int> offsets(2 * nTaps, 0);
+    std::vector<float> weights(nTaps, 0.0f);
+    for (int t = 0; t < (int) filter.taps.size(); t++)
+    {
+      offsets[2 * t] = filter.taps[t].dx;
+      offsets[2 * t + 1] = filter.taps[t].dy;
+      weights[t] = filter.taps[t].fWeight;
+    }
+
+    offsetBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, offsets.size() * sizeof(cl_int), &offsets[0]);
+    weightBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, nTaps * sizeof(float), &weights[0]);
+
+    kernel = cl::Kernel(program, "convolve_sparse");
+    kernel.setArg(0, inputBuffer);
+    kernel.setArg(1, offsetBuffer);
+    kernel.setArg(2, weightBuffer);
+    kernel.setArg(3, outputBuffer);
+    kernel.setArg(4, params.nPitch);
+    kernel.setArg(5, nTaps);
+    kernel.setArg(6, filter.nMinDx);
+    kernel.setArg(7, filter.nMinDy);
+    kernel.setArg(8, filter.nMaxDx);
+    kernel.setArg(9, filter.nMaxDy);
+    kernel.setArg(10, params.nWidth);
+    kernel.setArg(11, params.nHeight);
+    kernel.setArg(12, params.nBorderMode);
+    kernel.setArg(13, params.fBorderValue);
+  }
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(params.nWidth, params.nHeight), cl::NullRange);
+  queue.finish();
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, sizeBytes, hostBuffers.pOutputGPU);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// Calibrates the devices missing from DEVICE_SCORES_FILENAME and saves
+// their scores to it, on the first call only
+void CalibrateDevices()
+{
+  registry.Enumerate();
+  if (registry.Calibrate(util::loadProgram(CONVOLUTION_CL_FILENAME)) > 0)
+  {
+    registry.Print();
+    if (!registry.SaveScores(DEVICE_SCORES_FILENAME))
+      cerr << "Could not save " << DEVICE_SCORES_FILENAME << endl;
+  }
+}
+
+// Registry index of the device for an nWidth x nHeight image and an
+// nFilterWidth filter: params.nDevice when given, otherwise the
+// fastest by calibration. With more than one device, those missing
+// from DEVICE_SCORES_FILENAME are calibrated first and saved to it.
+int SelectDevice(int nWidth, int nHeight, int nFilterWidth)
+{
+  registry.Enumerate();
+  if (registry.Count() == 0)
+    throw(string("SelectDevice()::No OpenCL device"));
+
+  if (params.nDevice >= 0)
+  {
+    if (params.nDevice >= registry.Count())
+    {
+      std::ostringstream msg;
+      msg << "SelectDevice()::No OpenCL device " << params.nDevice << ", " << registry.Count() << " found";
+      throw(msg.str());
+    }
+    return params.nDevice;
+  }
+
+  if (registry.Count() == 1)
+    return 0;
+
+  CalibrateDevices();
+
+  const int nDevice = registry.Fastest(nWidth, nHeight, nFilterWidth);
+  return nDevice < 0 ? 0 : nDevice;
+}
+
+// Device, context, queue and built program, the setup shared by
+// single runs and the service
+void InitGPU(gpuContextStruct& gpu)
+{
+  InitGPU(gpu, SelectDevice(params.nWidth, params.nHeight, params.nFilterWidth));
+}
+
+void InitGPU(gpuContextStruct& gpu, int nDevice)
+{
+  registry.Enumerate();
+  const deviceCaps& caps = registry.Caps(nDevice);
+
+  cout << "OpenCL device:  [" << nDevice << "] " << caps.name << " (" << caps.platform << ")" << endl;
+
+  // nDevice is set last, so a failed init leaves gpu uninitialized
+  gpu.nDevice = -1;
+  gpu.device = registry.Device(nDevice);
+  gpu.context = cl::Context(gpu.device);
+  gpu.queue = cl::CommandQueue(gpu.context, gpu.device);
+  gpu.program = cl::Program(gpu.context, util::loadProgram(CONVOLUTION_CL_FILENAME));
+
+  try
+  {
+    gpu.program.build();
+  }
+  catch (cl::Error e)
+  {
+    std::string log;
+
+    gpu.program.getBuildInfo(gpu.device, CL_PROGRAM_BUILD_LOG, &log);
+    throw(string("InitGPU()::Could not build " CONVOLUTION_CL_FILENAME " for ") + caps.name + ": " + e.what() + "\n" + log);
+  }
+  gpu.nDevice = nDevice;
+
+  gpuDevice.bImageSupport = caps.bImageSupport;
+  gpuDevice.nLocalMemSize = caps.nLocalMemSize;
+}
+
+void RunGPU()
+{
+  gpuContextStruct gpu;
+  InitGPU(gpu);
+
+  const cl::Context& context = gpu.context;
+  const cl::CommandQueue& queue = gpu.queue;
+  const cl::Program& program = gpu.program;
+
+  cout << "\n********    Starting GPU run    ********" << endl;
+
+  if (params.nDataType == DATA_HALF)
+  {
+    std::string extensions;
+    gpu.device.getInfo(CL_DEVICE_EXTENSIONS, &extensions);
+    cout << "cl_khr_fp16: " << (extensions.find("cl_khr_fp16") != std::string::npos ? "yes" : "no")
+	 << " (half is used as storage only)" << endl;
+  }
+
+  if (!params.benchmark)
+  {
+    InitFilterHostBuffer(params.nFilterWidth);
+
+    const int engine = SelectedGPUEngine(driverState);
+    if (!GPUEngineSupported(engine, params.nFilterWidth))
+      throw(string("RunGPU()::") + GPUEngineName(engine) + " engine not supported by the device");
+
+    timers.dGpuTime = RunGPUConvolution(driverState, context, queue, program, engine, params.nFilterWidth);
+
+    PrintGPUTime();
+  }
+  else
+  {
+    for (int j = 0; j < BENCHMARK_FILTER_COUNT; ++j)
+    {
+      InitFilterHostBuffer(benchmarkFilterWidths[j]);
+
+      cout << "Filter size = " << benchmarkFilterWidths[j] << ": GPU time";
+
+      for (int e = 0; e < GPU_ENGINE_COUNT; e++)
+      {
+	if (!GPUEngineEnabled(driverState, e))
+	  continue;
+	if (!GPUEngineSupported(e, benchmarkFilterWidths[j]))
+	{
+	  cout << " " << GPUEngineName(e) << " = n/a";
+	  continue;
+	}
+
+	timers.dGpuTime = RunGPUConvolution(driverState, context, queue, program, e, benchmarkFilterWidths[j]);
+	stats.gpu[e].add(benchmarkFilterWidths[j], timers.dGpuTime);
+
+	cout << " " << GPUEngineName(e) << " = " << timers.dGpuTime << "s";
+	if (params.bEnergy)
+	  cout << EnergySummary(driverState, timers.dGpuTime);
+      }
+      cout << endl;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////
+// Service mode
+/////////////////////////////////////////////////////////////////
+
+// Grows the float buffers when a job needs more than any previous
+// one, so steady-state jobs do not allocate
+void ReserveServiceBuffers(int nWidth, int nHeight, int nFilterWidth)
+{
+  params.nWidth = nWidth;
+  params.nHeight = nHeight;
+  params.nPitch = AlignedPitch(nWidth, sizeof(float));
+  params.nTypedPitch = AlignedPitch(nWidth, DataTypeSize(params.nDataType));
+  params.nFilterWidth = nFilterWidth;
+
+  const size_t nSize = (size_t) params.nPitch * nHeight;
+  if (nSize > hostBuffers.nCapacity)
+  {
+    FREE(hostBuffers.pInput, NULL);
+    FREE(hostBuffers.pOutputCPU, NULL);
+    FREE(hostBuffers.pOutputGPU, NULL);
+    hostBuffers.nCapacity = 0;
+
+    hostBuffers.pInput = (float *) malloc(nSize * sizeof(float));
+    hostBuffers.pOutputCPU = (float *) malloc(nSize * sizeof(float));
+    hostBuffers.pOutputGPU = (float *) malloc(nSize * sizeof(float));
+    if (!hostBuffers.pInput || !hostBuffers.pOutputCPU || !hostBuffers.pOutputGPU)
+      throw(string("ReserveServiceBuffers()::Could not allocate memory"));
+
+    hostBuffers.nCapacity = nSize;
+  }
+
+  FREE(hostBuffers.pFilter, NULL);
+  hostBuffers.pFilter = (float *) malloc(nFilterWidth * nFilterWidth * sizeof(float));
+  if (!hostBuffers.pFilter)
+    throw(string("ReserveServiceBuffers()::Could not allocate memory"));
+}
+
+// GPU_DIRECT on the buffers of the device, reallocated only when the
+// job is larger than any before it. Returns the kernel time.
+double RunServiceGPUJob(serviceDeviceStruct& device, int nFilterWidth)
+{
+  const cl::Context& context = device.gpu.context;
+  const cl::CommandQueue& queue = device.gpu.queue;
+  const size_t imageBytes = (size_t) params.nPitch * params.nHeight * sizeof(float);
+  const size_t filterBytes = (size_t) nFilterWidth * nFilterWidth * sizeof(float);
+
+  if (imageBytes > device.nImageBytes)
+  {
+    device.nImageBytes = 0;
+    device.input = cl::Buffer(context, CL_MEM_READ_ONLY, imageBytes);
+    device.output = cl::Buffer(context, CL_MEM_WRITE_ONLY, imageBytes);
+    device.nImageBytes = imageBytes;
+  }
+  if (filterBytes > device.nFilterBytes)
+  {
+    device.nFilterBytes = 0;
+    device.filter = cl::Buffer(context, CL_MEM_READ_ONLY, filterBytes);
+    device.nFilterBytes = filterBytes;
+  }
+
+  queue.enqueueWriteBuffer(device.input, CL_FALSE, 0, imageBytes, hostBuffers.pInput);
+  queue.enqueueWriteBuffer(device.filter, CL_FALSE, 0, filterBytes, hostBuffers.pFilter);
+
+  cl::Kernel& kernel = device.kernel;
+  kernel.setArg(0, device.input);
+  kernel.setArg(1, device.filter);
+  kernel.setArg(2, device.output);
+  kernel.setArg(3, params.nPitch);
+  kernel.setArg(4, nFilterWidth);
+  kernel.setArg(5, params.nWidth);
+  kernel.setArg(6, params.nHeight);
+  kernel.setArg(7, params.nBorderMode);
+  kernel.setArg(8, params.fBorderValue);
+  queue.finish();
+
+  timers.counter.Reset();
+  timers.counter.Start();
+  queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(params.nWidth, params.nHeight), cl::NullRange);
+  queue.finish();
+  timers.counter.Stop();
+
+  queue.enqueueReadBuffer(device.output, CL_TRUE, 0, imageBytes, hostBuffers.pOutputGPU);
+  return timers.counter.GetElapsedTime();
+}
+
+static void ServiceError(serviceReply& reply, const char * pMessage)
+{
+  reply.nStatus = -1;
+  strncpy(reply.message, pMessage, sizeof(reply.message) - 1);
+}
+
+// Runs one request. Returns false when the connection is unusable,
+// job errors are reported in the reply instead
+// GPU jobs go to the device SelectDevice() picks for their size
+bool RunServiceJob(int fd, const serviceRequest& request, std::vector<serviceDeviceStruct> * pDevices, serviceReply& reply)
+{
+  memset(&reply, 0, sizeof(reply));
+
+  if (request.nMagic != SERVICE_MAGIC)
+    return false;
+
+  const int nWidth = request.nWidth;
+  const int nHeight = request.nHeight;
+  const int nFilterWidth = request.nFilterWidth;
+
+  const char * pError = NULL;
+  if (nWidth <= 0 || nHeight <= 0 || nFilterWidth <= 0 || nFilterWidth > SERVICE_MAX_FILTER_WIDTH)
+    pError = "Invalid image or filter size";
+  else if ((int64_t) nWidth * nHeight > SERVICE_MAX_PIXELS)
+    pError = "Image too large";
+  else if (request.nBorderMode < 0 || request.nBorderMode >= BORDER_MODE_COUNT)
+    pError = "Invalid border mode";
+  else if (request.nDevice == SERVICE_GPU && !pDevices)
+    pError = "GPU not initialized by this service";
+  else if (request.nDevice != SERVICE_CPU && request.nDevice != SERVICE_GPU)
+    pError = "Invalid device";
+
+  if (pError)
+  {
+    // The payload size cannot be trusted, drop the connection after replying
+    ServiceError(reply, pError);
+    SendAll(fd, &reply, sizeof(reply));
+    return false;
+  }
+
+  const size_t nRowBytes = (size_t) nWidth * sizeof(float);
+  const size_t nImageFloats = (size_t) nWidth * nHeight;
+  const size_t nFilterBytes = (size_t) nFilterWidth * nFilterWidth * sizeof(float);
+
+  try
+  {
+    ReserveServiceBuffers(nWidth, nHeight, nFilterWidth);
+  }
+  catch (string error)
+  {
+    // Skip the payload so the connection stays in step
+    cerr << "RunServiceJob(): " << error << endl;
+    ServiceError(reply, "Could not allocate memory");
+    if (!SkipAll(fd, nFilterBytes + (request.sharedName[0] ? 0 : nImageFloats * sizeof(float))))
+      return false;
+    return SendAll(fd, &reply, sizeof(reply));
+  }
+  params.nBorderMode = request.nBorderMode;
+  params.fBorderValue = request.fBorderValue;
+
+  if (!RecvAll(fd, hostBuffers.pFilter, nFilterBytes))
+    return false;
+
+  // Input rows, from the socket or the shared-memory object
+  float * pShared = NULL;
+  if (request.sharedName[0])
+  {
+    char name[SERVICE_NAME_LENGTH + 1] = {0};
+    memcpy(name, request.sharedName, SERVICE_NAME_LENGTH);
+
+    pShared = MapSharedImage(name, 2 * nImageFloats * sizeof(float), false);
+    if (!pShared)
+    {
+      reply.nStatus = -1;
+      snprintf(reply.message, sizeof(reply.message), "Could not map %s", name);
+      return SendAll(fd, &reply, sizeof(reply));
+    }
+    for (int y = 0; y < nHeight; y++)
+      memcpy(hostBuffers.pInput + (size_t) y * params.nPitch, pShared + (size_t) y * nWidth, nRowBytes);
+  }
+  else
+  {
+    for (int y = 0; y < nHeight; y++)
+      if (!RecvAll(fd, hostBuffers.pInput + (size_t) y * params.nPitch, nRowBytes))
+	return false;
+  }
+
+  // The payload is read, so a failing job leaves the connection usable
+  float * pOutput = NULL;
+  try
+  {
+    if (request.nDevice == SERVICE_GPU)
+    {
+      const int nDevice = SelectDevice(nWidth, nHeight, nFilterWidth);
+      serviceDeviceStruct& device = (*pDevices)[nDevice];
+      if (device.gpu.nDevice < 0)
+	throw(string("RunServiceJob()::OpenCL device ") + registry.Caps(nDevice).name + " failed to initialize");
+
+      reply.dComputeTime = RunServiceGPUJob(device, nFilterWidth);
+      pOutput = hostBuffers.pOutputGPU;
+    }
+    else
+    {
+      timers.counter.Reset();
+      timers.counter.Start();
+      ConvolveWithBorder(hostBuffers.pInput, hostBuffers.pFilter, hostBuffers.pOutputCPU,
+			 params.nPitch, nWidth, nHeight, nFilterWidth,
+			 params.nBorderMode, params.fBorderValue,
+			 DEFAULT_NUM_THREADS);
+      timers.counter.Stop();
+      reply.dComputeTime = timers.counter.GetElapsedTime();
+      pOutput = hostBuffers.pOutputCPU;
+    }
+  }
+  catch (cl::Error e)
+  {
+    cerr << "RunServiceJob(): " << e.what() << "(" << e.err() << ")" << endl;
+    ServiceError(reply, e.what());
+  }
+  catch (string error)
+  {
+    cerr << "RunServiceJob(): " << error << endl;
+    ServiceError(reply, error.c_str());
+  }
+  catch (std::bad_alloc&)
+  {
+    cerr << "RunServiceJob(): Out of memory" << endl;
+    ServiceError(reply, "Out of memory");
+  }
+
+  if (pShared)
+  {
+    if (pOutput)
+      for (int y = 0; y < nHeight; y++)
+	memcpy(pShared + nImageFloats + (size_t) y * nWidth, pOutput + (size_t) y * params.nPitch, nRowBytes);
+    UnmapSharedImage(pShared, 2 * nImageFloats * sizeof(float));
+    return SendAll(fd, &reply, sizeof(reply));
+  }
+
+  if (!SendAll(fd, &reply, sizeof(reply)))
+    return false;
+  if (!pOutput)
+    return true;
+  for (int y = 0; y < nHeight; y++)
+    if (!SendAll(fd, pOutput + (size_t) y * params.nPitch, nRowBytes))
+      return false;
+  return true;
+}
+
+// Context, program and kernel of every device, and the calibration
+// SelectDevice() needs, before the first job. A device that fails is
+// left uninitialized and its jobs are answered with an error.
+void InitServiceDevices(std::vector<serviceDeviceStruct>& devices)
+{
+  devices.resize(registry.Count());
+  for (int i = 0; i < registry.Count(); i++)
+  {
+    serviceDeviceStruct& device = devices[i];
+    device.nImageBytes = 0;
+    device.nFilterBytes = 0;
+
+    try
+    {
+      InitGPU(device.gpu, i);
+      device.kernel = cl::Kernel(device.gpu.program, "convolve");
+    }
+    catch (cl::Error e)
+    {
+      cerr << "InitServiceDevices(): " << e.what() << "(" << e.err() << ")" << endl;
+      device.gpu.nDevice = -1;
+    }
+    catch (string error)
+    {
+      cerr << "InitServiceDevices(): " << error << endl;
+      device.gpu.nDevice = -1;
+    }
+  }
+
+  if (params.nDevice < 0 && registry.Count() > 1)
+    CalibrateDevices();
+}
+
+void RunService()
+{
+  // Jobs are single float images, one pass each
+  params.nDataType = DATA_FLOAT;
+  params.nChannels = 1;
+  params.nIterations = 1;
+
+  // Without a device, -m -1 still serves CPU jobs
+  std::vector<serviceDeviceStruct> devices;
+  if (params.nMode != 0)
+  {
+    try
+    {
+      registry.Enumerate();
+    }
+    catch (cl::Error e)
+    {
+      cerr << "RunService(): " << e.what() << "(" << e.err() << ")" << endl;
+    }
+
+    if (registry.Count() > 0)
+      InitServiceDevices(devices);
+    else if (params.nMode == 1)
+      throw(string("RunService()::No OpenCL device"));
+    else
+      cerr << "Warning: no OpenCL device, serving CPU jobs only" << endl;
+  }
+
+  int listenFd = ServiceListen(params.pServicePath);
+  if (listenFd < 0)
+    throw(string("RunService()::Could not listen on ") + params.pServicePath + ": " + strerror(errno));
+
+  cout << "Convolution service listening on " << params.pServicePath << endl;
+
+  bool bRunning = true;
+  while (bRunning)
+  {
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+
+    serviceRequest request;
+    while (RecvAll(fd, &request, sizeof(request)))
+    {
+      if (request.nMagic == SERVICE_MAGIC && request.nCommand == SERVICE_SHUTDOWN)
+      {
+	bRunning = false;
+	break;
+      }
+
+      // Anything RunServiceJob() did not answer leaves the payload
+      // half read: reply, drop the connection and keep serving
+      serviceReply reply;
+      bool bOk = false;
+      try
+      {
+	bOk = RunServiceJob(fd, request, devices.empty() ? NULL : &devices, reply);
+      }
+      catch (cl::Error e)
+      {
+	cerr << "RunService(): " << e.what() << "(" << e.err() << ")" << endl;
+	ServiceError(reply, e.what());
+	SendAll(fd, &reply, sizeof(reply));
+      }
+      catch (string error)
+      {
+	cerr << "RunService(): " << error << endl;
+	ServiceError(reply, error.c_str());
+	SendAll(fd, &reply, sizeof(reply));
+      }
+      catch (std::exception& e)
+      {
+	cerr << "RunService(): " << e.what() << endl;
+	ServiceError(reply, e.what());
+	SendAll(fd, &reply, sizeof(reply));
+      }
+      if (!bOk)
+	break;
+    }
+    close(fd);
+  }
+
+  close(listenFd);
+  unlink(params.pServicePath);
+}
+
+/////////////////////////////////////////////////////////////////
+// Ring ingest mode
+/////////////////////////////////////////////////////////////////
+
+void PrintRingMetrics(const frameRing& input, const frameRing& output, double dSeconds)
+{
+  const frameRingHeader * in = input.pHeader;
+  const frameRingHeader * out = output.pHeader;
+
+  cout << "Frames: " << out->head
+       << "  fps: " << std::fixed << std::setprecision(1) << out->head / dSeconds
+       << std::defaultfloat << std::setprecision(6)
+       << "  depth in/out: " << FrameRingDepth(input) << "/" << FrameRingDepth(output)
+       << "  max: " << in->nMaxDepth << "/" << out->nMaxDepth
+       << "  idle waits: " << in->nReaderWaits
+       << "  output stalls: " << out->nWriterWaits << endl;
+}
+
+// Frames are convolved straight from the input slot into the output
+// slot. The engine owns both rings and a producer process attaches to
+// them: it writes /<name>_in and reads the results from /<name>_out.
+void RunFrameRings()
+{
+  const string inName = string("/") + params.pRingName + "_in";
+  const string outName = string("/") + params.pRingName + "_out";
+
+  frameRing input, output;
+  if (!CreateFrameRing(input, inName.c_str(), FRAME_RING_SLOTS, params.nWidth, params.nHeight, params.nPitch) ||
+      !CreateFrameRing(output, outName.c_str(), FRAME_RING_SLOTS, params.nWidth, params.nHeight, params.nPitch))
+    throw(string("RunFrameRings()::Could not create ") + params.pRingName + " rings: " + strerror(errno));
+
+  InitFilterHostBuffer(params.nFilterWidth);
+
+  cout << "Waiting for frames on " << inName << ", results go to " << outName << endl;
+
+  // Rates are measured from the first frame, not from startup
+  uint64_t nStart = 0;
+  double dLastReport = 0;
+
+  uint64_t nTimestamp;
+  float * pIn;
+  while ((pIn = AcquireReadSlot(input, true, &nTimestamp)) != NULL)
+  {
+    if (!nStart)
+      nStart = MonotonicNanoseconds();
+
+    // Waiting here is the backpressure from a slow result reader
+    float * pOut = AcquireWriteSlot(output, true);
+
+    ConvolveWithBorder(pIn, hostBuffers.pFilter, pOut,
+		       params.nPitch, params.nWidth, params.nHeight, params.nFilterWidth,
+		       params.nBorderMode, params.fBorderValue,
+		       DEFAULT_NUM_THREADS);
+
+    // The input timestamp travels with the frame for end-to-end latency
+    PublishSlot(output, nTimestamp);
+    ReleaseSlot(input);
+
+    const double dNow = (MonotonicNanoseconds() - nStart) * 1e-9;
+    if (dNow - dLastReport >= 1.0)
+    {
+      PrintRingMetrics(input, output, dNow);
+      dLastReport = dNow;
+    }
+  }
+
+  CloseFrameRingWriter(output);
+  if (nStart)
+    PrintRingMetrics(input, output, (MonotonicNanoseconds() - nStart) * 1e-9);
+
+  CloseFrameRing(input, true);
+  CloseFrameRing(output, true);
+}
+
+/////////////////////////////////////////////////////////////////
+// Job executor benchmark
+/////////////////////////////////////////////////////////////////
+
+// The job's engine over one tile covering its image, on the calling
+// thread
+static void RunConvolutionJob(convolutionJob& job)
+{
+  const paramStruct& params = *job.pState->pParams;
+  const imageRect image = {0, 0, params.nWidth, params.nHeight};
+
+  const double dStart = omp_get_wtime();
+  ConvolveCPUTile(*job.pState, job.engine, job.nFilterWidth, image);
+  job.dComputeTime = omp_get_wtime() - dStart;
+}
+
+// params.nJobs independent float images, first one at a time with the
+// whole OpenMP team, then spread over the job executor. Every job has
+// its own state: the parameters with a float single-channel image and
+// the host buffers with its input and output, sharing the filter.
+void RunJobs()
+{
+  const int nJobs = params.nJobs;
+  const size_t nImageSize = (size_t) params.nPitch * params.nHeight;
+  const int nWorkers = omp_get_num_procs();
+
+  float * pInputs = (float *) malloc(nJobs * nImageSize * sizeof(float));
+  float * pOutputs = (float *) malloc(nJobs * nImageSize * sizeof(float));
+  float * pReference = (float *) malloc(nJobs * nImageSize * sizeof(float));
+  if (!pInputs || !pOutputs || !pReference)
+  {
+    FREE(pInputs, NULL);
+    FREE(pOutputs, NULL);
+    FREE(pReference, NULL);
+    throw(string("RunJobs()::Could not allocate memory"));
+  }
+
+  FillUniform(pInputs, nJobs * nImageSize, params.nSeed, WORKLOAD_STREAM_JOBS, DEFAULT_NUM_THREADS);
+
+  InitFilterHostBuffer(params.nFilterWidth);
+
+  paramStruct jobParams = params;
+  jobParams.nDataType = DATA_FLOAT;
+  jobParams.nChannels = 1;
+
+  std::vector<hostBufferStruct> buffers(nJobs, hostBuffers);
+  std::vector<convolutionState> states(nJobs, driverState);
+  std::vector<convolutionJob> jobs(nJobs);
+  for (int j = 0; j < nJobs; j++)
+  {
+    buffers[j].pInput = pInputs + j * nImageSize;
+    buffers[j].pOutputCPU = pOutputs + j * nImageSize;
+
+    states[j].pParams = &jobParams;
+    states[j].pBuffers = &buffers[j];
+    states[j].pTimers = NULL;
+    states[j].pStats = NULL;
+    states[j].pScheduler = NULL;
+
+    jobs[j].pState = &states[j];
+    jobs[j].engine = SelectedCPUEngine(states[j], params.nFilterWidth);
+    jobs[j].nFilterWidth = params.nFilterWidth;
+    jobs[j].dComputeTime = 0;
+  }
+
+  cout << "\n********    Starting job executor run    ********" << endl;
+
+  timers.counter.Reset();
+  timers.counter.Start();
+  for (int i = 0; i < params.nIterations; i++)
+    for (int j = 0; j < nJobs; j++)
+      ConvolveWithBorder(pInputs + j * nImageSize, hostBuffers.pFilter, pReference + j * nImageSize,
+			 params.nPitch, params.nWidth, params.nHeight, params.nFilterWidth,
+			 params.nBorderMode, params.fBorderValue,
+			 DEFAULT_NUM_THREADS);
+  timers.counter.Stop();
+  const double dSequential = timers.counter.GetElapsedTime() / params.nIterations;
+
+  JobExecutor executor(nWorkers, RunConvolutionJob);
+
+  timers.counter.Reset();
+  timers.counter.Start();
+  for (int i = 0; i < params.nIterations; i++)
+  {
+    executor.Submit(&jobs[0], nJobs);
+    executor.Wait();
+  }
+  timers.counter.Stop();
+  const double dExecutor = timers.counter.GetElapsedTime() / params.nIterations;
+
+  double dMaxDiff = 0;
+  double dComputeTime = 0;
+  for (int j = 0; j < nJobs; j++)
+  {
+    for (int y = 0; y < params.nHeight; y++)
+      for (int x = 0; x < params.nWidth; x++)
+      {
+	const size_t i = j * nImageSize + y * params.nPitch + x;
+	dMaxDiff = std::max(dMaxDiff, (double) fabsf(pOutputs[i] - pReference[i]));
+      }
+    dComputeTime += jobs[j].dComputeTime;
+  }
+
+  cout << nJobs << " jobs of " << params.nWidth << " x " << params.nHeight << ", "
+       << CPUEngineName(jobs[0].engine) << " engine" << endl;
+  cout << "One at a time (" << DEFAULT_NUM_THREADS << "-thread team): " << dSequential << "s, "
+       << nJobs / dSequential << " jobs/s" << endl;
+  cout << "Job executor (" << executor.Workers() << " workers):  " << dExecutor << "s, "
+       << nJobs / dExecutor << " jobs/s, " << dComputeTime / nJobs << "s per job" << endl;
+  cout << "Max difference: " << dMaxDiff << endl;
+
+  FREE(pInputs, NULL);
+  FREE(pOutputs, NULL);
+  FREE(pReference, NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+// Filter pipeline benchmark
+/////////////////////////////////////////////////////////////////
+
+// Normalized random taps, as InitFilterHostBuffer()
+void InitPipelineFilters(std::vector<pipelineStage>& stages)
+{
+  for (size_t i = 0; i < stages.size(); i++)
+  {
+    if (stages[i].nType != STAGE_CONVOLVE)
+      continue;
+
+    const int nFilterSize = stages[i].nFilterWidth * stages[i].nFilterWidth;
+    stages[i].pFilter = (float *) malloc(nFilterSize * sizeof(float));
+    if (!stages[i].pFilter)
+      throw(string("InitPipelineFilters()::Could not allocate memory"));
+
+    double dFilterSum = 0;
+    for (int j = 0; j < nFilterSize; j++)
+    {
+      stages[i].pFilter[j] = WorkloadUniform(params.nSeed, WORKLOAD_STREAM_PIPELINE + i, j);
+      dFilterSum += stages[i].pFilter[j];
+    }
+    for (int j = 0; j < nFilterSize; j++)
+      stages[i].pFilter[j] /= dFilterSum;
+  }
+}
+void ReleasePipelineFilters(std::vector<pipelineStage>& stages)
+{
+  for (size_t i = 0; i < stages.size(); i++)
+    FREE(stages[i].pFilter, NULL);
+}
+
+double TimePipelineCPU(const std::vector<pipelineStage>& stages, bool bFused)
+{
+  float * pOutput = bFused ? hostBuffers.pOutputCPU : hostBuffers.pOutputGPU;
+
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+    RunPipeline(hostBuffers.pInput, pOutput, params.nPitch, params.nWidth, params.nHeight,
+		stages, params.nBorderMode, params.fBorderValue, bFused, DEFAULT_NUM_THREADS);
+
+  timers.counter.Stop();
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// Pointwise op codes and arguments in the layout of apply_ops()
+static void PackPipelineOps(const std::vector<pipelineStage>& ops,
+			    std::vector<cl_int>& codes, std::vector<float>& args)
+{
+  for (size_t i = 0; i < ops.size(); i++)
+  {
+    codes.push_back(ops[i].nType);
+    args.push_back(ops[i].fA);
+    args.push_back(ops[i].fB);
+  }
+}
+
+struct pipelineLaunch
+{
+  cl::Kernel kernel;
+  cl::NDRange globalRange;
+  cl::NDRange localRange;
+};
+
+// All stages are enqueued back to back on device buffers and only the
+// final image is read back. The fused chain runs pairs of consecutive
+// convolutions in pipeline_convolve2 and folds pointwise ops into the
+// convolution before them; the unfused chain launches one kernel per
+// stage and op.
+double RunGPUPipeline(const gpuContextStruct& gpu, const std::vector<pipelineStage>& stages, bool bFused)
+{
+  const size_t sizeBytes = params.nPitch * params.nHeight * sizeof(float);
+  const cl::NDRange imageRange(params.nWidth, params.nHeight);
+  const cl::NDRange tileRange((params.nWidth + LOCAL_TILE - 1) / LOCAL_TILE * LOCAL_TILE,
+			      (params.nHeight + LOCAL_TILE - 1) / LOCAL_TILE * LOCAL_TILE);
+  const bool bFusable = bFused && PipelineFusable(params.nBorderMode);
+
+  cl::Buffer inputBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, hostBuffers.pInput);
+  cl::Buffer pingPong[2] = {cl::Buffer(gpu.context, CL_MEM_READ_WRITE, sizeBytes),
+			    cl::Buffer(gpu.context, CL_MEM_READ_WRITE, sizeBytes)};
+
+  // Kernels keep references to these until the queue is finished
+  std::vector<cl::Buffer> constants;
+  std::vector<pipelineLaunch> launches;
+
+  const cl::Buffer * pCurrent = &inputBuffer;
+  int nNext = 0;
+
+  size_t i = 0;
+  while (i < stages.size())
+  {
+    // The next convolution or pointwise op and the ops folded into it
+    const bool bConvolve = (stages[i].nType == STAGE_CONVOLVE);
+    size_t nEnd = i + 1;
+    if (bFused)
+      while (nEnd < stages.size() && stages[nEnd].nType != STAGE_CONVOLVE)
+	nEnd++;
+
+    // A second convolution fused into the same launch
+    size_t nEnd2 = nEnd;
+    if (bConvolve && bFusable && nEnd < stages.size())
+    {
+      nEnd2 = nEnd + 1;
+      while (nEnd2 < stages.size() && stages[nEnd2].nType != STAGE_CONVOLVE)
+	nEnd2++;
+
+      const size_t nMidWidth = LOCAL_TILE + stages[nEnd].nFilterWidth - 1;
+      const size_t nTileWidth = nMidWidth + stages[i].nFilterWidth - 1;
+      if ((nMidWidth * nMidWidth + nTileWidth * nTileWidth) * sizeof(float) > gpuDevice.nLocalMemSize)
+	nEnd2 = nEnd;
+    }
+
+    const bool bPair = (nEnd2 > nEnd);
+    const size_t nOpsBegin = bConvolve ? i + 1 : i;
+
+    std::vector<pipelineStage> ops(stages.begin() + nOpsBegin, stages.begin() + nEnd);
+    std::vector<cl_int> codes;
+    std::vector<float> args;
+    PackPipelineOps(ops, codes, args);
+    if (bPair)
+      PackPipelineOps(std::vector<pipelineStage>(stages.begin() + nEnd + 1, stages.begin() + nEnd2), codes, args);
+    codes.push_back(0);	// No zero-sized buffers
+    args.push_back(0);
+
+    cl::Buffer codeBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, codes.size() * sizeof(cl_int), &codes[0]);
+    cl::Buffer argBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, args.size() * sizeof(float), &args[0]);
+    constants.push_back(codeBuffer);
+    constants.push_back(argBuffer);
+
+    pipelineLaunch launch;
+    launch.globalRange = imageRange;
+    launch.localRange = cl::NullRange;
+
+    if (!bConvolve)
+    {
+      launch.kernel = cl::Kernel(gpu.program, "pipeline_pointwise");
+      launch.kernel.setArg(0, *pCurrent);
+      launch.kernel.setArg(1, pingPong[nNext]);
+      launch.kernel.setArg(2, params.nPitch);
+      launch.kernel.setArg(3, codeBuffer);
+      launch.kernel.setArg(4, argBuffer);
+      launch.kernel.setArg(5, (cl_int) ops.size());
+    }
+    else
+    {
+      const int nFilterWidth = stages[i].nFilterWidth;
+      cl::Buffer filterBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			      nFilterWidth * nFilterWidth * sizeof(float), stages[i].pFilter);
+      constants.push_back(filterBuffer);
+
+      int arg = 0;
+      launch.kernel = cl::Kernel(gpu.program, bPair ? "pipeline_convolve2" : "pipeline_convolve");
+      launch.kernel.setArg(arg++, *pCurrent);
+      launch.kernel.setArg(arg++, filterBuffer);
+      if (bPair)
+      {
+	const int nFilterWidth2 = stages[nEnd].nFilterWidth;
+	cl::Buffer filterBuffer2(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+				 nFilterWidth2 * nFilterWidth2 * sizeof(float), stages[nEnd].pFilter);
+	constants.push_back(filterBuffer2);
+
+	launch.kernel.setArg(arg++, filterBuffer2);
+	launch.kernel.setArg(arg++, pingPong[nNext]);
+	launch.kernel.setArg(arg++, params.nPitch);
+	launch.kernel.setArg(arg++, nFilterWidth);
+	launch.kernel.setArg(arg++, nFilterWidth2);
+      }
+      else
+      {
+	launch.kernel.setArg(arg++, pingPong[nNext]);
+	launch.kernel.setArg(arg++, params.nPitch);
+	launch.kernel.setArg(arg++, nFilterWidth);
+      }
+      launch.kernel.setArg(arg++, params.nWidth);
+      launch.kernel.setArg(arg++, params.nHeight);
+      launch.kernel.setArg(arg++, params.nBorderMode);
+      launch.kernel.setArg(arg++, params.fBorderValue);
+      launch.kernel.setArg(arg++, codeBuffer);
+      launch.kernel.setArg(arg++, argBuffer);
+      launch.kernel.setArg(arg++, (cl_int) ops.size());
+      if (bPair)
+      {
+	const size_t nMidWidth = LOCAL_TILE + stages[nEnd].nFilterWidth - 1;
+	const size_t nTileWidth = nMidWidth + nFilterWidth - 1;
+
+	launch.kernel.setArg(arg++, (cl_int) (nEnd2 - nEnd - 1));
+	launch.kernel.setArg(arg++, cl::Local(nTileWidth * nTileWidth * sizeof(float)));
+	launch.kernel.setArg(arg++, cl::Local(nMidWidth * nMidWidth * sizeof(float)));
+	launch.globalRange = tileRange;
+	launch.localRange = cl::NDRange(LOCAL_TILE, LOCAL_TILE);
+      }
+    }
+
+    launches.push_back(launch);
+    pCurrent = &pingPong[nNext];
+    nNext = 1 - nNext;
+    i = bPair ? nEnd2 : nEnd;
+  }
+
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int it = 0; it < params.nIterations; it++)
+    for (size_t l = 0; l < launches.size(); l++)
+      gpu.queue.enqueueNDRangeKernel(launches[l].kernel, cl::NullRange,
+				     launches[l].globalRange, launches[l].localRange);
+  gpu.queue.finish();
+
+  timers.counter.Stop();
+
+  gpu.queue.enqueueReadBuffer(*pCurrent, CL_TRUE, 0, sizeBytes, hostBuffers.pOutputGPU);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+static double MaxDifference(const float * pA, const float * pB)
+{
+  double dMaxDiff = 0;
+  for (int y = 0; y < params.nHeight; y++)
+    for (int x = 0; x < params.nWidth; x++)
+      dMaxDiff = std::max(dMaxDiff, (double) fabsf(pA[y * params.nPitch + x] - pB[y * params.nPitch + x]));
+  return dMaxDiff;
+}
+
+void RunPipelineBenchmark()
+{
+  std::vector<pipelineStage> stages;
+  if (!ParsePipeline(params.pPipeline, stages))
+    throw(string("RunPipelineBenchmark()::Invalid pipeline ") + params.pPipeline);
+
+  InitPipelineFilters(stages);
+
+  cout << "Pipeline:       " << params.pPipeline << " (" << stages.size() << " stages)" << endl;
+  if (!PipelineFusable(params.nBorderMode))
+    cout << "Wrap borders are not fused, both runs are stage by stage" << endl;
+
+  if (params.nMode < 1)
+  {
+    cout << "\n********    Starting CPU (" << DEFAULT_NUM_THREADS << "-threads) pipeline run    ********" << endl;
+
+    const double dUnfused = TimePipelineCPU(stages, false);
+    const double dFused = TimePipelineCPU(stages, true);
+
+    cout << "CPU time unfused = " << dUnfused << "s fused = " << dFused << "s" << endl;
+    cout << "Max difference: " << MaxDifference(hostBuffers.pOutputCPU, hostBuffers.pOutputGPU) << endl;
+  }
+
+  if (params.nMode != 0)
+  {
+    gpuContextStruct gpu;
+    InitGPU(gpu);
+
+    cout << "\n********    Starting GPU pipeline run    ********" << endl;
+
+    // The CPU buffer keeps the unfused result for the comparison
+    const double dUnfused = RunGPUPipeline(gpu, stages, false);
+    memcpy(hostBuffers.pOutputCPU, hostBuffers.pOutputGPU, params.nPitch * params.nHeight * sizeof(float));
+    const double dFused = RunGPUPipeline(gpu, stages, true);
+
+    cout << "GPU time unfused = " << dUnfused << "s fused = " << dFused << "s" << endl;
+    cout << "Max difference: " << MaxDifference(hostBuffers.pOutputCPU, hostBuffers.pOutputGPU) << endl;
+  }
+
+  ReleasePipelineFilters(stages);
+}
+
+/////////////////////////////////////////////////////////////////
+// Pyramid benchmark
+/////////////////////////////////////////////////////////////////
+
+// Largest difference relative to the largest magnitude of pReference
+static double RelativeDifference(const float * pA, const float * pReference, int nWidth, int nHeight, int nPitch)
+{
+  double dMaxDiff = 0, dMaxValue = 0;
+  for (int y = 0; y < nHeight; y++)
+    for (int x = 0; x < nWidth; x++)
+    {
+      dMaxDiff = std::max(dMaxDiff, (double) fabsf(pA[y * nPitch + x] - pReference[y * nPitch + x]));
+      dMaxValue = std::max(dMaxValue, (double) fabsf(pReference[y * nPitch + x]));
+    }
+  return dMaxValue > 0 ? dMaxDiff / dMaxValue : dMaxDiff;
+}
+
+static void PrintPyramidTimes(const std::vector<pyramidLevel>& levels)
+{
+  double dTotal = 0;
+  for (size_t k = 0; k < levels.size(); k++)
+  {
+    cout << "Level " << k << ": " << setw(5) << levels[k].nWidth << " x " << setw(5) << levels[k].nHeight
+	 << "  reduce " << levels[k].dReduceTime << "s  expand " << levels[k].dExpandTime << "s" << endl;
+    dTotal += levels[k].dReduceTime + levels[k].dExpandTime;
+  }
+  cout << "Total: " << dTotal << "s" << endl;
+}
+
+// Every reduction, then every expansion, enqueued as one batch per
+// iteration on a profiling queue. Level buffers are created once and
+// reused by every iteration; the level times are the mean kernel
+// times of the events. levels holds the CPU pyramid and is compared
+// against the device result.
+void RunGPUPyramid(const gpuContextStruct& gpu, const float * pFilter, std::vector<pyramidLevel>& levels)
+{
+  const int nLevels = (int) levels.size();
+  const int nFilterWidth = params.nFilterWidth;
+
+  cl::CommandQueue queue(gpu.context, gpu.device, CL_QUEUE_PROFILING_ENABLE);
+  cl::Buffer filterBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			  nFilterWidth * nFilterWidth * sizeof(float), (void *) pFilter);
+
+  std::vector<cl::Buffer> gaussians, laplacians;
+  for (int k = 0; k < nLevels; k++)
+  {
+    const size_t sizeBytes = levels[k].nPitch * levels[k].nHeight * sizeof(float);
+    if (k == 0)
+      gaussians.push_back(cl::Buffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeBytes, hostBuffers.pInput));
+    else
+      gaussians.push_back(cl::Buffer(gpu.context, CL_MEM_READ_WRITE, sizeBytes));
+    laplacians.push_back(cl::Buffer(gpu.context, CL_MEM_READ_WRITE, sizeBytes));
+  }
+
+  std::vector<cl::Kernel> reduce(nLevels), expand(nLevels);
+  for (int k = 1; k < nLevels; k++)
+  {
+    reduce[k] = cl::Kernel(gpu.program, "pyramid_reduce");
+    reduce[k].setArg(0, gaussians[k-1]);
+    reduce[k].setArg(1, filterBuffer);
+    reduce[k].setArg(2, gaussians[k]);
+    reduce[k].setArg(3, levels[k-1].nPitch);
+    reduce[k].setArg(4, levels[k].nPitch);
+    reduce[k].setArg(5, nFilterWidth);
+    reduce[k].setArg(6, levels[k-1].nWidth);
+    reduce[k].setArg(7, levels[k-1].nHeight);
+    reduce[k].setArg(8, params.nBorderMode);
+    reduce[k].setArg(9, params.fBorderValue);
+
+    expand[k-1] = cl::Kernel(gpu.program, "pyramid_expand");
+    expand[k-1].setArg(0, gaussians[k]);
+    expand[k-1].setArg(1, gaussians[k-1]);
+    expand[k-1].setArg(2, filterBuffer);
+    expand[k-1].setArg(3, laplacians[k-1]);
+    expand[k-1].setArg(4, levels[k].nPitch);
+    expand[k-1].setArg(5, levels[k-1].nPitch);
+    expand[k-1].setArg(6, nFilterWidth);
+    expand[k-1].setArg(7, levels[k].nWidth);
+    expand[k-1].setArg(8, levels[k].nHeight);
+    expand[k-1].setArg(9, params.nBorderMode);
+    expand[k-1].setArg(10, params.fBorderValue);
+    expand[k-1].setArg(11, -1.0f);
+  }
+
+  std::vector<cl::Event> reduceEvents(params.nIterations * nLevels);
+  std::vector<cl::Event> expandEvents(params.nIterations * nLevels);
+
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+  {
+    for (int k = 1; k < nLevels; k++)
+      queue.enqueueNDRangeKernel(reduce[k], cl::NullRange, cl::NDRange(levels[k].nWidth, levels[k].nHeight),
+				 cl::NullRange, NULL, &reduceEvents[i * nLevels + k]);
+    for (int k = 0; k + 1 < nLevels; k++)
+      queue.enqueueNDRangeKernel(expand[k], cl::NullRange, cl::NDRange(levels[k].nWidth, levels[k].nHeight),
+				 cl::NullRange, NULL, &expandEvents[i * nLevels + k]);
+  }
+  queue.finish();
+
+  timers.counter.Stop();
+
+  std::vector<pyramidLevel> deviceLevels = levels;
+  for (int k = 0; k < nLevels; k++)
+  {
+    deviceLevels[k].dReduceTime = 0;
+    deviceLevels[k].dExpandTime = 0;
+    for (int i = 0; i < params.nIterations; i++)
+    {
+      cl_ulong nStart = 0, nEnd = 0;
+      if (k > 0)
+      {
+	reduceEvents[i * nLevels + k].getProfilingInfo(CL_PROFILING_COMMAND_START, &nStart);
+	reduceEvents[i * nLevels + k].getProfilingInfo(CL_PROFILING_COMMAND_END, &nEnd);
+	deviceLevels[k].dReduceTime += (nEnd - nStart) * 1e-9 / params.nIterations;
+      }
+      if (k + 1 < nLevels)
+      {
+	expandEvents[i * nLevels + k].getProfilingInfo(CL_PROFILING_COMMAND_START, &nStart);
+	expandEvents[i * nLevels + k].getProfilingInfo(CL_PROFILING_COMMAND_END, &nEnd);
+	deviceLevels[k].dExpandTime += (nEnd - nStart) * 1e-9 / params.nIterations;
+      }
+    }
+  }
+
+  PrintPyramidTimes(deviceLevels);
+  cout << "Batch time: " << timers.counter.GetElapsedTime()/double(params.nIterations) << "s" << endl;
+
+  // The device Laplacian of level 0 and top level against the CPU ones
+  const int nTop = nLevels - 1;
+  float * pTop = (float *) malloc(levels[nTop].nPitch * levels[nTop].nHeight * sizeof(float));
+  if (!pTop)
+    throw(string("RunGPUPyramid()::Could not allocate memory"));
+
+  queue.enqueueReadBuffer(gaussians[nTop], CL_TRUE, 0, levels[nTop].nPitch * levels[nTop].nHeight * sizeof(float), pTop);
+  cout << "Top level relative difference: "
+       << RelativeDifference(pTop, levels[nTop].pGaussian, levels[nTop].nWidth, levels[nTop].nHeight, levels[nTop].nPitch) << endl;
+  if (nTop > 0)
+  {
+    queue.enqueueReadBuffer(laplacians[0], CL_TRUE, 0, params.nPitch * params.nHeight * sizeof(float), hostBuffers.pOutputGPU);
+    cout << "Level 0 Laplacian relative difference: "
+	 << RelativeDifference(hostBuffers.pOutputGPU, levels[0].pLaplacian, params.nWidth, params.nHeight, params.nPitch) << endl;
+  }
+
+  FREE(pTop, NULL);
+}
+
+void RunPyramid()
+{
+  const int nFilterWidth = params.nFilterWidth;
+  float * pFilter = (float *) malloc(nFilterWidth * nFilterWidth * sizeof(float));
+  if (!pFilter)
+    throw(string("RunPyramid()::Could not allocate memory"));
+  InitBinomialFilter(pFilter, nFilterWidth);
+
+  BufferPool pool;
+  std::vector<pyramidLevel> levels;
+
+  cout << "\n********    Starting CPU (" << DEFAULT_NUM_THREADS << "-threads) pyramid run    ********" << endl;
+
+  // Level times are means over the iterations
+  std::vector<double> reduceTimes, expandTimes;
+  for (int i = 0; i < params.nIterations; i++)
+  {
+    if (i > 0)
+      ReleasePyramid(levels, pool);
+    BuildPyramid(hostBuffers.pInput, params.nPitch, params.nWidth, params.nHeight,
+		 pFilter, nFilterWidth, params.nPyramidLevels,
+		 params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS, pool, levels);
+
+    reduceTimes.resize(levels.size(), 0);
+    expandTimes.resize(levels.size(), 0);
+    for (size_t k = 0; k < levels.size(); k++)
+    {
+      reduceTimes[k] += levels[k].dReduceTime / params.nIterations;
+      expandTimes[k] += levels[k].dExpandTime / params.nIterations;
+    }
+  }
+  for (size_t k = 0; k < levels.size(); k++)
+  {
+    levels[k].dReduceTime = reduceTimes[k];
+    levels[k].dExpandTime = expandTimes[k];
+  }
+
+  PrintPyramidTimes(levels);
+  cout << "Pool allocations: " << pool.Allocations() << " over " << params.nIterations << " builds" << endl;
+
+  CollapsePyramid(levels, pFilter, nFilterWidth, params.nBorderMode, params.fBorderValue,
+		  DEFAULT_NUM_THREADS, pool, hostBuffers.pOutputCPU);
+  cout << "Rebuild relative difference: "
+       << RelativeDifference(hostBuffers.pOutputCPU, hostBuffers.pInput, params.nWidth, params.nHeight, params.nPitch) << endl;
+
+  if (params.nMode != 0)
+  {
+    gpuContextStruct gpu;
+    InitGPU(gpu);
+
+    cout << "\n********    Starting GPU pyramid run    ********" << endl;
+    RunGPUPyramid(gpu, pFilter, levels);
+  }
+
+  ReleasePyramid(levels, pool);
+  FREE(pFilter, NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+// Filter bank benchmark
+/////////////////////////////////////////////////////////////////
+
+// nFilters filters of width params.nFilterWidth, filter f taking the
+// workload counters after filter f - 1
+void InitBankFilters(float * pFilters, int nFilters)
+{
+  const int nFilterSize = params.nFilterWidth * params.nFilterWidth;
+
+  for (int f = 0; f < nFilters; f++)
+    InitFilterTaps(pFilters + f * nFilterSize, params.nFilterWidth, f * nFilterSize);
+}
+
+static void PrintBankTime(int nFilters, double dTime)
+{
+  const double dFlops = 2.0 * nFilters * params.nFilterWidth * params.nFilterWidth
+    * params.nWidth * params.nHeight;
+
+  cout << setw(12) << dTime << "s  " << setw(10) << nFilters / dTime << " filters/s  "
+       << setw(8) << dFlops / dTime * 1e-9 << " GFLOP/s";
+}
+
+// The padded input is built on the host with PadImage(), as on the
+// CPU, and stays on the device; only the GEMM is timed
+double RunGPUFilterBank(const gpuContextStruct& gpu, const float * pFilters, int nFilters, float * pOutputs)
+{
+  const int nFilterWidth = params.nFilterWidth;
+  const int nPaddedPitch = params.nWidth + nFilterWidth - 1;
+  const int nPaddedHeight = params.nHeight + nFilterWidth - 1;
+  const int nPlaneSize = params.nPitch * params.nHeight;
+  const int nPixels = params.nWidth * params.nHeight;
+
+  std::vector<float> padded((size_t) nPaddedPitch * nPaddedHeight);
+  PadImage(hostBuffers.pInput, &padded[0], params.nPitch, nPaddedPitch, params.nWidth, params.nHeight,
+	   nFilterWidth, params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS);
+
+  cl::Buffer paddedBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			  padded.size() * sizeof(float), &padded[0]);
+  cl::Buffer filterBuffer(gpu.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			  nFilters * nFilterWidth * nFilterWidth * sizeof(float), (void *) pFilters);
+  cl::Buffer outputBuffer(gpu.context, CL_MEM_WRITE_ONLY, (size_t) nFilters * nPlaneSize * sizeof(float));
+
+  cl::Kernel kernel(gpu.program, "filter_bank_gemm");
+  kernel.setArg(0, paddedBuffer);
+  kernel.setArg(1, filterBuffer);
+  kernel.setArg(2, outputBuffer);
+  kernel.setArg(3, nPaddedPitch);
+  kernel.setArg(4, params.nPitch);
+  kernel.setArg(5, nPlaneSize);
+  kernel.setArg(6, nFilterWidth);
+  kernel.setArg(7, params.nWidth);
+  kernel.setArg(8, params.nHeight);
+  kernel.setArg(9, nFilters);
+
+  // BANK_TILE_N / BANK_WPT x BANK_TILE_M work-items per 64-pixel x
+  // 16-filter tile, see convolution.cl
+  const cl::NDRange local(16, 16);
+  const cl::NDRange global((nPixels + 63) / 64 * 16, (nFilters + 15) / 16 * 16);
+
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+    gpu.queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
+  gpu.queue.finish();
+
+  timers.counter.Stop();
+
+  gpu.queue.enqueueReadBuffer(outputBuffer, CL_TRUE, 0, (size_t) nFilters * nPlaneSize * sizeof(float), pOutputs);
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// Banks of 1, 2, 4, ... filters up to params.nBankFilters, each one
+// convolved filter by filter with ConvolveWithBorder() and as one
+// GEMM on the CPU and / or the device. Every plane of a GEMM result
+// is checked against the filter by filter one.
+void RunFilterBank()
+{
+  const int nMaxFilters = params.nBankFilters;
+  const int nFilterSize = params.nFilterWidth * params.nFilterWidth;
+  const size_t nPlaneSize = (size_t) params.nPitch * params.nHeight;
+
+  float * pFilters = (float *) malloc((size_t) nMaxFilters * nFilterSize * sizeof(float));
+  float * pReference = (float *) malloc(nMaxFilters * nPlaneSize * sizeof(float));
+  float * pOutputs = (float *) malloc(nMaxFilters * nPlaneSize * sizeof(float));
+  if (!pFilters || !pReference || !pOutputs)
+  {
+    FREE(pFilters, NULL);
+    FREE(pReference, NULL);
+    FREE(pOutputs, NULL);
+    throw(string("RunFilterBank()::Could not allocate memory"));
+  }
+  InitBankFilters(pFilters, nMaxFilters);
+
+  gpuContextStruct gpu;
+  if (params.nMode != 0)
+    InitGPU(gpu);
+
+  cout << "Filter bank:    up to " << nMaxFilters << " filters of " << params.nFilterWidth << " x " << params.nFilterWidth << endl;
+
+  filterBank bank;
+  for (int nFilters = 1; ; nFilters = std::min(2 * nFilters, nMaxFilters))
+  {
+    InitFilterBank(bank, pFilters, nFilters, params.nFilterWidth);
+
+    cout << "\n********    " << nFilters << (nFilters > 1 ? " filters" : " filter") << "    ********" << endl;
+
+    // Reference planes, also the comparison base of the GPU run
+    timers.counter.Reset();
+    timers.counter.Start();
+    for (int i = 0; i < params.nIterations; i++)
+      for (int f = 0; f < nFilters; f++)
+	ConvolveWithBorder(hostBuffers.pInput, pFilters + f * nFilterSize, pReference + f * nPlaneSize,
+			   params.nPitch, params.nWidth, params.nHeight, params.nFilterWidth,
+			   params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS);
+    timers.counter.Stop();
+
+    if (params.nMode < 1)
+    {
+      const double dSingle = timers.counter.GetElapsedTime()/double(params.nIterations);
+
+      timers.counter.Reset();
+      timers.counter.Start();
+      for (int i = 0; i < params.nIterations; i++)
+	ConvolveFilterBank(bank, hostBuffers.pInput, pOutputs, params.nPitch, params.nWidth, params.nHeight,
+			   params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS);
+      timers.counter.Stop();
+      const double dBank = timers.counter.GetElapsedTime()/double(params.nIterations);
+
+      double dMaxDiff = 0;
+      for (int f = 0; f < nFilters; f++)
+	dMaxDiff = std::max(dMaxDiff, MaxDifference(pOutputs + f * nPlaneSize, pReference + f * nPlaneSize));
+
+      cout << "CPU filter by filter (" << DEFAULT_NUM_THREADS << "-threads): ";
+      PrintBankTime(nFilters, dSingle);
+      cout << endl << "CPU bank GEMM (" << DEFAULT_NUM_THREADS << "-threads):        ";
+      PrintBankTime(nFilters, dBank);
+      cout << endl << "Max difference: " << dMaxDiff << endl;
+    }
+
+    if (params.nMode != 0)
+    {
+      const double dBank = RunGPUFilterBank(gpu, pFilters, nFilters, pOutputs);
+
+      double dMaxDiff = 0;
+      for (int f = 0; f < nFilters; f++)
+	dMaxDiff = std::max(dMaxDiff, MaxDifference(pOutputs + f * nPlaneSize, pReference + f * nPlaneSize));
+
+      cout << "GPU bank GEMM:                    ";
+      PrintBankTime(nFilters, dBank);
+      cout << endl << "Max difference: " << dMaxDiff << endl;
+    }
+
+    if (nFilters == nMaxFilters)
+      break;
+  }
+
+  FREE(pFilters, NULL);
+  FREE(pReference, NULL);
+  FREE(pOutputs, NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+// Image-size sweep
+/////////////////////////////////////////////////////////////////
+
+const char * SweepPitchName(int nPitchMode)
+{
+  return (nPitchMode == SWEEP_PITCH_POW2) ? "pow2" : "padded";
+}
+
+const char * SweepWidthName(int nWidthMode)
+{
+  const char * names[SWEEP_WIDTH_COUNT] = {"pow2", "odd", "wide"};
+  return names[nWidthMode];
+}
+
+int SweepWidth(int nSize, int nWidthMode)
+{
+  if (nWidthMode == SWEEP_WIDTH_ODD)
+    return nSize - 1;
+  if (nWidthMode == SWEEP_WIDTH_WIDE)
+    return nSize * 3 / 2 + 1;
+  return nSize;
+}
+
+// Pitch in pixels. Below 4 KiB rows AlignedPitch() keeps a power of
+// two, so the padded pitch then moves on by one alignment step: the
+// two modes never time the same layout.
+int SweepPitch(int nWidth, int nPixelSize, int nPitchMode)
+{
+  int nPow2 = 1;
+  while (nPow2 < nWidth)
+    nPow2 *= 2;
+
+  if (nPitchMode == SWEEP_PITCH_POW2)
+    return nPow2;
+
+  const int nPitch = AlignedPitch(nWidth, nPixelSize);
+  return (nPitch == nPow2) ? AlignedPitch(nPitch + 1, nPixelSize) : nPitch;
+}
+
+// nSize high images of the current data type and channels, with their
+// host buffers and tiles
+void InitSweepImage(int nSize, int nWidthMode, int nPitchMode)
+{
+  ReleaseHostBuffers();
+
+  params.nWidth = SweepWidth(nSize, nWidthMode);
+  params.nHeight = nSize;
+  params.nPitch = SweepPitch(params.nWidth, sizeof(float), nPitchMode);
+  params.nTypedPitch = SweepPitch(params.nWidth, DataTypeSize(params.nDataType), nPitchMode);
+
+  InitHostBuffers();
+  BuildTiles(params.nWidth, params.nHeight, params.nTileSize, params.nTileOrder, scheduler.tiles);
+}
+
+// At least params.nIterations, more on small images and filters so
+// that every point is timed over SWEEP_MIN_TAPS taps
+static int SweepIterations(int nFilterWidth)
+{
+  const double dTaps = double(params.nWidth) * params.nHeight * nFilterWidth * nFilterWidth;
+  return std::max(params.nIterations, (int) ceil(SWEEP_MIN_TAPS / dTaps));
+}
+
+static void PrintSweepTime(double dTime)
+{
+  const double dPixelTime = dTime * 1e9 / (double(params.nWidth) * params.nHeight);
+
+  cout << std::fixed << std::setprecision(3) << setw(10) << dPixelTime
+       << std::defaultfloat << std::setprecision(6);
+}
+
+// Every enabled engine on images of height SWEEP_MIN_SIZE, twice
+// that, ... up to params.nSweepSize, each with the widths of
+// sweepWidth and a padded and a power-of-two pitch, over the benchmark
+// filter widths, up to -f when given. Prints and writes ns per
+// output pixel; the surface of an engine, width and pitch over (image
+// height, filter width) goes to
+// data/sweep/<cpu|gpu>_<engine>_<width>_<pitch>.dat.
+void RunSizeSweep()
+{
+  const int nWidth = params.nWidth, nHeight = params.nHeight;
+  const int nPitch = params.nPitch, nTypedPitch = params.nTypedPitch;
+  const int nIterations = params.nIterations;
+
+  // The default -f of 3 would leave two filter widths, no surface
+  int nMaxFilterWidth = benchmarkFilterWidths[BENCHMARK_FILTER_COUNT - 1];
+  if (params.bFilterWidthSet)
+    nMaxFilterWidth = params.nFilterWidth;
+
+  StatFile cpuFiles[CPU_ENGINE_COUNT][SWEEP_WIDTH_COUNT][SWEEP_PITCH_COUNT];
+  StatFile gpuFiles[GPU_ENGINE_COUNT][SWEEP_WIDTH_COUNT][SWEEP_PITCH_COUNT];
+
+  StatFile::clearDirectory("data");
+  StatFile::clearDirectory("data/sweep");
+  for (int w = 0; w < SWEEP_WIDTH_COUNT; w++)
+    for (int p = 0; p < SWEEP_PITCH_COUNT; p++)
+    {
+      const string suffix = string("_") + SweepWidthName(w) + "_" + SweepPitchName(p) + ".dat";
+      if (params.nMode < 1)
+	for (int e = 0; e < CPU_ENGINE_COUNT; e++)
+	  if (CPUEngineEnabled(driverState, e))
+	    cpuFiles[e][w][p].open((string("data/sweep/cpu_") + CPUEngineName(e) + suffix).c_str());
+      if (params.nMode != 0)
+	for (int e = 0; e < GPU_ENGINE_COUNT; e++)
+	  if (GPUEngineEnabled(driverState, e))
+	    gpuFiles[e][w][p].open((string("data/sweep/gpu_") + GPUEngineName(e) + suffix).c_str());
+    }
+
+  gpuContextStruct gpu;
+  if (params.nMode != 0)
+    InitGPU(gpu, SelectDevice(params.nSweepSize, params.nSweepSize, params.nFilterWidth));
+
+  TilePool pool(DEFAULT_NUM_THREADS);
+  scheduler.pPool = &pool;
+
+  cout << "Size sweep:     " << SWEEP_MIN_SIZE << " to " << params.nSweepSize
+       << ", filter widths up to " << nMaxFilterWidth << ", ns per output pixel (CPU " << DEFAULT_NUM_THREADS << "-threads)" << endl;
+
+  for (int nSize = SWEEP_MIN_SIZE; nSize <= params.nSweepSize; nSize *= 2)
+    for (int w = 0; w < SWEEP_WIDTH_COUNT; w++)
+      for (int p = 0; p < SWEEP_PITCH_COUNT; p++)
+      {
+	InitSweepImage(nSize, w, p);
+
+	cout << "\n********    " << params.nWidth << " x " << nSize << ", " << SweepPitchName(p) << " pitch " << params.nPitch
+	     << " (" << (size_t) params.nPitch * params.nHeight * sizeof(float) / 1024 << " KiB)    ********" << endl;
+	cout << std::left << setw(20) << "filter width" << std::right;
+	for (int j = 0; j < BENCHMARK_FILTER_COUNT; j++)
+	  if (benchmarkFilterWidths[j] <= nMaxFilterWidth && benchmarkFilterWidths[j] <= std::min(params.nWidth, params.nHeight))
+	    cout << setw(10) << benchmarkFilterWidths[j];
+	cout << endl;
+
+	for (int e = 0; e < CPU_ENGINE_COUNT && params.nMode < 1; e++)
+	{
+	  if (!CPUEngineEnabled(driverState, e))
+	    continue;
+
+	  cout << std::left << setw(20) << (string("cpu ") + CPUEngineName(e)) << std::right;
+	  for (int j = 0; j < BENCHMARK_FILTER_COUNT; j++)
+	  {
+	    const int nFilterWidth = benchmarkFilterWidths[j];
+	    if (nFilterWidth > nMaxFilterWidth || nFilterWidth > std::min(params.nWidth, params.nHeight))
+	      continue;
+	    // Enabled again per width, the box engines depend on the taps
+	    InitFilterHostBuffer(nFilterWidth);
+	    if (!CPUEngineEnabled(driverState, e) || !CPUEngineSupported(e, nFilterWidth))
+	    {
+	      cout << setw(10) << "n/a";
+	      continue;
+	    }
+
+	    params.nIterations = SweepIterations(nFilterWidth);
+	    timers.dCpuTime = TimeCPU(driverState, e, nFilterWidth, DEFAULT_NUM_THREADS, params.nSchedule);
+	    params.nIterations = nIterations;
+
+	    cpuFiles[e][w][p].add(nSize, nFilterWidth, timers.dCpuTime * 1e9 / (double(params.nWidth) * nSize));
+	    PrintSweepTime(timers.dCpuTime);
+	  }
+	  cpuFiles[e][w][p].endBlock();
+	  cout << endl;
+	}
+
+	for (int e = 0; e < GPU_ENGINE_COUNT && params.nMode != 0; e++)
+	{
+	  if (!GPUEngineEnabled(driverState, e))
+	    continue;
+
+	  cout << std::left << setw(20) << (string("gpu ") + GPUEngineName(e)) << std::right;
+	  for (int j = 0; j < BENCHMARK_FILTER_COUNT; j++)
+	  {
+	    const int nFilterWidth = benchmarkFilterWidths[j];
+	    if (nFilterWidth > nMaxFilterWidth || nFilterWidth > std::min(params.nWidth, params.nHeight))
+	      continue;
+	    // Enabled again per width, the box engines depend on the taps
+	    InitFilterHostBuffer(nFilterWidth);
+	    if (!GPUEngineEnabled(driverState, e) || !GPUEngineSupported(e, nFilterWidth))
+	    {
+	      cout << setw(10) << "n/a";
+	      continue;
+	    }
+
+	    params.nIterations = SweepIterations(nFilterWidth);
+	    timers.dGpuTime = RunGPUConvolution(driverState, gpu.context, gpu.queue, gpu.program, e, nFilterWidth);
+	    params.nIterations = nIterations;
+
+	    gpuFiles[e][w][p].add(nSize, nFilterWidth, timers.dGpuTime * 1e9 / (double(params.nWidth) * nSize));
+	    PrintSweepTime(timers.dGpuTime);
+	  }
+	  gpuFiles[e][w][p].endBlock();
+	  cout << endl;
+	}
+      }
+
+  scheduler.pPool = NULL;
+
+  for (int w = 0; w < SWEEP_WIDTH_COUNT; w++)
+    for (int p = 0; p < SWEEP_PITCH_COUNT; p++)
+    {
+      for (int e = 0; e < CPU_ENGINE_COUNT; e++)
+	cpuFiles[e][w][p].close();
+      for (int e = 0; e < GPU_ENGINE_COUNT; e++)
+	gpuFiles[e][w][p].close();
+    }
+
+  params.nWidth = nWidth;
+  params.nHeight = nHeight;
+  params.nPitch = nPitch;
+  params.nTypedPitch = nTypedPitch;
+}
+
+/////////////////////////////////////////////////////////////////
+// Spatio-temporal benchmark
+/////////////////////////////////////////////////////////////////
+
+#define TEMPORAL_SOURCE_FRAMES 8	// Distinct frames the stream cycles through
+
+// params.nTemporalFrames slices of params.nFilterWidth x
+// params.nFilterWidth taps, slice j taking the workload counters after
+// slice j - 1. The slices are scaled by 1 / t, so a normalized filter
+// type stays normalized over the whole window.
+void InitTemporalFilter(float * pFilter)
+{
+  const int nFrames = params.nTemporalFrames;
+  const int nSliceSize = params.nFilterWidth * params.nFilterWidth;
+
+  for (int j = 0; j < nFrames; j++)
+    InitFilterTaps(pFilter + j * nSliceSize, params.nFilterWidth, j * nSliceSize);
+  for (int i = 0; i < nFrames * nSliceSize; i++)
+    pFilter[i] /= nFrames;
+}
+
+// Frame nFrame of the stream: source nFrame % TEMPORAL_SOURCE_FRAMES,
+// which is the input of seed -z + that source
+static const float * StreamFrame(const float * pSources, int nFrame)
+{
+  return pSources + (size_t) (nFrame % TEMPORAL_SOURCE_FRAMES) * params.nPitch * params.nHeight;
+}
+
+static void PrintTemporalTime(double dTime)
+{
+  cout << 1.0 / dTime << " fps (" << dTime << " s/frame)";
+  if (params.bEnergy)
+    cout << EnergySummary(driverState, dTime);
+  cout << endl;
+}
+
+// Seconds per output frame over params.nIterations frames, after the
+// t - 1 frames that fill the window. The ring pushes each frame once;
+// the volume variant refills the whole window per output, the cost
+// the ring avoids. pOutput receives the last output frame.
+double TimeTemporalCPU(const float * pSources, const float * pFilter, bool bRing, float * pOutput)
+{
+  const int nFrames = params.nTemporalFrames;
+  std::vector<const float *> frames(nFrames);
+
+  frameWindow window;
+  InitFrameWindow(window, nFrames, params.nPitch, params.nHeight);
+  if (bRing)
+    for (int n = 0; n < nFrames - 1; n++)
+      PushFrame(window, StreamFrame(pSources, n), DEFAULT_NUM_THREADS);
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+  {
+    const int nFrame = nFrames - 1 + i;
+
+    if (bRing)
+      PushFrame(window, StreamFrame(pSources, nFrame), DEFAULT_NUM_THREADS);
+    else
+    {
+      window.nPushed = 0;
+      for (int j = 0; j < nFrames; j++)
+	PushFrame(window, StreamFrame(pSources, std::max(nFrame - nFrames + 1 + j, 0)), DEFAULT_NUM_THREADS);
+    }
+    WindowFrames(window, &frames[0]);
+
+    ConvolveTemporal(&frames[0], nFrames, pFilter, pOutput,
+		     params.nPitch, params.nWidth, params.nHeight, params.nFilterWidth,
+		     params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS);
+  }
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  ReleaseFrameWindow(window);
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// The device keeps the ring of t slots in one buffer. Every output
+// frame is written, convolved and read back on one in-order queue, so
+// a slot is only overwritten once the kernels reading it are done.
+// The volume variant uploads the whole window per output instead of
+// the newest frame.
+double RunGPUTemporal(const gpuContextStruct& gpu, const float * pSources, const float * pFilter, bool bRing)
+{
+  const cl::Context& context = gpu.context;
+  const cl::CommandQueue& queue = gpu.queue;
+  const int nFrames = params.nTemporalFrames;
+  const size_t frameBytes = (size_t) params.nPitch * params.nHeight * sizeof(float);
+  const size_t filterBytes = (size_t) nFrames * params.nFilterWidth * params.nFilterWidth * sizeof(float);
+
+  cl::Buffer ringBuffer(context, CL_MEM_READ_ONLY, nFrames * frameBytes);
+  cl::Buffer filterBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filterBytes, (void *) pFilter);
+  cl::Buffer outputBuffer(context, CL_MEM_WRITE_ONLY, frameBytes);
+
+  cl::Kernel kernel(gpu.program, "convolve_temporal");
+  kernel.setArg(0, ringBuffer);
+  kernel.setArg(1, filterBuffer);
+  kernel.setArg(2, outputBuffer);
+  kernel.setArg(3, params.nPitch);
+  kernel.setArg(4, params.nFilterWidth);
+  kernel.setArg(5, nFrames);
+  kernel.setArg(7, params.nWidth);
+  kernel.setArg(8, params.nHeight);
+  kernel.setArg(9, params.nBorderMode);
+  kernel.setArg(10, params.fBorderValue);
+
+  if (bRing)
+  {
+    for (int n = 0; n < nFrames - 1; n++)
+      queue.enqueueWriteBuffer(ringBuffer, CL_FALSE, TemporalSlot(n, nFrames, nFrames - 1) * frameBytes,
+			       frameBytes, StreamFrame(pSources, n));
+    queue.finish();
+  }
+
+  if (params.bEnergy)
+    timers.energy.Start();
+  timers.counter.Reset();
+  timers.counter.Start();
+
+  for (int i = 0; i < params.nIterations; i++)
+  {
+    const int nFrame = nFrames - 1 + i;
+
+    if (bRing)
+    {
+      queue.enqueueWriteBuffer(ringBuffer, CL_FALSE, TemporalSlot(nFrame, nFrames, nFrames - 1) * frameBytes,
+			       frameBytes, StreamFrame(pSources, nFrame));
+      kernel.setArg(6, nFrame);
+    }
+    else
+    {
+      // Window j in slot j, the slots of frame t - 1
+      for (int j = 0; j < nFrames; j++)
+	queue.enqueueWriteBuffer(ringBuffer, CL_FALSE, j * frameBytes, frameBytes,
+				 StreamFrame(pSources, std::max(nFrame - nFrames + 1 + j, 0)));
+      kernel.setArg(6, nFrames - 1);
+    }
+
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(params.nWidth, params.nHeight), cl::NullRange);
+    queue.enqueueReadBuffer(outputBuffer, CL_FALSE, 0, frameBytes, hostBuffers.pOutputGPU);
+  }
+  queue.finish();
+
+  timers.counter.Stop();
+  if (params.bEnergy)
+    timers.energy.Stop();
+
+  return timers.counter.GetElapsedTime()/double(params.nIterations);
+}
+
+// A stream of params.nIterations frames through a
+// params.nFilterWidth x params.nFilterWidth x params.nTemporalFrames
+// filter, with the frame ring and with the volume refilled per
+// output, on the CPU and / or the device. The last output frame of
+// every run is checked against the CPU ring one.
+void RunTemporal()
+{
+  const int nFrames = params.nTemporalFrames;
+  const size_t nFrameSize = (size_t) params.nPitch * params.nHeight;
+  const size_t nFilterSize = (size_t) nFrames * params.nFilterWidth * params.nFilterWidth;
+
+  float * pSources = (float *) malloc(TEMPORAL_SOURCE_FRAMES * nFrameSize * sizeof(float));
+  float * pFilter = (float *) malloc(nFilterSize * sizeof(float));
+  if (!pSources || !pFilter)
+  {
+    FREE(pSources, NULL);
+    FREE(pFilter, NULL);
+    throw(string("RunTemporal()::Could not allocate memory"));
+  }
+
+  for (int s = 0; s < TEMPORAL_SOURCE_FRAMES; s++)
+    FillPattern(pSources + s * nFrameSize, params.nPitch, params.nWidth, params.nHeight, 1,
+		params.nInputPattern, params.nSeed + s, WORKLOAD_STREAM_INPUT, DEFAULT_NUM_THREADS);
+  InitTemporalFilter(pFilter);
+
+  gpuContextStruct gpu;
+  if (params.nMode != 0)
+    InitGPU(gpu);
+
+  cout << "Temporal:       " << params.nFilterWidth << " x " << params.nFilterWidth << " x " << nFrames
+       << " filter, " << params.nIterations << " frames" << endl;
+
+  if (params.nMode < 1)
+  {
+    const double dRing = TimeTemporalCPU(pSources, pFilter, true, hostBuffers.pOutputCPU);
+    const double dVolume = TimeTemporalCPU(pSources, pFilter, false, hostBuffers.pOutputGPU);
+
+    cout << "CPU ring (" << DEFAULT_NUM_THREADS << "-threads):   ";
+    PrintTemporalTime(dRing);
+    cout << "CPU volume (" << DEFAULT_NUM_THREADS << "-threads): ";
+    PrintTemporalTime(dVolume);
+    cout << "Max difference: " << MaxDifference(hostBuffers.pOutputGPU, hostBuffers.pOutputCPU) << endl;
+  }
+  else
+  {
+    // Reference of the last frame only
+    std::vector<const float *> frames(nFrames);
+    const int nLast = nFrames - 2 + params.nIterations;
+    for (int j = 0; j < nFrames; j++)
+      frames[j] = StreamFrame(pSources, std::max(nLast - nFrames + 1 + j, 0));
+    ConvolveTemporal(&frames[0], nFrames, pFilter, hostBuffers.pOutputCPU,
+		     params.nPitch, params.nWidth, params.nHeight, params.nFilterWidth,
+		     params.nBorderMode, params.fBorderValue, DEFAULT_NUM_THREADS);
+  }
+
+  if (params.nMode != 0)
+  {
+    const double dRing = RunGPUTemporal(gpu, pSources, pFilter, true);
+    const double dRingDiff = MaxDifference(hostBuffers.pOutputGPU, hostBuffers.pOutputCPU);
+    const double dVolume = RunGPUTemporal(gpu, pSources, pFilter, false);
+    const double dVolumeDiff = MaxDifference(hostBuffers.pOutputGPU, hostBuffers.pOutputCPU);
+
+    cout << "GPU ring:       ";
+    PrintTemporalTime(dRing);
+    cout << "GPU volume:     ";
+    PrintTemporalTime(dVolume);
+    cout << "Max difference: " << std::max(dRingDiff, dVolumeDiff) << endl;
+  }
+
+  FREE(pSources, NULL);
+  FREE(pFilter, NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+// Incremental benchmark
+/////////////////////////////////////////////////////////////////
+
+// Square of params.nChangedArea percent of the image over frame n of
+// the feed, moving by a quarter of its side per frame
+static imageRect FeedObject(int nFrame)
+{
+  const double dArea = params.nChangedArea / 100.0 * params.nWidth * params.nHeight;
+  const int nSide = std::min((int) sqrt(dArea), std::min(params.nWidth, params.nHeight));
+  const int nStep = std::max(1, nSide / 4);
+
+  imageRect object;
+  object.x0 = (nFrame * nStep) % (params.nWidth - nSide + 1);
+  object.y0 = (nFrame * nStep / 2) % (params.nHeight - nSide + 1);
+  object.x1 = object.x0 + nSide;
+  object.y1 = object.y0 + nSide;
+  return object;
+}
+
+// Turns frame n - 1 of the feed in hostBuffers.pInput into frame n:
+// the object leaves the background behind it and is drawn at its new
+// place, one step brighter or darker than before
+static void DrawFeedFrame(const float * pBackground, int nFrame)
+{
+  const imageRect object = FeedObject(nFrame);
+  const float fObject = (nFrame % 2) ? 0.75f : 0.25f;
+
+  if (nFrame > 0)
+  {
+    const imageRect previous = FeedObject(nFrame - 1);
+    for (int y = previous.y0; y < previous.y1; y++)
+      memcpy(hostBuffers.pInput + y * params.nPitch + previous.x0, pBackground + y * params.nPitch + previous.x0,
+	     (previous.x1 - previous.x0) * sizeof(float));
+  }
+  for (int y = object.y0; y < object.y1; y++)
+    for (int x = object.x0; x < object.x1; x++)
+      hostBuffers.pInput[y * params.nPitch + x] = pBackground[y * params.nPitch + x] + fObject;
+}
+
+// Dirty mask of frame n as a motion detector would give it: the tiles
+// under the object's previous and current places
+static void FeedMask(const incrementalState& state, int nFrame, unsigned char * pMask)
+{
+  const imageRect object = FeedObject(nFrame);
+  const imageRect previous = FeedObject(std::max(nFrame - 1, 0));
+
+  for (int i = 0; i < IncrementalTileCount(state); i++)
+  {
+    const imageRect tile = IncrementalTile(state, i);
+    imageRect a = {std::max(tile.x0, object.x0), std::max(tile.y0, object.y0),
+		   std::min(tile.x1, object.x1), std::min(tile.y1, object.y1)};
+    imageRect b = {std::max(tile.x0, previous.x0), std::max(tile.y0, previous.y0),
+		   std::min(tile.x1, previous.x1), std::min(tile.y1, previous.y1)};
+    pMask[i] = !RectEmpty(a) || !RectEmpty(b);
+  }
+}
+
+// Frames 1 .. params.nIterations of the feed, after frame 0 which
+// fills the output: whole-image convolutions with the selected engine
+// and schedule, or with bIncremental the dirty output tiles only,
+// from DiffTiles() or, with bMask, from the feed's dirty mask. The
+// tile counts are summed into pDirtyInput and pDirtyOutput. Returns
+// seconds per frame; only the convolution is timed, not the feed.
+double TimeIncremental(const float * pBackground, int engine, bool bIncremental, bool bMask,
+		       long * pDirtyInput, long * pDirtyOutput)
+{
+  const int nTileSchedule = (params.nSchedule == SCHEDULE_ENGINE) ? SCHEDULE_OMP_DYNAMIC : params.nSchedule;
+
+  cpuTileContext context;
+  context.pState = &driverState;
+  context.engine = engine;
+  context.nFilterWidth = params.nFilterWidth;
+
+  incrementalState state;
+  InitIncremental(state, params.nPitch, params.nWidth, params.nHeight, params.nTileSize);
+  std::vector<unsigned char> mask(IncrementalTileCount(state));
+
+  memcpy(hostBuffers.pInput, pBackground, params.nPitch * params.nHeight * sizeof(float));
+
+  double dTime = 0;
+  *pDirtyInput = 0;
+  *pDirtyOutput = 0;
+  for (int n = 0; n <= params.nIterations; n++)
+  {
+    DrawFeedFrame(pBackground, n);
+    if (bMask)
+      FeedMask(state, n, &mask[0]);
+
+    const double dStart = omp_get_wtime();
+    if (!bIncremental)
+      ConvolveCPU(driverState, engine, params.nFilterWidth, DEFAULT_NUM_THREADS, params.nSchedule);
+    else
+    {
+      const int nDirty = bMask ? SetDirtyTiles(state, &mask[0], hostBuffers.pInput, DEFAULT_NUM_THREADS)
+	: DiffTiles(state, hostBuffers.pInput, DEFAULT_NUM_THREADS);
+      DirtyOutputTiles(state, params.nFilterWidth, params.nBorderMode);
+      RunTiles(nTileSchedule, state.dirtyTiles, ConvolveCPUTileFunction, &context,
+	       DEFAULT_NUM_THREADS, scheduler.pPool);
+
+      if (n > 0)
+      {
+	*pDirtyInput += nDirty;
+	*pDirtyOutput += (long) state.dirtyTiles.size();
+      }
+    }
+    if (n > 0)
+      dTime += omp_get_wtime() - dStart;
+  }
+
+  ReleaseIncremental(state);
+  return dTime / params.nIterations;
+}
+
+static void PrintIncrementalTime(double dTime, double dFullTime, long nDirtyInput, long nDirtyOutput, long nTiles)
+{
+  cout << dTime << " s/frame, " << 100.0 * (nTiles - nDirtyInput) / nTiles << "% of input tiles unchanged, "
+       << 100.0 * (nTiles - nDirtyOutput) / nTiles << "% of output tiles skipped, speedup "
+       << dFullTime / dTime << "x" << endl;
+}
+
+// A feed of mostly static frames, a moving object over the -d input,
+// convolved whole and incrementally with the engine of the filter.
+// The last incremental outputs are checked against the whole one.
+void RunIncremental()
+{
+  if (params.nDataType != DATA_FLOAT || params.nChannels > 1)
+    throw(string("RunIncremental()::Only single-channel float images"));
+
+  const size_t nImageSize = (size_t) params.nPitch * params.nHeight;
+  const int engine = SelectedCPUEngine(driverState, params.nFilterWidth);
+  const int nTilesX = (params.nWidth + params.nTileSize - 1) / params.nTileSize;
+  const int nTilesY = (params.nHeight + params.nTileSize - 1) / params.nTileSize;
+  const long nTiles = (long) nTilesX * nTilesY * params.nIterations;
+
+  float * pBackground = (float *) malloc(nImageSize * sizeof(float));
+  if (!pBackground)
+    throw(string("RunIncremental()::Could not allocate memory"));
+  memcpy(pBackground, hostBuffers.pInput, nImageSize * sizeof(float));
+
+  TilePool pool(DEFAULT_NUM_THREADS);
+  scheduler.pPool = &pool;
+  BuildTiles(params.nWidth, params.nHeight, params.nTileSize, params.nTileOrder, scheduler.tiles);
+
+  cout << "Incremental:    object of " << params.nChangedArea << "% of the frame, " << nTilesX << " x " << nTilesY
+       << " tiles of " << params.nTileSize << " x " << params.nTileSize << ", " << CPUEngineName(engine)
+       << " engine, " << params.nIterations << " frames" << endl;
+
+  long nDirtyInput, nDirtyOutput;
+
+  const double dFull = TimeIncremental(pBackground, engine, false, false, &nDirtyInput, &nDirtyOutput);
+  memcpy(hostBuffers.pOutputGPU, hostBuffers.pOutputCPU, nImageSize * sizeof(float));
+  cout << "Full (" << DEFAULT_NUM_THREADS << "-threads): " << dFull << " s/frame" << endl;
+
+  const double dDiff = TimeIncremental(pBackground, engine, true, false, &nDirtyInput, &nDirtyOutput);
+  const double dDiffDifference = MaxDifference(hostBuffers.pOutputCPU, hostBuffers.pOutputGPU);
+  cout << "Diff (" << DEFAULT_NUM_THREADS << "-threads): ";
+  PrintIncrementalTime(dDiff, dFull, nDirtyInput, nDirtyOutput, nTiles);
+
+  const double dMask = TimeIncremental(pBackground, engine, true, true, &nDirtyInput, &nDirtyOutput);
+  const double dMaskDifference = MaxDifference(hostBuffers.pOutputCPU, hostBuffers.pOutputGPU);
+  cout << "Mask (" << DEFAULT_NUM_THREADS << "-threads): ";
+  PrintIncrementalTime(dMask, dFull, nDirtyInput, nDirtyOutput, nTiles);
+
+  cout << "Max difference: " << std::max(dDiffDifference, dMaskDifference) << endl;
+
+  scheduler.pPool = NULL;
+  memcpy(hostBuffers.pInput, pBackground, nImageSize * sizeof(float));
+  FREE(pBackground, NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+// Main
+/////////////////////////////////////////////////////////////////
+
+int main(int argc, char * argv[])
+{
+  try
+  {
+    InitParams(argc, argv);
+    OpenHwCounters();
+    OpenEnergyCounters();
+
+    if (params.pServicePath)
+    {
+      RunService();
+      ReleaseHostBuffers();
+      return 0;
+    }
+    if (params.pRingName)
+    {
+      RunFrameRings();
+      ReleaseHostBuffers();
+      return 0;
+    }
+    if (params.nJobs > 0)
+    {
+      RunJobs();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    PrintInfo();
+
+    if (params.pPipeline)
+    {
+      InitHostBuffers();
+      RunPipelineBenchmark();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    if (params.nPyramidLevels > 0)
+    {
+      InitHostBuffers();
+      RunPyramid();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    if (params.nBankFilters > 0)
+    {
+      InitHostBuffers();
+      RunFilterBank();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    if (params.nSweepSize > 0)
+    {
+      RunSizeSweep();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    if (params.nTemporalFrames > 0)
+    {
+      InitHostBuffers();
+      RunTemporal();
+      ReleaseHostBuffers();
+      return 0;
+    }
+
+    if (params.nChangedArea >= 0)
+    {
+      InitHostBuffers();
+      RunIncremental();
+      ReleaseHostBuffers();
+      return 0;
+    }
 
     InitHostBuffers();
     InitStatFiles();
@@ -282,11 +3372,13 @@ int main(int argc, char * argv[])
     switch (params.nMode)
     {
     case -1:
-      RunCPU(4);
+      for (int run = 0; run < params.nOmpRuns; run++)
+	RunCPU(run);
       RunGPU();
       break;
     case 0:
-      RunCPU(4);
+      for (int run = 0; run < params.nOmpRuns; run++)
+	RunCPU(run);
       break;
     case 1:
       RunGPU();